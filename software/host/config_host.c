@@ -0,0 +1,141 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// Stand-in for the configuration layer (config.c) when building for the host:
+// returns the default settings of the firmware, modifiable via host_config.
+
+#include <string.h>
+#include "config.h"
+#include "font.h"
+#include "host.h"
+
+struct HostConfigStruct host_config =
+  {
+    .ttype = CFG_TTYPE_VT102, .recvCR = 1, .recvLF = 2, .recvBS = 1, .recvDEL = 2, .echo = 0, .cursor = 0, .clearBit7 = 0,
+    .fgcolor = 7, .bgcolor = 0, .attr = 0,
+    .scrolldelay = 170,
+    .rows = 30, .cols = 80, .dblchars = 1, .font = FONT_ID_VGA, .bfont = FONT_ID_NONE, .display = CFG_DISPTYPE_VGA, .mono = 0, .blink = 60,
+    .scrolllock = 1, .syncupdates = 0, .zmodemauto = 0
+  };
+
+static const uint8_t default_colors_ansi_dvi[16] =
+  {0b000000, 0b100000, 0b001000, 0b101000, 0b000010, 0b100010, 0b001010, 0b101010, 
+   0b010101, 0b110000, 0b001100, 0b111100, 0b000011, 0b110011, 0b001111, 0b111111};
+
+static const uint8_t default_colors_ansi_vga[16] =
+  {0b00000000, 0b10000000, 0b00010000, 0b10010000, 0b00000010, 0b10000010, 0b00010010, 0b10010010, 
+   0b01001001, 0b11100000, 0b00011100, 0b11111100, 0b00000011, 0b11100011, 0b00011111, 0b11111111};
+
+static const uint8_t default_colors_petscii_dvi[16] =
+  {0b000000, 0b111111, 0b100000, 0b001010, 0b100010, 0b001000, 0b000010, 0b111100, 
+   0b111000, 0b100100, 0b110000, 0b010101, 0b101010, 0b001100, 0b000011, 0b101010};
+
+static const uint8_t default_colors_petscii_vga[16] =
+  {0b00000000, 0b11111111, 0b10000000, 0b00010010, 0b10000010, 0b00010000, 0b00000010, 0b11111100, 
+   0b10001000, 0b01000100, 0b11100000, 0b01001001, 0b10010010, 0b00011100, 0b00000011, 0b10110110};
+
+static uint8_t keyboard_data[4096];
+
+
+uint32_t config_get_serial_baud()        { return 115200; }
+uint8_t  config_get_serial_bits()        { return 8; }
+char     config_get_serial_parity()      { return 'N'; }
+uint8_t  config_get_serial_stopbits()    { return 1; }
+uint8_t  config_get_serial_ctsmode()     { return 0; }
+uint8_t  config_get_serial_rtsmode()     { return 0; }
+uint8_t  config_get_serial_xonxoff()     { return 0; }
+uint16_t config_get_serial_blink()       { return 0; }
+uint8_t  config_get_serial_rx_highmark() { return 75; }
+uint8_t  config_get_serial_rx_lowmark()  { return 25; }
+
+uint8_t config_get_screen_rows()         { return host_config.rows; }
+uint8_t config_get_screen_cols()         { return host_config.cols; }
+bool    config_get_screen_dblchars()     { return host_config.dblchars!=0; }
+uint8_t config_get_screen_font_normal()  { return host_config.font; }
+uint8_t config_get_screen_font_bold()    { return host_config.bfont; }
+uint8_t config_get_screen_blink_period() { return host_config.blink; }
+uint8_t config_get_screen_display()      { return host_config.display; }
+bool    config_get_screen_monochrome()   { return host_config.mono!=0; }
+bool    config_get_screen_sync_updates() { return host_config.syncupdates!=0; }
+
+uint8_t config_get_screen_monochrome_backgroundcolor(bool dvi)
+{
+  return dvi ? default_colors_ansi_dvi[0] : default_colors_ansi_vga[0];
+}
+
+uint8_t config_get_screen_monochrome_textcolor_normal(bool dvi)
+{
+  return dvi ? default_colors_ansi_dvi[7] : default_colors_ansi_vga[7];
+}
+
+uint8_t config_get_screen_monochrome_textcolor_bold(bool dvi)
+{
+  return dvi ? default_colors_ansi_dvi[15] : default_colors_ansi_vga[15];
+}
+
+uint8_t config_get_screen_color(uint8_t color, bool dvi)
+{
+  if( host_config.ttype==CFG_TTYPE_PETSCII )
+    return dvi ? default_colors_petscii_dvi[color&15] : default_colors_petscii_vga[color&15];
+  else
+    return dvi ? default_colors_ansi_dvi[color&15] : default_colors_ansi_vga[color&15];
+}
+
+uint8_t config_get_terminal_type()          { return host_config.ttype; }
+uint8_t config_get_terminal_localecho()     { return host_config.echo; }
+uint8_t config_get_terminal_cursortype()    { return host_config.cursor; }
+uint8_t config_get_terminal_cr()            { return host_config.recvCR; }
+uint8_t config_get_terminal_lf()            { return host_config.recvLF; }
+uint8_t config_get_terminal_bs()            { return host_config.recvBS; }
+uint8_t config_get_terminal_del()           { return host_config.recvDEL; }
+bool    config_get_terminal_clearBit7()     { return host_config.clearBit7!=0; }
+bool    config_get_terminal_uppercase()     { return false; }
+uint16_t config_get_terminal_scrolldelay()  { return host_config.scrolldelay; }
+bool    config_get_terminal_zmodem_autostart() { return host_config.zmodemauto!=0; }
+uint8_t config_get_terminal_default_fg()    { return host_config.fgcolor; }
+uint8_t config_get_terminal_default_bg()    { return host_config.bgcolor; }
+uint8_t config_get_terminal_default_attr()  { return host_config.attr; }
+const char *config_get_terminal_answerback() { return ""; }
+
+uint8_t  config_get_keyboard_layout()          { return 0; }
+uint8_t  config_get_keyboard_enter()           { return 0; }
+uint8_t  config_get_keyboard_backspace()       { return 0; }
+uint8_t  config_get_keyboard_delete()          { return 1; }
+uint8_t  config_get_keyboard_scroll_lock()     { return host_config.scrolllock; }
+uint8_t  config_get_keyboard_repeat_delay()    { return 3; }
+uint8_t  config_get_keyboard_repeat_rate()     { return 25; }
+uint16_t config_get_keyboard_repeat_delay_ms() { return 250; }
+uint16_t config_get_keyboard_repeat_rate_mHz() { return 30000; }
+uint8_t  *config_get_keyboard_user_mapping()   { return keyboard_data; }
+uint8_t  *config_get_keyboard_macros_start()   { return keyboard_data+256; }
+
+uint16_t config_get_audible_bell_frequency()   { return 440; }
+uint16_t config_get_audible_bell_volume()      { return 50; }
+uint16_t config_get_audible_bell_duration()    { return 100; }
+uint16_t config_get_visual_bell_color()        { return 0; }
+uint8_t  config_get_visual_bell_duration()     { return 0; }
+
+uint8_t config_get_usb_mode()    { return CFG_USBMODE_OFF; }
+uint8_t config_get_usb_cdcmode() { return 0; }
+
+void config_show_splash()        {}
+bool config_load(uint8_t n)      { return false; }
+bool config_menu_active()        { return false; }
+void config_init()               {}
+int  config_menu()               { return 0; }
@@ -0,0 +1,189 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// In-memory framebuffer backend for the host build. It stands in for both the
+// DVI and VGA backends, storing each character cell as one 32-bit word
+// (character, attribute, background, foreground) just like the VGA backend.
+
+#include <string.h>
+#include "framebuf.h"
+#include "framebuf_dvi.h"
+#include "framebuf_vga.h"
+#include "host.h"
+
+static uint32_t *cells = NULL;
+static bool inverted = false;
+static uint8_t cursor_row, cursor_rows, cursor_col, cursor_attr = 0;
+
+
+void framebuf_vga_charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n)
+{
+  uint32_t w = c + (a<<8) + (bg << 16) + (fg << 24);
+  for(size_t i=0; i<n; i++) cells[idx+i] = w;
+}
+
+void framebuf_vga_charmemmove(uint32_t toidx, uint32_t fromidx, size_t n)
+{
+  memmove(cells+toidx, cells+fromidx, n*4);
+}
+
+void framebuf_vga_set_char(uint32_t idx, uint8_t c)
+{
+  cells[idx] = (cells[idx] & 0xFFFFFF00) | c;
+}
+
+uint8_t framebuf_vga_get_char(uint32_t idx)
+{
+  return cells[idx] & 0xFF;
+}
+
+void framebuf_vga_set_attr(uint32_t idx, uint8_t a)
+{
+  cells[idx] = (cells[idx] & 0xFFFF00FF) | (a << 8);
+}
+
+uint8_t framebuf_vga_get_attr(uint32_t idx)
+{
+  return (cells[idx] >> 8) & 0xFF;
+}
+
+void framebuf_vga_set_color(uint32_t idx, uint8_t fg, uint8_t bg)
+{
+  cells[idx] = (cells[idx] & 0x0000FFFF) | (bg << 16) | (fg << 24);
+}
+
+void framebuf_vga_get_color(uint32_t idx, uint8_t *fg, uint8_t *bg)
+{
+  *bg = (cells[idx] >> 16) & 0xFF;
+  *fg = (cells[idx] >> 24) & 0xFF;
+}
+
+void framebuf_vga_set_char_and_attr(uint32_t idx, uint32_t c)
+{
+  cells[idx] = c;
+}
+
+uint32_t framebuf_vga_get_char_and_attr(uint32_t idx)
+{
+  return cells[idx];
+}
+
+void framebuf_vga_get_chars_and_attrs(uint32_t idx, uint32_t *buf, size_t n)
+{
+  memcpy(buf, cells+idx, n*4);
+}
+
+void framebuf_vga_set_inverted(bool invert)
+{
+  inverted = invert;
+}
+
+void framebuf_vga_set_cursor(uint8_t row, uint8_t nrows, uint8_t col, uint8_t attr)
+{
+  cursor_row  = row;
+  cursor_rows = nrows;
+  cursor_col  = col;
+  cursor_attr = attr;
+}
+
+uint8_t framebuf_vga_set_columns(uint8_t ncols)
+{
+  // same column counts as the VGA backend
+#if VERSATERM_VGA_WIDE
+  return ncols > VGA_FRAME_WIDTH / FONT_CHAR_WIDTH ? 132 : VGA_FRAME_WIDTH / FONT_CHAR_WIDTH;
+#else
+  return FRAME_WIDTH / FONT_CHAR_WIDTH;
+#endif
+}
+
+void framebuf_vga_init(uint8_t *databuf, uint16_t *rowinfo)
+{
+  cells = (uint32_t *) databuf;
+}
+
+
+// the DVI backend functions use the same storage (colors are RGB222 values)
+void framebuf_dvi_charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n) { framebuf_vga_charmemset(idx, c, a, fg, bg, n); }
+void framebuf_dvi_charmemmove(uint32_t toidx, uint32_t fromidx, size_t n) { framebuf_vga_charmemmove(toidx, fromidx, n); }
+void framebuf_dvi_set_char(uint32_t idx, uint8_t c)                 { framebuf_vga_set_char(idx, c); }
+uint8_t framebuf_dvi_get_char(uint32_t idx)                         { return framebuf_vga_get_char(idx); }
+void framebuf_dvi_set_attr(uint32_t idx, uint8_t a)                 { framebuf_vga_set_attr(idx, a); }
+uint8_t framebuf_dvi_get_attr(uint32_t idx)                         { return framebuf_vga_get_attr(idx); }
+void framebuf_dvi_set_color(uint32_t idx, uint8_t fg, uint8_t bg)   { framebuf_vga_set_color(idx, fg, bg); }
+void framebuf_dvi_get_color(uint32_t idx, uint8_t *fg, uint8_t *bg) { framebuf_vga_get_color(idx, fg, bg); }
+void framebuf_dvi_set_char_and_attr(uint32_t idx, uint32_t c)       { framebuf_vga_set_char_and_attr(idx, c); }
+uint32_t framebuf_dvi_get_char_and_attr(uint32_t idx)               { return framebuf_vga_get_char_and_attr(idx); }
+void framebuf_dvi_get_chars_and_attrs(uint32_t idx, uint32_t *buf, size_t n) { framebuf_vga_get_chars_and_attrs(idx, buf, n); }
+void framebuf_dvi_set_inverted(bool invert)                         { framebuf_vga_set_inverted(invert); }
+void framebuf_dvi_set_cursor(uint8_t row, uint8_t nrows, uint8_t col, uint8_t attr) { framebuf_vga_set_cursor(row, nrows, col, attr); }
+void framebuf_dvi_init(uint8_t *databuf, uint16_t *rowinfo)         { framebuf_vga_init(databuf, rowinfo); }
+
+uint8_t framebuf_dvi_set_columns(uint8_t ncols)
+{
+  // same column counts as the DVI backend
+#if VERSATERM_DVI_WIDE
+  return ncols > DVI_FRAME_WIDTH / FONT_CHAR_WIDTH ? 132 : DVI_FRAME_WIDTH / FONT_CHAR_WIDTH;
+#else
+  return MAX_COLS;
+#endif
+}
+
+
+void framebuf_host_dump(FILE *f)
+{
+  uint8_t nrows = framebuf_get_nrows();
+  uint8_t ncols = framebuf_get_ncols(-1);
+
+  fprintf(f, "screen %ix%i %s%s\n", ncols, nrows, framebuf_is_dvi() ? "dvi" : "vga", inverted ? " inverted" : "");
+  if( cursor_attr!=0 )
+    fprintf(f, "cursor display row %i (%i rows), column %i, attr %X\n", cursor_row, cursor_rows, cursor_col, cursor_attr);
+
+  fprintf(f, "[chars]\n");
+  for(int y=0; y<nrows; y++)
+    {
+      fprintf(f, "%02i %i |", y, framebuf_get_row_attr(y));
+      for(int x=0; x<ncols; x++)
+        {
+          uint8_t c = framebuf_get_char(x, y);
+          fputc(x<framebuf_get_ncols(y) ? (c>=32 && c<127 ? c : '.') : ' ', f);
+        }
+      fprintf(f, "|\n");
+    }
+
+  fprintf(f, "[attrs]\n");
+  for(int y=0; y<nrows; y++)
+    {
+      fprintf(f, "%02i |", y);
+      for(int x=0; x<framebuf_get_ncols(y); x++) fprintf(f, "%X", framebuf_get_attr(x, y) & 15);
+      fprintf(f, "|\n");
+    }
+
+  fprintf(f, "[colors fg/bg]\n");
+  for(int y=0; y<nrows; y++)
+    {
+      fprintf(f, "%02i |", y);
+      for(int x=0; x<framebuf_get_ncols(y); x++)
+        {
+          uint8_t fg, bg;
+          framebuf_get_fullcolor(x, y, &fg, &bg);
+          fprintf(f, "%02X%02X ", fg, bg);
+        }
+      fprintf(f, "|\n");
+    }
+}
@@ -0,0 +1,52 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+// settings used by the host stand-in for the configuration layer (config_host.c),
+// may be changed before calling host_init()
+struct HostConfigStruct
+{
+  uint8_t  ttype, recvCR, recvLF, recvBS, recvDEL, echo, cursor, clearBit7;
+  uint8_t  fgcolor, bgcolor, attr;
+  uint16_t scrolldelay;
+  uint8_t  rows, cols, dblchars, font, bfont, display, mono, blink;
+  uint8_t  scrolllock;
+  uint8_t  syncupdates;
+  uint8_t  zmodemauto;
+};
+
+extern struct HostConfigStruct host_config;
+
+// initialize terminal core (framebuffer, fonts, keyboard, terminal) using host_config
+void host_init();
+
+// data sent by the terminal to the serial port (e.g. replies to status queries)
+// is collected here, host_serial_output_len is reset by the caller
+extern char   host_serial_output[1024];
+extern size_t host_serial_output_len;
+
+// print the current screen content (characters, attributes and colors) as text
+void framebuf_host_dump(FILE *f);
+
+#endif
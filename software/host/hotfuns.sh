@@ -0,0 +1,70 @@
+#!/bin/sh
+# -----------------------------------------------------------------------------
+# VersaTerm - A versatile serial terminal
+# Copyright (C) 2022 David Hansel
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software Foundation,
+# Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+# -----------------------------------------------------------------------------
+
+# Regenerates the "hot path" function list: builds the host terminal core
+# with gprof instrumentation, replays all vtbench workloads and lists every
+# firmware function that is called at least once per MIN_BYTES received
+# bytes (default 100) or uses at least MIN_TIME percent (default 2) of the
+# run time (and is called at least once per 10KB), together with its current placement in the firmware sources:
+#   HOTFUN  marked with HOTFUN(), runs from SRAM
+#   ram     marked with __not_in_flash_func(), runs from SRAM
+#   flash   runs from flash (candidate for HOTFUN)
+#   -       not part of the firmware (host stubs)
+#
+# usage (from the "software" directory): host/hotfuns.sh [build-dir]
+
+set -e
+
+BUILD=${1:-build-prof}
+MIN_BYTES=${MIN_BYTES:-100}
+MIN_TIME=${MIN_TIME:-2}
+HOST=$(cd "$(dirname "$0")" && pwd)
+SRC=$HOST/../src
+
+cmake -S "$HOST" -B "$BUILD" -DCMAKE_BUILD_TYPE=Release -DVERSATERM_PROFILE=ON >/dev/null
+cmake --build "$BUILD" --target vtbench >/dev/null
+
+cd "$BUILD"
+rm -f gmon.out gmon.sum
+BYTES=0
+for d in dvi vga; do
+  n=$(./vtbench -f csv -d $d | awk -F, 'NR>1 { n += $4*$5 } END { printf "%.0f", n }')
+  BYTES=$((BYTES + n))
+  if [ -f gmon.sum ]; then gprof -s ./vtbench gmon.out gmon.sum; else mv gmon.out gmon.sum; fi
+done
+echo "# $BYTES bytes received, functions called at least once per $MIN_BYTES bytes or using >= $MIN_TIME% time"
+echo "# calls/KB  time%  placement  function"
+
+gprof -b -p ./vtbench gmon.sum | awk -v bytes="$BYTES" -v minb="$MIN_BYTES" -v mint="$MIN_TIME" '
+  $1 ~ /^[0-9.]+$/ {
+    calls = (NF>=7) ? $4 : 0
+    if( calls*10240 >= bytes && (calls*minb >= bytes || $1 >= mint) ) printf "%s %.1f %s\n", $NF, $1, calls*1024/bytes
+  }' | sort -k3 -g -r | while read -r fn pct perkb; do
+  if grep -q "HOTFUN($fn)" "$SRC"/*.c "$SRC"/*.cpp; then
+    where=HOTFUN
+  elif grep -q "__not_in_flash_func($fn)" "$SRC"/*.c "$SRC"/*.cpp; then
+    where=ram
+  elif grep -Eq "^[A-Za-z].*[ *]$fn\(" "$SRC"/*.c "$SRC"/*.cpp; then
+    where=flash
+  else
+    where=-
+  fi
+  printf "%10.1f %6.1f  %-9s  %s\n" "$perkb" "$pct" "$where" "$fn"
+done
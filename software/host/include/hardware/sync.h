@@ -0,0 +1,37 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#ifndef _HARDWARE_SYNC_H
+#define _HARDWARE_SYNC_H
+
+#include "pico/stdlib.h"
+
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t status) {}
+static inline void __dmb(void) { __sync_synchronize(); }
+
+// the host build is single-threaded: a spin lock is always free when
+// read (reading a hardware spin lock claims it) and locking is a no-op
+typedef volatile uint32_t spin_lock_t;
+static inline int spin_lock_claim_unused(bool required) { return 0; }
+static inline spin_lock_t *spin_lock_instance(unsigned int lock_num) { static spin_lock_t lock = 1; return &lock; }
+static inline void spin_lock_unsafe_blocking(spin_lock_t *lock) {}
+static inline void spin_unlock_unsafe(spin_lock_t *lock) {}
+
+#endif
@@ -0,0 +1,73 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// Minimal stand-in for the pico-sdk "pico/stdlib.h" header so the terminal
+// core can be compiled and run on the host (see host/CMakeLists.txt)
+
+#ifndef _PICO_STDLIB_H
+#define _PICO_STDLIB_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t;
+
+#define __in_flash(group)
+#define __not_in_flash(group)
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+
+#ifndef MIN
+#define MIN(a, b) ((b)>(a)?(a):(b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) ((a)>(b)?(a):(b))
+#endif
+
+#define GPIO_OUT 1
+#define GPIO_IN  0
+
+static inline void gpio_init(uint gpio) {}
+static inline void gpio_set_dir(uint gpio, bool out) {}
+static inline void gpio_put(uint gpio, bool value) {}
+static inline bool gpio_get(uint gpio) { return false; }
+static inline void gpio_pull_up(uint gpio) {}
+
+static inline absolute_time_t get_absolute_time(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec) * 1000000u + ts.tv_nsec / 1000;
+}
+
+static inline uint32_t to_ms_since_boot(absolute_time_t t) { return (uint32_t) (t / 1000); }
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) { return get_absolute_time() + ((uint64_t) ms) * 1000; }
+static inline absolute_time_t make_timeout_time_us(uint64_t us) { return get_absolute_time() + us; }
+static inline bool time_reached(absolute_time_t t) { return get_absolute_time() >= t; }
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) { return (int64_t) (to - from); }
+static inline uint32_t time_us_32(void) { return (uint32_t) get_absolute_time(); }
+static inline void sleep_ms(uint32_t ms) {}
+static inline void busy_wait_us(uint32_t us) {}
+
+#endif
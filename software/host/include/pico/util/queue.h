@@ -0,0 +1,75 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// Single-threaded host implementation of the pico-sdk queue
+
+#ifndef _PICO_UTIL_QUEUE_H
+#define _PICO_UTIL_QUEUE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+typedef struct
+{
+  uint8_t *data;
+  uint16_t wptr, rptr, element_size, element_count;
+} queue_t;
+
+static inline void queue_init(queue_t *q, uint element_size, uint element_count)
+{
+  q->data = (uint8_t *) calloc(element_count+1, element_size);
+  q->element_size  = element_size;
+  q->element_count = element_count;
+  q->wptr = q->rptr = 0;
+}
+
+static inline uint queue_get_level(queue_t *q)
+{
+  int level = q->wptr - q->rptr;
+  return level<0 ? level + q->element_count + 1 : level;
+}
+
+static inline bool queue_is_empty(queue_t *q) { return q->wptr==q->rptr; }
+static inline bool queue_is_full(queue_t *q)  { return queue_get_level(q)==q->element_count; }
+
+static inline bool queue_try_add(queue_t *q, const void *data)
+{
+  if( queue_is_full(q) ) return false;
+  memcpy(q->data + q->wptr * q->element_size, data, q->element_size);
+  q->wptr = (q->wptr+1) % (q->element_count+1);
+  return true;
+}
+
+static inline bool queue_try_remove(queue_t *q, void *data)
+{
+  if( queue_is_empty(q) ) return false;
+  memcpy(data, q->data + q->rptr * q->element_size, q->element_size);
+  q->rptr = (q->rptr+1) % (q->element_count+1);
+  return true;
+}
+
+static inline bool queue_try_peek(queue_t *q, void *data)
+{
+  if( queue_is_empty(q) ) return false;
+  memcpy(data, q->data + q->rptr * q->element_size, q->element_size);
+  return true;
+}
+
+#endif
@@ -0,0 +1,114 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// Stand-ins for the serial, sound, USB/PS2 keyboard and flash hardware layers
+// when building the terminal core for the host
+
+#include <string.h>
+#include "hardware/flash.h"
+#include "serial.h"
+#include "sound.h"
+#include "keyboard.h"
+#include "keyboard_usb.h"
+#include "keyboard_ps2.h"
+#include "framebuf.h"
+#include "terminal.h"
+#include "font.h"
+#include "host.h"
+
+uint8_t host_flash_memory[PICO_FLASH_SIZE_BYTES];
+char    host_serial_output[1024];
+size_t  host_serial_output_len = 0;
+
+
+void wait(uint32_t milliseconds)
+{
+  // nothing to wait for on the host (scroll delay, scroll lock etc.)
+}
+
+
+void run_tasks(bool processInput)
+{
+}
+
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+  if( flash_offs+count <= PICO_FLASH_SIZE_BYTES )
+    memset(host_flash_memory+flash_offs, 0xFF, count);
+}
+
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+  // programming flash can only clear bits
+  if( flash_offs+count <= PICO_FLASH_SIZE_BYTES )
+    for(size_t i=0; i<count; i++)
+      host_flash_memory[flash_offs+i] &= data[i];
+}
+
+
+void serial_set_break(bool set) {}
+bool serial_readable() { return false; }
+void serial_task(bool processInput) {}
+void serial_apply_settings() {}
+void serial_init() {}
+
+void serial_send_char(char c)
+{
+  if( host_serial_output_len < sizeof(host_serial_output) )
+    host_serial_output[host_serial_output_len++] = c;
+}
+
+
+void serial_send_string(const char *s)
+{
+  while( *s ) serial_send_char(*s++);
+}
+
+
+int serial_xmodem_receive_char(int msDelay) { return -1; }
+void serial_xmodem_send_data(const char *data, int size) {}
+
+
+void sound_ringbell() {}
+void sound_play_tone(uint16_t frequency, uint16_t duration_ms, uint8_t volume, bool wait) {}
+bool sound_playing() { return false; }
+void sound_init() {}
+
+
+void keyboard_usb_set_led_status(uint8_t leds) {}
+void keyboard_usb_init() {}
+void keyboard_usb_task() {}
+void keyboard_usb_apply_settings() {}
+
+void keyboard_ps2_set_led_status(uint8_t leds) {}
+void keyboard_ps2_task() {}
+void keyboard_ps2_init() {}
+void keyboard_ps2_apply_settings() {}
+
+
+void host_init()
+{
+  memset(host_flash_memory, 0xFF, sizeof(host_flash_memory));
+  host_serial_output_len = 0;
+  keyboard_init();
+  framebuf_init(false);
+  terminal_init();
+}
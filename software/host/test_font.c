@@ -0,0 +1,231 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// Streams font files (BMP, PSF1, PSF2 and BDF, all generated from the built-in
+// VGA font) through font_receive_start/data/finish in uneven chunk sizes,
+// applies the resulting user font and compares the screen font data with
+// the data of the built-in VGA font.
+//
+// usage: test_font (exit status 0 if all tests pass)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+#include "font.h"
+#include "test_helper.h"
+
+#define FONT_DATA_SIZE (16*256*4)
+
+static uint8_t  file[64*1024];
+static size_t   fileLen;
+static uint8_t  glyphs[256][16];
+static uint8_t  reference[FONT_DATA_SIZE];
+
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+
+static void get_vga_glyphs()
+{
+  // inverse of the bitmap layout handled by set_font_data() in font.c
+  uint32_t w, h;
+  uint8_t  ch;
+  font_get_font_info(FONT_ID_VGA, &w, &h, &ch, NULL);
+  const uint8_t *bmp = font_get_bmpdata(FONT_ID_VGA);
+
+  memset(glyphs, 0, sizeof(glyphs));
+  for(uint32_t br=0; br<h; br++)
+    for(uint32_t bc=0; bc<w/8; bc++)
+      {
+        uint32_t cr = (h-br-1) % ch;
+        uint32_t cn = ((h-br-1)/ch)*(w/8) + bc;
+        if( cn<256 ) glyphs[cn][cr] = bmp[br*w/8+bc];
+      }
+}
+
+
+static void make_bmp()
+{
+  // 2048x16 monochrome bitmap, bottom-up, 8 pixel wide characters side by side
+  memset(file, 0, 62);
+  file[0] = 'B'; file[1] = 'M';
+  put_le32(file+0x0a, 62);
+  put_le32(file+0x0e, 40);
+  put_le32(file+0x12, 2048);
+  put_le32(file+0x16, 16);
+  file[0x1a] = 1;
+  file[0x1c] = 1;
+  for(int r=0; r<16; r++)
+    for(int c=0; c<256; c++)
+      file[62+(15-r)*256+c] = glyphs[c][r];
+  fileLen = 62+16*256;
+  put_le32(file+2, fileLen);
+}
+
+
+static void make_psf1()
+{
+  // 512 glyph PSF1 font, glyphs 256-511 must be ignored
+  file[0] = 0x36; file[1] = 0x04; file[2] = 0x01; file[3] = 16;
+  for(int c=0; c<512; c++)
+    for(int r=0; r<16; r++)
+      file[4+c*16+r] = (c<256) ? glyphs[c][r] : 0xAA;
+  fileLen = 4+512*16;
+}
+
+
+static void make_psf2()
+{
+  // PSF2 with a 40 byte header (larger than the minimum) and 256 glyphs
+  memset(file, 0, 40);
+  put_le32(file+0,  0x864AB572);
+  put_le32(file+8,  40);
+  put_le32(file+16, 256);
+  put_le32(file+20, 16);
+  put_le32(file+24, 16);
+  put_le32(file+28, 8);
+  for(int c=0; c<256; c++)
+    memcpy(file+40+c*16, glyphs[c], 16);
+  fileLen = 40+256*16;
+}
+
+
+static void make_bdf()
+{
+  // CRLF line endings, glyphs listed in reverse order and with bounding
+  // boxes trimmed to their non-empty rows to exercise glyph placement
+  char *s = (char *) file;
+  s += sprintf(s, "STARTFONT 2.1\r\nFONT -test-vga\r\nSIZE 16 75 75\r\n"
+               "FONTBOUNDINGBOX 8 16 0 -4\r\nCHARS 256\r\n");
+  for(int c=255; c>=0; c--)
+    {
+      int top = 0, bottom = 15;
+      while( top<16 && glyphs[c][top]==0 ) top++;
+      while( bottom>top && glyphs[c][bottom]==0 ) bottom--;
+      if( top==16 ) { top = 0; bottom = -1; }
+
+      s += sprintf(s, "STARTCHAR c%02x\r\nENCODING %d\r\nSWIDTH 500 0\r\nDWIDTH 8 0\r\n", c, c);
+      s += sprintf(s, "BBX 8 %d 0 %d\r\nBITMAP\r\n", bottom-top+1, -4+(15-bottom));
+      for(int r=top; r<=bottom; r++)
+        s += sprintf(s, (c & 1) ? "%02x\r\n" : "%02X\r\n", glyphs[c][r]);
+      s += sprintf(s, "ENDCHAR\r\n");
+    }
+
+  s += sprintf(s, "ENDFONT\r\n");
+  fileLen = s - (char *) file;
+}
+
+
+static const char *upload(const int *chunks, int numChunks, const char *fileName)
+{
+  const char *err = font_receive_start();
+  if( err!=NULL ) return err;
+
+  size_t pos = 0;
+  for(int i=0; pos<fileLen; i++)
+    {
+      size_t n = chunks[i % numChunks];
+      if( n>fileLen-pos ) n = fileLen-pos;
+      font_receive_data(i+1, (char *) file+pos, n);
+      pos += n;
+    }
+
+  return font_receive_finish(0, true, fileName);
+}
+
+
+static void check_font(const char *name, const int *chunks, int numChunks)
+{
+  const char *err = upload(chunks, numChunks, "/tmp/testfont.v1.dat");
+  check(err==NULL, name, err==NULL ? "" : err);
+  if( err!=NULL ) return;
+
+  uint32_t w, h;
+  uint8_t  ch, ul;
+  check(font_get_font_info(FONT_ID_USER1, &w, &h, &ch, &ul), name, "no font info");
+  check(w==2048 && h==16 && ch==16 && ul==14, name, "wrong font geometry");
+  check(strcmp(font_get_name(FONT_ID_USER1), "testfont")==0, name, "font not named after file");
+
+  // switch away from the user font and clear the font data so the comparison
+  // below sees what applying the uploaded font produced
+  font_apply_font(FONT_ID_VGA, false);
+  memset((uint8_t *) font_get_data(), 0, FONT_DATA_SIZE);
+  check(font_apply_font(FONT_ID_USER1, false), name, "font not applied");
+
+  int bad = 0;
+  for(int r=0; r<16; r++)
+    for(int c=0; c<256; c++)
+      if( font_get_data()[r*1024+c]!=reference[r*1024+c] )
+        bad++;
+
+  check(bad==0, name, "font data differs from the VGA font");
+}
+
+
+int main()
+{
+  static const int oneBlock[]    = {128};
+  static const int unevenXM[]    = {128, 1024, 128, 128, 1024};
+  static const int unevenSmall[] = {128, 1, 7, 300, 2, 61, 1024, 3};
+
+  host_init();
+  get_vga_glyphs();
+  font_apply_font(FONT_ID_VGA, false);
+  memcpy(reference, font_get_data(), FONT_DATA_SIZE);
+
+  make_bmp();
+  check_font("bmp", oneBlock, 1);
+  check_font("bmp uneven", unevenSmall, 8);
+
+  make_psf1();
+  check_font("psf1", unevenXM, 5);
+  check_font("psf1 uneven", unevenSmall, 8);
+
+  make_psf2();
+  check_font("psf2", unevenXM, 5);
+  check_font("psf2 uneven", unevenSmall, 8);
+
+  make_bdf();
+  check_font("bdf", unevenXM, 5);
+  check_font("bdf uneven", unevenSmall, 8);
+
+  // split the FONTBOUNDINGBOX line in the middle of its numbers
+  const char *p = strstr((const char *) file, "BOX 8 16");
+  int split[] = {(int) (p - (const char *) file) + 6, (int) fileLen};
+  check_font("bdf split line", split, 2);
+
+  // errors
+  static const char garbage[] = "GARBAGE, not a font file";
+  memcpy(file, garbage, sizeof(garbage)); fileLen = sizeof(garbage);
+  check(upload(oneBlock, 1, NULL)!=NULL, "garbage", "no error");
+
+  make_psf2();
+  put_le32(file+28, 9);
+  check(upload(oneBlock, 1, NULL)!=NULL, "psf2 9 pixels wide", "no error");
+
+  make_bdf();
+  fileLen = strstr((const char *) file, "FONTBOUNDINGBOX") - (const char *) file;
+  check(upload(oneBlock, 1, NULL)!=NULL, "bdf without bounding box", "no error");
+
+  return test_result("font");
+}
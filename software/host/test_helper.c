@@ -0,0 +1,117 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include "test_helper.h"
+
+static int inFd, outFd, failures = 0;
+
+
+void check(bool ok, const char *name, const char *what)
+{
+  if( !ok )
+    {
+      printf("FAIL %s: %s\n", name, what);
+      failures++;
+    }
+}
+
+
+int test_result(const char *suite)
+{
+  if( failures==0 )
+    printf("all %s tests passed\n", suite);
+  else
+    printf("%s tests FAILED\n", suite);
+
+  return failures==0 ? 0 : 1;
+}
+
+
+int pipe_recv_char(int msDelay)
+{
+  struct pollfd p = {inFd, POLLIN, 0};
+  unsigned char c;
+  if( poll(&p, 1, msDelay)<=0 || read(inFd, &c, 1)!=1 ) return -1;
+  return c;
+}
+
+
+void pipe_send_data(const char *buf, int len)
+{
+  while( len>0 )
+    {
+      ssize_t n = write(outFd, buf, len);
+      if( n<=0 ) return;
+      buf += n;
+      len -= n;
+    }
+}
+
+
+void pipe_send_char(uint8_t c)
+{
+  pipe_send_data((const char *) &c, 1);
+}
+
+
+bool pipe_read(uint8_t *buf, int len)
+{
+  for(int i=0; i<len; i++)
+    {
+      int c = pipe_recv_char(2000);
+      if( c<0 ) return false;
+      buf[i] = c;
+    }
+
+  return true;
+}
+
+
+pid_t start_peer(bool (*peer)())
+{
+  int toPeer[2], fromPeer[2];
+  if( pipe(toPeer)!=0 || pipe(fromPeer)!=0 ) { perror("pipe"); exit(1); }
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if( pid<0 ) { perror("fork"); exit(1); }
+  if( pid==0 )
+    {
+      close(toPeer[1]); close(fromPeer[0]);
+      inFd = toPeer[0]; outFd = fromPeer[1];
+      _exit(peer() ? 0 : 1);
+    }
+
+  close(toPeer[0]); close(fromPeer[1]);
+  inFd = fromPeer[0]; outFd = toPeer[1];
+  return pid;
+}
+
+
+bool finish_peer(pid_t pid)
+{
+  int status;
+  close(inFd); close(outFd);
+  return waitpid(pid, &status, 0)==pid && WIFEXITED(status) && WEXITSTATUS(status)==0;
+}
@@ -0,0 +1,51 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#ifndef TEST_HELPER_H
+#define TEST_HELPER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+// shared by the host tests (test_*.c)
+
+// reports a failed check as "FAIL name: what" and counts it
+void check(bool ok, const char *name, const char *what);
+
+// prints the summary line for the given test suite, returns the exit status
+int test_result(const char *suite);
+
+// runs peer() in a child process connected to this process by two pipes, the
+// pipe_* functions below then talk to the child (in the parent) or to the
+// parent (in the child). finish_peer closes the pipes and returns true if
+// peer() returned true.
+pid_t start_peer(bool (*peer)());
+bool  finish_peer(pid_t pid);
+
+// receive/send functions as used by the xmodem/zmodem code, pipe_recv_char
+// returns -1 if no character arrives within msDelay
+int  pipe_recv_char(int msDelay);
+void pipe_send_data(const char *buf, int len);
+void pipe_send_char(uint8_t c);
+
+// reads len characters (at most 2 seconds apart), false on timeout
+bool pipe_read(uint8_t *buf, int len);
+
+#endif
@@ -0,0 +1,289 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// XMODEM/YMODEM loopback test: xmodem_transmit/ymodem_transmit and xmodem_receive
+// run in two processes (xmodem.c keeps its state in static variables) connected
+// by a pair of pipes. Corrupted frames, checksum transfers and the NAK answer
+// to EOT some YMODEM receivers give are covered by scripted stand-ins for the
+// sender and receiver. Prints the time per KB of the loopback transfers.
+//
+// usage: test_xmodem (exit status 0 if all tests pass)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "xmodem.h"
+#include "test_helper.h"
+
+#define SOH 0x01
+#define STX 0x02
+#define EOT 0x04
+#define ACK 0x06
+#define NAK 0x15
+#define CAN 0x18
+#define SUB 0x1A
+
+#define MAX_DATA (256*1024)
+
+static uint8_t data[MAX_DATA], received[MAX_DATA+1024];
+static long    dataLen, receivedLen;
+static int     blockSizes[2048], numBlocks;
+
+
+static bool transmit_data(unsigned long no, char *buf, int len)
+{
+  // block size is the same for all blocks of a transfer
+  long offset = (no-1)*len;
+  if( offset>=dataLen ) return false;
+  for(int i=0; i<len; i++) buf[i] = offset+i<dataLen ? data[offset+i] : SUB;
+  return true;
+}
+
+
+static bool receive_data(unsigned long no, char *buf, int len)
+{
+  if( numBlocks<2048 ) blockSizes[numBlocks++] = len;
+  memcpy(received+receivedLen, buf, len);
+  receivedLen += len;
+  return true;
+}
+
+
+static uint16_t crc16(const uint8_t *buf, int len)
+{
+  uint16_t crc = 0;
+  while( len-->0 )
+    {
+      crc ^= *buf++ << 8;
+      for(int i=0; i<8; i++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+  return crc;
+}
+
+
+static void make_data(long len, unsigned seed)
+{
+  srand(seed);
+  for(long i=0; i<len; i++) data[i] = rand();
+  dataLen = len;
+}
+
+
+static bool receive(const char *name, bool (*peer)())
+{
+  receivedLen = 0;
+  numBlocks = 0;
+
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  pid_t pid = start_peer(peer);
+  bool ok = xmodem_receive(pipe_recv_char, pipe_send_data, receive_data);
+  bool peerOk = finish_peer(pid);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  check(ok, name, "xmodem_receive failed");
+  check(peerOk, name, "sender failed");
+
+  double ms = (t1.tv_sec-t0.tv_sec)*1e3 + (t1.tv_nsec-t0.tv_nsec)/1e6;
+  if( dataLen>=64*1024 ) printf("%-24s %7li bytes %8.3f ms/KB\n", name, dataLen, ms/(dataLen/1024.0));
+  return ok && peerOk;
+}
+
+
+static bool check_blocks(const char *name, int size, int lastSize)
+{
+  bool ok = numBlocks>0;
+  for(int i=0; i<numBlocks; i++)
+    ok &= blockSizes[i]==(i<numBlocks-1 ? size : lastSize);
+
+  check(ok, name, "unexpected block sizes");
+  return ok;
+}
+
+
+// ---- XMODEM-CRC and YMODEM loopback -------------------------------------------------------------
+
+
+static bool peer_xmodem_transmit()
+{
+  return xmodem_transmit(pipe_recv_char, pipe_send_data, transmit_data);
+}
+
+
+static bool peer_ymodem_transmit()
+{
+  return ymodem_transmit(pipe_recv_char, pipe_send_data, transmit_data, "dir/test.bin", dataLen);
+}
+
+
+static void test_xmodem_loopback(long len)
+{
+  char name[40];
+  snprintf(name, sizeof(name), "xmodem-crc %li", len);
+  make_data(len, len);
+  if( !receive(name, peer_xmodem_transmit) ) return;
+
+  // plain XMODEM receivers only accept 128 byte blocks, there is no
+  // file size => last block is padded
+  long padded = (len+127) & ~127;
+  check_blocks(name, 128, 128);
+  check(receivedLen==padded, name, "wrong length");
+  check(memcmp(received, data, len)==0, name, "data differs");
+  for(long i=len; i<padded; i++)
+    if( received[i]!=SUB ) { check(false, name, "padding missing"); break; }
+
+  check(xmodem_get_filename()==NULL && xmodem_get_filesize()==-1, name, "file name/size for XMODEM transfer");
+}
+
+
+static void test_ymodem_loopback(long len)
+{
+  char name[40];
+  snprintf(name, sizeof(name), "ymodem %li", len);
+  make_data(len, len);
+  if( !receive(name, peer_ymodem_transmit) ) return;
+
+  // the file size from the header removes the padding of the last block
+  check(receivedLen==len, name, "wrong length (padding not removed)");
+  check(memcmp(received, data, len)==0, name, "data differs");
+  if( len>0 ) check_blocks(name, 1024, len%1024==0 ? 1024 : len%1024);
+  check(xmodem_get_filename()!=NULL && strcmp(xmodem_get_filename(), "dir/test.bin")==0, name, "wrong file name");
+  check(xmodem_get_filesize()==len, name, "wrong file size");
+}
+
+
+// ---- 128 byte frames and NAK on EOT --------------------------------------------------------------
+
+
+static bool peer_xmodem_crc128_sender()
+{
+  // XMODEM-CRC sender using 128 byte frames (as "sx" without -k does),
+  // the receiver must NAK the second frame whose CRC is corrupted
+  if( pipe_recv_char(5000)!='C' ) return false;
+
+  uint8_t frame[3+128+2];
+  bool corrupted = false;
+  for(int no=1; (no-1)*128<dataLen; )
+    {
+      frame[0] = SOH;
+      frame[1] = no;
+      frame[2] = 255-no;
+      for(int i=0; i<128; i++)
+        frame[3+i] = (no-1)*128+i<dataLen ? data[(no-1)*128+i] : SUB;
+
+      uint16_t crc = crc16(frame+3, 128);
+      frame[3+128] = crc >> 8;
+      frame[3+129] = crc ^ ((no==2 && !corrupted) ? 0x55 : 0);
+      pipe_send_data((const char *) frame, sizeof(frame));
+
+      int c = pipe_recv_char(2000);
+      if( c==ACK )
+        no++;
+      else if( c==NAK && no==2 && !corrupted )
+        corrupted = true;
+      else
+        return false;
+    }
+
+  pipe_send_char(EOT);
+  return pipe_recv_char(2000)==ACK && corrupted;
+}
+
+
+static void test_receive_128()
+{
+  const char *name = "xmodem-crc 128 byte frames";
+  make_data(1000, 128);
+  if( !receive(name, peer_xmodem_crc128_sender) ) return;
+
+  check_blocks(name, 128, 128);
+  check(receivedLen==1024, name, "wrong length");
+  check(memcmp(received, data, dataLen)==0, name, "data differs");
+}
+
+
+static bool peer_checksum_receiver()
+{
+  // XMODEM checksum receiver: 128 byte frames, NAKs the first EOT as
+  // some YMODEM receivers do to make sure the EOT was not line noise
+  int eotCount = 0;
+  uint8_t frame[3+128+1];
+  receivedLen = 0;
+
+  pipe_send_char(NAK);
+  while( true )
+    {
+      int c = pipe_recv_char(2000);
+      if( c==EOT )
+        {
+          pipe_send_char(eotCount++==0 ? NAK : ACK);
+          if( eotCount==2 ) break;
+        }
+      else if( c==SOH && pipe_read(frame+1, sizeof(frame)-1) )
+        {
+          uint8_t sum = 0;
+          for(int i=0; i<128; i++) sum += frame[3+i];
+          if( frame[1]!=(uint8_t) (receivedLen/128+1) || frame[2]!=(uint8_t) ~frame[1] || frame[3+128]!=sum )
+            return false;
+
+          memcpy(received+receivedLen, frame+3, 128);
+          receivedLen += 128;
+          pipe_send_char(ACK);
+        }
+      else
+        return false;
+    }
+
+  // no more data may follow the acknowledged EOT
+  return receivedLen==((dataLen+127) & ~127) && memcmp(received, data, dataLen)==0 && pipe_recv_char(200)==-1;
+}
+
+
+static void test_transmit_128_nak_eot()
+{
+  const char *name = "xmodem checksum, NAK EOT";
+  make_data(1000, 129);
+  pid_t pid = start_peer(peer_checksum_receiver);
+  bool ok = xmodem_transmit(pipe_recv_char, pipe_send_data, transmit_data);
+  check(ok, name, "xmodem_transmit failed");
+  check(finish_peer(pid), name, "receiver failed (wrong frames or EOT not repeated)");
+}
+
+
+int main()
+{
+  test_xmodem_loopback(1024);
+  test_xmodem_loopback(1000);
+  test_xmodem_loopback(MAX_DATA-100);
+
+  test_ymodem_loopback(0);
+  test_ymodem_loopback(1);
+  test_ymodem_loopback(1024);
+  test_ymodem_loopback(5000);
+  test_ymodem_loopback(MAX_DATA);
+
+  test_receive_128();
+  test_transmit_128_nak_eot();
+
+  return test_result("xmodem");
+}
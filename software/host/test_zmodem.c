@@ -0,0 +1,566 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// ZMODEM receiver test: a stand-in for "sz" runs in a child process connected
+// by a pair of pipes and generates the sender side of a session the way lsz
+// does (hex and binary headers, CRC-16 and CRC-32, ZDLE escaping, streamed
+// and acknowledged subpackets). Covers ZRPOS after a corrupted subpacket,
+// ZSKIP for a rejected file, ZFIN and a canceled session. Also checks the
+// ZMODEM auto-start detection in terminal_receive_buffer, which holds back
+// ZDLE "B0" and must replay it when no ZMODEM header follows, and that nothing
+// is held back or detected while auto-start is disabled (the default).
+//
+// usage: test_zmodem (exit status 0 if all tests pass)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include "zmodem.h"
+#include "host.h"
+#include "terminal.h"
+#include "framebuf.h"
+#include "test_helper.h"
+
+#define ZDLE     0x18
+#define ZRQINIT  0
+#define ZRINIT   1
+#define ZACK     3
+#define ZFILE    4
+#define ZSKIP    5
+#define ZFIN     8
+#define ZRPOS    9
+#define ZDATA    10
+#define ZEOF     11
+#define ZCRCE    'h'
+#define ZCRCG    'i'
+#define ZCRCQ    'j'
+#define ZCRCW    'k'
+#define CANFC32  0x20
+
+// the receiver answers at once, this is shorter than its own timeout (7s) so
+// replies it only sends after timing out (e.g. a late ZRPOS) count as missing
+#define REPLY_TIMEOUT 2000
+
+#define HDR_TIMEOUT -1
+#define HDR_CANCEL  -2
+
+#define MAX_FILE (32*1024)
+
+struct SenderFile
+{
+  const char *name;
+  uint8_t     data[MAX_FILE];
+  long        len;
+  int         blockSize;   // data subpacket size
+  char        frameEnd;    // ZCRCG, ZCRCQ or ZCRCW for subpackets within a frame
+  long        corruptPos;  // corrupt the subpacket starting at this position (-1: none)
+  bool        crc16;       // use CRC-16 binary headers and subpackets
+  bool        escapeCtl;   // escape all control characters
+};
+
+struct ReceivedFile
+{
+  char    name[64];
+  long    size, len;
+  uint8_t data[MAX_FILE];
+  int     blocks, ended;
+  bool    ok, blockNoOk;
+};
+
+static struct SenderFile   sendFiles[3];
+static struct ReceivedFile recvFiles[4];
+static int numRecvFiles;
+
+
+// ---- ZMODEM sender stand-in ----------------------------------------------------------------------
+
+
+static uint8_t outBuf[2*MAX_FILE+64];
+static int     outLen;
+static bool    useCrc32, escapeCtl;
+
+
+static uint16_t crc16(uint16_t crc, const uint8_t *buf, int len)
+{
+  while( len-->0 )
+    {
+      crc ^= *buf++ << 8;
+      for(int i=0; i<8; i++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+  return crc;
+}
+
+
+static uint32_t updcrc32(uint32_t crc, const uint8_t *buf, int len)
+{
+  while( len-->0 )
+    {
+      crc ^= *buf++;
+      for(int i=0; i<8; i++) crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+
+  return crc;
+}
+
+
+static void put_raw(const char *s, int len)
+{
+  memcpy(outBuf+outLen, s, len);
+  outLen += len;
+}
+
+
+static void put_escaped(const uint8_t *buf, int len)
+{
+  // escape ZDLE, DLE, XON and XOFF (with and without parity bit) as lsz
+  // does, all control characters plus DEL and 0xFF if escapeCtl is set
+  for(int i=0; i<len; i++)
+    {
+      uint8_t c = buf[i];
+      if( escapeCtl && (c==0x7F || c==0xFF) )
+        { outBuf[outLen++] = ZDLE; outBuf[outLen++] = c==0x7F ? 'l' : 'm'; }
+      else if( c==ZDLE || (c & 0x7F)==0x10 || (c & 0x7F)==0x11 || (c & 0x7F)==0x13 || (escapeCtl && (c & 0x60)==0) )
+        { outBuf[outLen++] = ZDLE; outBuf[outLen++] = c ^ 0x40; }
+      else
+        outBuf[outLen++] = c;
+    }
+}
+
+
+static void flush_out()
+{
+  pipe_send_data((const char *) outBuf, outLen);
+  outLen = 0;
+}
+
+
+static void send_hex_header(uint8_t type, uint32_t pos)
+{
+  uint8_t hdr[5] = {type, pos, pos >> 8, pos >> 16, pos >> 24};
+  char buf[32];
+  int n = sprintf(buf, "**\030B%02x%02x%02x%02x%02x%04x\r\x8a", hdr[0], hdr[1], hdr[2], hdr[3], hdr[4], crc16(0, hdr, 5));
+  if( type!=ZFIN && type!=ZACK ) buf[n++] = 0x11;
+  put_raw(buf, n);
+  flush_out();
+}
+
+
+static void send_bin_header(uint8_t type, uint32_t pos)
+{
+  uint8_t hdr[9] = {type, pos, pos >> 8, pos >> 16, pos >> 24};
+  if( useCrc32 )
+    {
+      uint32_t crc = ~updcrc32(0xFFFFFFFF, hdr, 5);
+      hdr[5] = crc; hdr[6] = crc >> 8; hdr[7] = crc >> 16; hdr[8] = crc >> 24;
+      put_raw("*\030C", 3);
+      put_escaped(hdr, 9);
+    }
+  else
+    {
+      uint16_t crc = crc16(0, hdr, 5);
+      hdr[5] = crc >> 8; hdr[6] = crc;
+      put_raw("*\030A", 3);
+      put_escaped(hdr, 7);
+    }
+
+  flush_out();
+}
+
+
+static void send_subpacket(const uint8_t *data, int len, char end, bool corrupt)
+{
+  uint8_t crc[4], e = end;
+  int crcLen;
+  if( useCrc32 )
+    {
+      uint32_t c = ~updcrc32(updcrc32(0xFFFFFFFF, data, len), &e, 1);
+      crc[0] = c; crc[1] = c >> 8; crc[2] = c >> 16; crc[3] = c >> 24;
+      crcLen = 4;
+    }
+  else
+    {
+      uint16_t c = crc16(crc16(0, data, len), &e, 1);
+      crc[0] = c >> 8; crc[1] = c;
+      crcLen = 2;
+    }
+
+  put_escaped(data, len/2);
+  if( corrupt )
+    {
+      // flip one bit in the middle of the data (CRC computed for the original)
+      uint8_t c = data[len/2] ^ 0x04;
+      put_escaped(&c, 1);
+      put_escaped(data+len/2+1, len-len/2-1);
+    }
+  else
+    put_escaped(data+len/2, len-len/2);
+
+  outBuf[outLen++] = ZDLE;
+  outBuf[outLen++] = end;
+  put_escaped(crc, crcLen);
+  flush_out();
+}
+
+
+static int get_header(uint32_t *pos, int msDelay)
+{
+  // find and decode the next hex header from the receiver (the receiver only
+  // sends hex headers), msDelay is the timeout while hunting for the start
+  char window[4] = {0, 0, 0, 0};
+  int cans = 0;
+  while( memcmp(window, "**\030B", 4)!=0 )
+    {
+      int c = pipe_recv_char(msDelay);
+      if( c<0 ) return HDR_TIMEOUT;
+      cans = c==ZDLE ? cans+1 : 0;
+      if( cans>=5 ) return HDR_CANCEL;
+      memmove(window, window+1, 3);
+      window[3] = c;
+    }
+
+  uint8_t hdr[7];
+  for(int i=0; i<7; i++)
+    {
+      char hex[3] = {0, 0, 0};
+      for(int j=0; j<2; j++)
+        {
+          int c = pipe_recv_char(2000);
+          if( c<0 ) return HDR_TIMEOUT;
+          hex[j] = c;
+        }
+      hdr[i] = strtol(hex, NULL, 16);
+    }
+
+  if( crc16(0, hdr, 5)!=((hdr[5]<<8) | hdr[6]) ) return HDR_TIMEOUT;
+  *pos = hdr[1] | (hdr[2]<<8) | (hdr[3]<<16) | ((uint32_t) hdr[4]<<24);
+  return hdr[0];
+}
+
+
+static int get_header_skip(int skipType, uint32_t *pos)
+{
+  // lsz ignores repeated ZRINIT (e.g. the answer to ZRQINIT) while waiting for a reply
+  int type;
+  while( (type = get_header(pos, REPLY_TIMEOUT))==skipType );
+  return type;
+}
+
+
+static bool start_session()
+{
+  uint32_t flags;
+  pipe_send_data("rz\r", 3);
+  send_hex_header(ZRQINIT, 0);
+  if( get_header(&flags, REPLY_TIMEOUT)!=ZRINIT ) return false;
+  useCrc32 = (flags >> 24) & CANFC32;
+  return useCrc32;
+}
+
+
+static int send_file(const struct SenderFile *f)
+{
+  // returns ZSKIP if the file was skipped, ZRINIT if it was sent or -1 on
+  // protocol errors, including a ZRPOS after the corrupted subpacket that
+  // does not point at the start of that subpacket
+  bool corrupted = false;
+  uint32_t p, pos;
+  char info[128];
+  int type;
+
+  useCrc32  = useCrc32 && !f->crc16;
+  escapeCtl = f->escapeCtl;
+
+  int n = sprintf(info, "%s", f->name)+1;
+  n += sprintf(info+n, "%li 0 100644 0 1 %li", f->len, f->len)+1;
+  send_bin_header(ZFILE, 0);
+  send_subpacket((const uint8_t *) info, n, ZCRCW, false);
+
+  type = get_header_skip(ZRINIT, &pos);
+  if( type==ZSKIP ) return ZSKIP;
+  if( type!=ZRPOS || pos!=0 ) return -1;
+
+  while( true )
+    {
+      bool restart = false;
+      send_bin_header(ZDATA, pos);
+      if( pos>=f->len ) send_subpacket(NULL, 0, ZCRCE, false);
+
+      while( pos<f->len && !restart )
+        {
+          int len = f->len-pos < f->blockSize ? f->len-pos : f->blockSize;
+          bool last = pos+len>=f->len;
+          char end = last ? (f->frameEnd==ZCRCW ? ZCRCW : ZCRCE) : f->frameEnd;
+          bool corrupt = f->corruptPos>=0 && !corrupted && pos>=f->corruptPos;
+          uint32_t errorPos = pos;
+
+          send_subpacket(f->data+pos, len, end, corrupt);
+          pos += len;
+
+          if( end==ZCRCQ || end==ZCRCW )
+            {
+              // acknowledged subpacket
+              type = get_header(&p, REPLY_TIMEOUT);
+              if( type==ZACK && p==pos && !corrupt )
+                ;
+              else if( type==ZRPOS && corrupt && p==errorPos )
+                { pos = p; restart = true; }
+              else
+                return -1;
+            }
+          else if( (type = get_header(&p, 0))==ZRPOS )
+            {
+              // streaming: the receiver asks for a resend at the corrupted subpacket
+              if( !corrupted || p!=f->corruptPos ) return -1;
+              pos = p;
+              restart = true;
+            }
+          else if( type==HDR_CANCEL )
+            return -1;
+
+          if( corrupt ) corrupted = true;
+          if( end==ZCRCW && !last && !restart ) send_bin_header(ZDATA, pos);
+        }
+
+      if( restart ) continue;
+
+      send_bin_header(ZEOF, pos);
+      type = get_header(&p, REPLY_TIMEOUT);
+      if( type==ZRPOS && corrupted && p==f->corruptPos )
+        pos = p;
+      else
+        return (type==ZRINIT && corrupted==(f->corruptPos>=0)) ? ZRINIT : -1;
+    }
+}
+
+
+static bool peer_sz_batch()
+{
+  // three files: received after a CRC error, skipped, received with CRC-16
+  uint32_t p;
+  if( !start_session() ) return false;
+  if( send_file(&sendFiles[0])!=ZRINIT ) return false;
+  if( send_file(&sendFiles[1])!=ZSKIP ) return false;
+  if( send_file(&sendFiles[2])!=ZRINIT ) return false;
+
+  send_hex_header(ZFIN, 0);
+  if( get_header(&p, REPLY_TIMEOUT)!=ZFIN ) return false;
+  pipe_send_data("OO", 2);
+  return true;
+}
+
+
+static bool peer_sz_cancel()
+{
+  // cancels the transfer (as Ctrl-C in sz does) after the first subpacket
+  static const char canistr[] = {ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8};
+  const struct SenderFile *f = &sendFiles[0];
+  uint32_t p;
+
+  if( !start_session() ) return false;
+  send_bin_header(ZFILE, 0);
+  send_subpacket((const uint8_t *) "cancel.bin\0" "16384", 17, ZCRCW, false);
+  if( get_header_skip(ZRINIT, &p)!=ZRPOS ) return false;
+  send_bin_header(ZDATA, 0);
+  send_subpacket(f->data, 1024, ZCRCG, false);
+  pipe_send_data(canistr, sizeof(canistr));
+
+  // the receiver answers with its own cancel sequence (and nothing else)
+  return get_header(&p, REPLY_TIMEOUT)==HDR_CANCEL;
+}
+
+
+// ---- receiver callbacks --------------------------------------------------------------------------
+
+
+static bool file_start(const char *fileName, long fileSize)
+{
+  if( numRecvFiles>=4 ) return false;
+
+  struct ReceivedFile *f = &recvFiles[numRecvFiles++];
+  memset(f, 0, sizeof(struct ReceivedFile));
+  snprintf(f->name, sizeof(f->name), "%s", fileName);
+  f->size = fileSize;
+  f->blockNoOk = true;
+  return strncmp(fileName, "skip", 4)!=0;
+}
+
+
+static bool file_data(unsigned long no, char *data, int len)
+{
+  struct ReceivedFile *f = &recvFiles[numRecvFiles-1];
+  if( f->len+len>MAX_FILE ) return false;
+
+  // block numbers start at 1 for each file, a resend does not repeat them
+  if( no!=(unsigned long) ++f->blocks ) f->blockNoOk = false;
+  memcpy(f->data+f->len, data, len);
+  f->len += len;
+  return true;
+}
+
+
+static void file_end(bool ok)
+{
+  struct ReceivedFile *f = &recvFiles[numRecvFiles-1];
+  f->ended++;
+  f->ok = ok;
+}
+
+
+static void make_file(struct SenderFile *f, const char *name, long len, int blockSize, char frameEnd, long corruptPos, bool crc16, bool escapeCtl)
+{
+  f->name = name;
+  f->len = len;
+  f->blockSize = blockSize;
+  f->frameEnd = frameEnd;
+  f->corruptPos = corruptPos;
+  f->crc16 = crc16;
+  f->escapeCtl = escapeCtl;
+  srand(len);
+  for(long i=0; i<len; i++) f->data[i] = rand();
+}
+
+
+static void check_received(const char *name, const struct ReceivedFile *r, const struct SenderFile *f)
+{
+  check(strcmp(r->name, f->name)==0, name, "wrong file name");
+  check(r->size==f->len, name, "wrong file size");
+  check(r->len==f->len && memcmp(r->data, f->data, f->len)==0, name, "data differs");
+  check(r->blockNoOk, name, "wrong block numbers");
+  check(r->ended==1 && r->ok, name, "file not ended ok");
+}
+
+
+static void test_zmodem_batch()
+{
+  const char *name = "zmodem batch";
+  make_file(&sendFiles[0], "test1.bin", 16384, 1024, ZCRCG, 5120, false, false);
+  make_file(&sendFiles[1], "skip.bin",  1000,  1024, ZCRCG, -1,   false, false);
+  make_file(&sendFiles[2], "test3.bin", 3000,  256,  ZCRCW, 512,  true,  true);
+
+  numRecvFiles = 0;
+  pid_t pid = start_peer(peer_sz_batch);
+  bool ok = zmodem_receive(pipe_recv_char, pipe_send_data, file_start, file_data, file_end);
+  check(ok, name, "zmodem_receive failed");
+  check(finish_peer(pid), name, "sender failed (no ZRPOS at the corrupted subpacket, no ZSKIP or no ZFIN)");
+
+  check(numRecvFiles==3, name, "wrong number of files");
+  if( numRecvFiles!=3 ) return;
+  check_received("zmodem streamed, CRC error", &recvFiles[0], &sendFiles[0]);
+  check(strcmp(recvFiles[1].name, "skip.bin")==0 && recvFiles[1].len==0 && recvFiles[1].ended==0, "zmodem skipped file", "file not skipped");
+  check_received("zmodem ZCRCW, CRC-16", &recvFiles[2], &sendFiles[2]);
+}
+
+
+static void test_zmodem_cancel()
+{
+  const char *name = "zmodem cancel";
+  numRecvFiles = 0;
+  pid_t pid = start_peer(peer_sz_cancel);
+  bool ok = zmodem_receive(pipe_recv_char, pipe_send_data, file_start, file_data, file_end);
+  check(!ok, name, "zmodem_receive did not fail");
+  check(finish_peer(pid), name, "sender failed (no cancel sequence from the receiver)");
+  check(numRecvFiles==1 && recvFiles[0].len==1024 && recvFiles[0].ended==1 && !recvFiles[0].ok, name, "file not ended as failed");
+}
+
+
+// ---- ZMODEM auto-start detection -----------------------------------------------------------------
+
+
+static void receive(const char *s)
+{
+  terminal_receive_buffer(s, strlen(s));
+}
+
+
+static void check_line(const char *name, const char *expected)
+{
+  // compares the first screen row (without trailing blanks)
+  char line[81];
+  int n = framebuf_get_ncols(0);
+  if( n>80 ) n = 80;
+  for(int x=0; x<n; x++) line[x] = framebuf_get_char(x, 0);
+  while( n>0 && (line[n-1]==' ' || line[n-1]==0) ) n--;
+  line[n] = 0;
+
+  check(strcmp(line, expected)==0, name, "wrong screen content");
+}
+
+
+static void check_screen(const char *name, const char *expected, bool requested)
+{
+  check_line(name, expected);
+  check(terminal_zmodem_requested()==requested, name, requested ? "ZMODEM start not detected" : "false ZMODEM start");
+  check(!terminal_zmodem_requested(), name, "ZMODEM start reported twice");
+
+  // clear screen and home cursor for the next test
+  receive("\033[H\033[2J");
+}
+
+
+static void test_autostart()
+{
+  receive("ab\030B00cd");
+  check_screen("auto-start disabled", "abB00cd", false);
+
+  host_config.zmodemauto = 1;
+  receive("ab\030cd");
+  check_screen("stray ZDLE", "abcd", false);
+
+  receive("ab\030B0xcd");
+  check_screen("ZDLE B0 without 0", "abB0xcd", false);
+
+  receive("ab\030");
+  check_line("ZDLE held back", "ab");
+  receive("B");
+  check_line("ZDLE B held back", "ab");
+  receive("1c");
+  check_screen("ZDLE B split", "abB1c", false);
+
+  receive("a\030\030B00");
+  check_screen("ZDLE ZDLE B00", "a", true);
+
+  receive("rz **\030B00");
+  receive("000000000000\r\x8a\x11");
+  check_screen("ZRQINIT", "rz **", true);
+
+  receive("x**\030B00000000000000\r\x8a\x11ignored");
+  check_screen("ZRQINIT dropped", "x**", true);
+
+  receive("\033[1mbold\030B\033[0m.");
+  check_screen("ZDLE B before escape sequence", "boldB.", false);
+}
+
+
+int main()
+{
+  // a failing peer may leave a pipe without reader
+  signal(SIGPIPE, SIG_IGN);
+
+  test_zmodem_batch();
+  test_zmodem_cancel();
+
+  host_init();
+  test_autostart();
+
+  return test_result("zmodem");
+}
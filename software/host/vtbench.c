@@ -0,0 +1,470 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// Throughput benchmark for the terminal core. Replays a fixed set of
+// generated terminal workloads (same content on every run) through the
+// terminal and reports bytes/sec and ns/byte for each of them.
+//
+// usage: vtbench [-f json|csv] [-w workload] [-d dvi|vga] [-s size_kb] [-m min_ms]
+//
+// Results are printed one line per workload and input path ("buffer" uses
+// terminal_receive_buffer() like the serial tasks do, "char" feeds bytes one
+// at a time via terminal_receive_char()). Numbers are host numbers, compare
+// them relative to each other (before/after a change), not to the RP2040.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include "config.h"
+#include "terminal.h"
+#include "host.h"
+
+#define ROWS 30
+#define COLS 80
+
+typedef struct
+{
+  char  *data;
+  size_t len, size;
+} Corpus;
+
+typedef struct
+{
+  const char *name;
+  uint8_t     ttype;
+  void      (*generate)(Corpus *c, size_t size);
+} Workload;
+
+static uint32_t rnd_state = 1;
+
+
+static uint32_t rnd(uint32_t n)
+{
+  // fixed LCG so the corpus is identical on every run and every platform
+  rnd_state = rnd_state * 1103515245u + 12345u;
+  return ((rnd_state >> 16) & 0x7FFF) % n;
+}
+
+
+static void put(Corpus *c, const char *s, size_t n)
+{
+  if( c->len+n > c->size )
+    {
+      c->size = (c->len+n)*2;
+      c->data = realloc(c->data, c->size);
+    }
+
+  memcpy(c->data+c->len, s, n);
+  c->len += n;
+}
+
+
+static void putstr(Corpus *c, const char *s)
+{
+  put(c, s, strlen(s));
+}
+
+
+static void putch(Corpus *c, char ch)
+{
+  put(c, &ch, 1);
+}
+
+
+static void putf(Corpus *c, const char *fmt, ...)
+{
+  char buf[256];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  put(c, buf, n);
+}
+
+
+static void putword(Corpus *c)
+{
+  static const char *words[] = {"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "int", "return",
+                                "static", "void", "uint8_t", "framebuf", "terminal", "0x1F", "while", "for", "if", "else"};
+  putstr(c, words[rnd(sizeof(words)/sizeof(words[0]))]);
+}
+
+
+static void put_reset_vt(Corpus *c)
+{
+  putstr(c, "\033[0m\033[r\033[H\033[2J");
+}
+
+
+static void gen_ascii_flood(Corpus *c, size_t size)
+{
+  // full-width lines of printable text, scrolling the whole screen
+  put_reset_vt(c);
+  while( c->len < size )
+    {
+      int n = 40 + rnd(COLS-40);
+      for(int i=0; i<n; i++) putch(c, 32 + rnd(95));
+      putstr(c, "\r\n");
+    }
+}
+
+
+static void gen_short_lines(Corpus *c, size_t size)
+{
+  // "seq"/"ls -1" style short lines, the screen scrolls (and a line goes
+  // into the scrollback buffer) every few bytes
+  put_reset_vt(c);
+  while( c->len < size )
+    {
+      if( rnd(4)==0 ) putf(c, "\033[3%im%u\033[0m\r\n", rnd(8), rnd(100000));
+      else putf(c, "%u\r\n", rnd(100000));
+    }
+}
+
+
+static void gen_ls_color(Corpus *c, size_t size)
+{
+  // "ls --color" style output: short colored names in columns
+  static const char *colors[] = {"", "01;34", "01;32", "01;36", "01;31", "01;35", "40;33;01"};
+  put_reset_vt(c);
+  while( c->len < size )
+    {
+      int col = 0;
+      while( col < COLS-20 )
+        {
+          const char *color = colors[rnd(sizeof(colors)/sizeof(colors[0]))];
+          int n = 0;
+          if( color[0] ) putf(c, "\033[0m\033[%sm", color);
+          for(int i=0, l=3+rnd(10); i<l; i++, n++) putch(c, 'a'+rnd(26));
+          if( rnd(2) ) { putstr(c, ".c"); n += 2; }
+          if( color[0] ) putstr(c, "\033[0m");
+          for(; n<18; n++) putch(c, ' ');
+          col += 18;
+        }
+      putstr(c, "\r\n");
+    }
+}
+
+
+static void gen_vim_redraw(Corpus *c, size_t size)
+{
+  // cursor-addressed full screen redraws with syntax highlighting,
+  // status line and occasional scrolling within a region
+  put_reset_vt(c);
+  while( c->len < size )
+    {
+      for(int row=1; row<ROWS; row++)
+        {
+          putf(c, "\033[%i;1H", row);
+          int col = 4*rnd(4);
+          for(int i=0; i<col; i++) putch(c, ' ');
+          while( col < COLS-12 && rnd(8)!=0 )
+            {
+              switch( rnd(4) )
+                {
+                case 0: putstr(c, "\033[33m"); putword(c); putstr(c, "\033[m"); break;
+                case 1: putstr(c, "\033[31m\""); putword(c); putstr(c, "\"\033[m"); break;
+                case 2: putstr(c, "\033[34m// "); putword(c); putstr(c, "\033[m"); break;
+                default: putword(c); break;
+                }
+              putch(c, ' ');
+              col += 10;
+            }
+          putstr(c, "\033[K");
+        }
+
+      putf(c, "\033[%i;1H\033[7m src/terminal.c [+]", ROWS);
+      for(int i=19; i<COLS-12; i++) putch(c, ' ');
+      putf(c, "%4i,%-3i\033[m", rnd(2000), rnd(80));
+
+      for(int i=rnd(4); i>0; i--)
+        putf(c, "\033[1;%ir\033[%i;1H\n\033[r", ROWS-1, ROWS-1);
+      putf(c, "\033[%i;%iH", 1+rnd(ROWS-1), 1+rnd(COLS));
+    }
+}
+
+
+static void gen_htop(Corpus *c, size_t size)
+{
+  // htop style updates: meters with colored bars and a process list
+  // with a highlighted header and selection bar
+  put_reset_vt(c);
+  while( c->len < size )
+    {
+      for(int cpu=0; cpu<4; cpu++)
+        {
+          int n = rnd(30);
+          putf(c, "\033[%i;3H\033[36m%i\033[39m[", cpu+1, cpu);
+          putstr(c, "\033[32m");
+          for(int i=0; i<n; i++) { if( i==n/2 ) putstr(c, "\033[31m"); putch(c, '|'); }
+          putf(c, "\033[39m\033[%i;36H\033[m%5.1f%%]", cpu+1, rnd(1000)/10.0);
+        }
+
+      putf(c, "\033[6;1H\033[30;42m  PID USER      PRI  NI  VIRT   RES   SHR S CPU%% MEM%%   TIME+  Command\033[K\033[m");
+      int sel = 7+rnd(ROWS-8);
+      for(int row=7; row<=ROWS; row++)
+        {
+          putf(c, "\033[%i;1H", row);
+          if( row==sel ) putstr(c, "\033[30;46m");
+          putf(c, "%5i root       20   0 %5iM %5iM  %4i S %4.1f %4.1f %2i:%02i.%02i ",
+               rnd(32768), rnd(9999), rnd(999), rnd(999), rnd(1000)/10.0, rnd(1000)/10.0, rnd(60), rnd(60), rnd(100));
+          if( row!=sel ) putstr(c, "\033[1m");
+          putword(c);
+          putstr(c, row==sel ? "\033[K\033[m" : "\033[m\033[K");
+        }
+    }
+}
+
+
+static void gen_scroll_region(Corpus *c, size_t size, int height)
+{
+  // log output scrolling within a DECSTBM region below a fixed header
+  put_reset_vt(c);
+  putf(c, "\033[7m header line\033[K\033[m\033[2;%ir\033[%i;1H", 1+height, 1+height);
+  while( c->len < size )
+    {
+      putf(c, "[%5i.%06i] ", rnd(99999), rnd(999999));
+      for(int i=0, n=2+rnd(8); i<n; i++) { putword(c); putch(c, ' '); }
+      putstr(c, "\r\n");
+    }
+  putstr(c, "\033[r");
+}
+
+static void gen_scroll_region_4(Corpus *c, size_t size)  { gen_scroll_region(c, size, 4); }
+static void gen_scroll_region_14(Corpus *c, size_t size) { gen_scroll_region(c, size, 14); }
+static void gen_scroll_region_28(Corpus *c, size_t size) { gen_scroll_region(c, size, ROWS-2); }
+
+
+static void gen_sgr_churn(Corpus *c, size_t size)
+{
+  // color/attribute change every few characters
+  put_reset_vt(c);
+  while( c->len < size )
+    {
+      switch( rnd(6) )
+        {
+        case 0:  putf(c, "\033[3%i;4%im", rnd(8), rnd(8)); break;
+        case 1:  putf(c, "\033[1;3%im", rnd(8)); break;
+        case 2:  putf(c, "\033[9%im", rnd(8)); break;
+        case 3:  putf(c, "\033[%im", rnd(2) ? 4 : 7); break;
+        case 4:  putstr(c, "\033[0m"); break;
+        default: putf(c, "\033[0;3%i;4%i;1m", rnd(8), rnd(8)); break;
+        }
+
+      for(int i=0, n=1+rnd(4); i<n; i++) putch(c, 33 + rnd(94));
+      if( rnd(40)==0 ) putstr(c, "\r\n");
+    }
+}
+
+
+static void gen_truecolor(Corpus *c, size_t size)
+{
+  // syntax highlighted source code as shown by "bat" or "delta": 24-bit
+  // foreground colors from a small theme, 256-color line backgrounds
+  static const uint8_t theme[8][3] = {{248,248,242}, {249,38,114}, {166,226,46}, {230,219,116},
+                                      {102,217,239}, {174,129,255}, {117,113,94}, {253,151,31}};
+  put_reset_vt(c);
+  while( c->len < size )
+    {
+      if( rnd(8)==0 ) putf(c, "\033[48;5;%im", 232+rnd(4));
+      putf(c, "\033[38;5;%im%4i \033[0m", 240+rnd(8), rnd(1000));
+      for(int w=0, n=2+rnd(8); w<n; w++)
+        {
+          const uint8_t *rgb = theme[rnd(8)];
+          putf(c, rnd(4) ? "\033[38;2;%i;%i;%im" : "\033[38:2::%i:%i:%im", rgb[0], rgb[1], rgb[2]);
+          for(int i=0, l=1+rnd(8); i<l; i++) putch(c, 'a' + rnd(26));
+          putch(c, ' ');
+        }
+      putstr(c, "\033[0m\r\n");
+    }
+}
+
+
+static void gen_petscii(Corpus *c, size_t size)
+{
+  // PETSCII stream: color codes, reverse on/off, cursor movement,
+  // upper/lower case letters and graphics characters
+  static const uint8_t colors[] = {5, 28, 30, 31, 129, 144, 149, 150, 151, 152, 153, 154, 155, 156, 158, 159};
+  static const uint8_t cursor[] = {17, 29, 145, 157};
+  putch(c, (char) 147);
+  while( c->len < size )
+    {
+      switch( rnd(8) )
+        {
+        case 0:  putch(c, colors[rnd(sizeof(colors))]); break;
+        case 1:  putch(c, rnd(2) ? 18 : 146); break;
+        case 2:  putch(c, cursor[rnd(sizeof(cursor))]); break;
+        case 3:  putch(c, 13); break;
+        case 4:  if( rnd(16)==0 ) putch(c, 19); break;
+        default: break;
+        }
+
+      for(int i=0, n=1+rnd(12); i<n; i++)
+        switch( rnd(3) )
+          {
+          case 0:  putch(c, 65 + rnd(26)); break;
+          case 1:  putch(c, (char) (193 + rnd(26))); break;
+          default: putch(c, (char) (161 + rnd(31))); break;
+          }
+    }
+}
+
+
+static const Workload workloads[] =
+  {
+    {"ascii_flood",      CFG_TTYPE_VT102,   gen_ascii_flood},
+    {"short_lines",      CFG_TTYPE_VT102,   gen_short_lines},
+    {"ls_color",         CFG_TTYPE_VT102,   gen_ls_color},
+    {"vim_redraw",       CFG_TTYPE_VT102,   gen_vim_redraw},
+    {"htop_redraw",      CFG_TTYPE_VT102,   gen_htop},
+    {"scroll_region_4",  CFG_TTYPE_VT102,   gen_scroll_region_4},
+    {"scroll_region_14", CFG_TTYPE_VT102,   gen_scroll_region_14},
+    {"scroll_region_28", CFG_TTYPE_VT102,   gen_scroll_region_28},
+    {"sgr_churn",        CFG_TTYPE_VT102,   gen_sgr_churn},
+    {"truecolor",        CFG_TTYPE_VT102,   gen_truecolor},
+    {"petscii",          CFG_TTYPE_PETSCII, gen_petscii},
+  };
+
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static double run(const Corpus *c, bool perChar, double minTime, unsigned *iterations)
+{
+  double start = now(), t;
+  unsigned n = 0;
+  do
+    {
+      if( perChar )
+        for(size_t i=0; i<c->len; i++) terminal_receive_char(c->data[i]);
+      else
+        {
+          // feed in chunks as the serial tasks do
+          for(size_t i=0; i<c->len; i+=256)
+            terminal_receive_buffer(c->data+i, c->len-i < 256 ? c->len-i : 256);
+        }
+
+      n++;
+      t = now()-start;
+    }
+  while( t < minTime );
+
+  *iterations = n;
+  return t;
+}
+
+
+static void usage(const char *prg)
+{
+  fprintf(stderr, "usage: %s [-f json|csv] [-w workload] [-d dvi|vga] [-s size_kb] [-m min_ms]\n", prg);
+  fprintf(stderr, "workloads:");
+  for(size_t i=0; i<sizeof(workloads)/sizeof(workloads[0]); i++) fprintf(stderr, " %s", workloads[i].name);
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+
+int main(int argc, char **argv)
+{
+  bool csv = false;
+  const char *only = NULL;
+  size_t size = 256*1024;
+  double minTime = 0.5;
+
+  for(int i=1; i<argc; i++)
+    {
+      if( strcmp(argv[i], "-f")==0 && i+1<argc )
+        {
+          i++;
+          if( strcmp(argv[i], "csv")==0 ) 
+            csv = true;
+          else if( strcmp(argv[i], "json")!=0 )
+            usage(argv[0]);
+        }
+      else if( strcmp(argv[i], "-w")==0 && i+1<argc )
+        only = argv[++i];
+      else if( strcmp(argv[i], "-d")==0 && i+1<argc )
+        {
+          i++;
+          if( strcmp(argv[i], "dvi")==0 )
+            host_config.display = CFG_DISPTYPE_DVI;
+          else if( strcmp(argv[i], "vga")==0 )
+            host_config.display = CFG_DISPTYPE_VGA;
+          else
+            usage(argv[0]);
+        }
+      else if( strcmp(argv[i], "-s")==0 && i+1<argc )
+        size = atoi(argv[++i]) * 1024;
+      else if( strcmp(argv[i], "-m")==0 && i+1<argc )
+        minTime = atoi(argv[++i]) / 1000.0;
+      else
+        usage(argv[0]);
+    }
+
+  host_config.rows = ROWS;
+  host_config.cols = COLS;
+  host_config.dblchars = 0;
+
+  if( csv ) printf("workload,api,display,bytes,iterations,seconds,bytes_per_sec,ns_per_byte,max_baud_8n1\n");
+
+  bool found = false;
+  for(size_t w=0; w<sizeof(workloads)/sizeof(workloads[0]); w++)
+    {
+      if( only!=NULL && strcmp(only, workloads[w].name)!=0 ) continue;
+      found = true;
+
+      Corpus c = {NULL, 0, 0};
+      rnd_state = 1;
+      workloads[w].generate(&c, size);
+
+      for(int perChar=0; perChar<2; perChar++)
+        {
+          host_config.ttype = workloads[w].ttype;
+          host_init();
+
+          unsigned iterations;
+          double t = run(&c, perChar, minTime, &iterations);
+          double bytes = (double) c.len * iterations;
+          double bps = bytes / t;
+          const char *api = perChar ? "char" : "buffer";
+          const char *disp = host_config.display==CFG_DISPTYPE_DVI ? "dvi" : "vga";
+
+          if( csv )
+            printf("%s,%s,%s,%zu,%u,%.4f,%.0f,%.2f,%.0f\n", 
+                   workloads[w].name, api, disp, c.len, iterations, t, bps, 1e9/bps, bps*10);
+          else
+            printf("{\"workload\":\"%s\",\"api\":\"%s\",\"display\":\"%s\",\"bytes\":%zu,\"iterations\":%u,\"seconds\":%.4f,"
+                   "\"bytes_per_sec\":%.0f,\"ns_per_byte\":%.2f,\"max_baud_8n1\":%.0f}\n",
+                   workloads[w].name, api, disp, c.len, iterations, t, bps, 1e9/bps, bps*10);
+          fflush(stdout);
+        }
+
+      free(c.data);
+    }
+
+  if( !found ) usage(argv[0]);
+  return 0;
+}
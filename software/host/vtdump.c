@@ -0,0 +1,103 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// Feeds a file (or stdin) through the terminal core and prints the resulting
+// screen content. Useful to check the effect of escape sequences without
+// hardware and to compare framebuffer output before and after a change.
+//
+// usage: vtdump [-c cols] [-r rows] [-t vt102|vt52|petscii] [-d dvi|vga] [file]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "terminal.h"
+#include "framebuf.h"
+#include "host.h"
+
+
+static void usage(const char *prg)
+{
+  fprintf(stderr, "usage: %s [-c cols] [-r rows] [-t vt102|vt52|petscii] [-d dvi|vga] [-s] [file]\n", prg);
+  exit(1);
+}
+
+
+int main(int argc, char **argv)
+{
+  const char *fname = NULL;
+  size_t chunk = 4096;
+
+  for(int i=1; i<argc; i++)
+    {
+      if( strcmp(argv[i], "-c")==0 && i+1<argc )
+        host_config.cols = atoi(argv[++i]);
+      else if( strcmp(argv[i], "-r")==0 && i+1<argc )
+        host_config.rows = atoi(argv[++i]);
+      else if( strcmp(argv[i], "-t")==0 && i+1<argc )
+        {
+          i++;
+          if( strcmp(argv[i], "vt102")==0 )
+            host_config.ttype = CFG_TTYPE_VT102;
+          else if( strcmp(argv[i], "vt52")==0 )
+            host_config.ttype = CFG_TTYPE_VT52;
+          else if( strcmp(argv[i], "petscii")==0 )
+            host_config.ttype = CFG_TTYPE_PETSCII;
+          else
+            usage(argv[0]);
+        }
+      else if( strcmp(argv[i], "-d")==0 && i+1<argc )
+        {
+          i++;
+          if( strcmp(argv[i], "dvi")==0 )
+            host_config.display = CFG_DISPTYPE_DVI;
+          else if( strcmp(argv[i], "vga")==0 )
+            host_config.display = CFG_DISPTYPE_VGA;
+          else
+            usage(argv[0]);
+        }
+      else if( strcmp(argv[i], "-s")==0 )
+        {
+          host_config.syncupdates = 1;
+          chunk = 64;
+        }
+      else if( argv[i][0]=='-' || fname!=NULL )
+        usage(argv[0]);
+      else
+        fname = argv[i];
+    }
+
+  FILE *f = fname==NULL ? stdin : fopen(fname, "rb");
+  if( f==NULL ) { perror(fname); return 1; }
+
+  host_init();
+
+  char buf[4096];
+  size_t n;
+  while( (n=fread(buf, 1, chunk, f))>0 )
+    {
+      terminal_receive_buffer(buf, n);
+      framebuf_new_frame();
+    }
+
+  if( f!=stdin ) fclose(f);
+
+  framebuf_host_dump(stdout);
+  return 0;
+}
@@ -162,7 +162,7 @@
 				//	par = pointer to 1-bit font, par2 = background color)
 #define GF_CTEXT	13	// 8-pixel color text, character + background color + foreground color
 				//      (num = number of characters, font is 8-bit width,
-				//	par = pointer to 1-bit font)
+				//	par = pointer to 1-bit normal, bold, soft and bold soft font, see CTextFontAttr)
 #define GF_GTEXT	14	// 8-pixel gradient text (par = pointer to 1-bit font, par2 = pointer to color array)
 #define GF_DTEXT	15	// 8-pixel double gradient text (par = pointer to 1-bit font, par2 = pointer to color array)
 #define GF_LEVEL	16	// level graph (data=samples 0..255, par = 2 colors of palettes, par2 = Y zero level 0..255)
@@ -189,9 +189,12 @@
 #define GF_TILEPERSP2	26	// tiles with perspective, double pixels (parameters as GF_TILEPERSP)
 #define GF_TILEPERSP3	27	// tiles with perspective, triple pixels (parameters as GF_TILEPERSP)
 #define GF_TILEPERSP4	28	// tiles with perspective, quadruple pixels (parameters as GF_TILEPERSP)
+#define GF_CTEXT6	29	// 6-pixel color text, character + background color + foreground color
+				//	(parameters as GF_CTEXT, 8-pixel font narrowed with RenderTextNarrow,
+				//	X offset must be 0, characters centered in the segment)
 
 #define GF_GRP3MIN	GF_GRAPH4	// 3rd group minimal format
-#define GF_GRP3MAX	GF_TILEPERSP4	// 3rd group maximal format
+#define GF_GRP3MAX	GF_CTEXT6	// 3rd group maximal format
 
 
 #define FRACT		12	// number of bits of fractional part of fractint number (use max. 13, min. 8)
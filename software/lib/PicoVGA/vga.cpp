@@ -7,6 +7,10 @@
 
 #include "include.h"
 
+#if VGA_LINE_TIMING
+#include "hardware/structs/systick.h"
+#endif
+
 // scanline type
 u8 ScanlineType[MAXLINE];
 
@@ -50,6 +54,29 @@ u32*	CtrlBufNext[LAYERS_MAX];
 u32 RenderTextMask[512];
 u32 RenderTextMaskDW[1024];
 
+// render font pixel mask with inverted pixels (foreground and background swapped)
+u32 RenderTextMaskInv[512];
+u32 RenderTextMaskDWInv[1024];
+
+// 8-pixel font sample narrowed to 6 pixels in bits 7..2 (columns 1+2 and 4+5 merged), used by GF_CTEXT6
+u8 RenderTextNarrow[256];
+
+// font pixel masks used by GF_CTEXT (normal or inverted)
+u32* RenderCTextMask = RenderTextMask;
+u32* RenderCTextMaskDW = RenderTextMaskDW;
+
+// text cursor drawn over GF_CTEXT segments
+volatile u32 CTextCursor = 0;
+
+// underline and blink of GF_CTEXT characters per font line
+u32 CTextFontAttr[16];
+
+#if VGA_LINE_TIMING
+// clock cycles spent in the last and in the longest scanline handler
+volatile u32 VgaLineTime = 0;
+volatile u32 VgaLineTimeMax = 0;
+#endif
+
 // saved integer divider state
 hw_divider_state_t DividerState;
 
@@ -174,6 +201,75 @@ int __not_in_flash_func(VgaBufProcess)()
 	return bufinx;
 }
 
+// draw the text cursor over a rendered GF_CTEXT or GF_CTEXT6 line
+//  narrow ... 6-pixel characters centered in the line (GF_CTEXT6)
+static inline void __not_in_flash_func(DrawCTextCursor)(u8* dbuf, int x, int y, int w, sSegm* segm, Bool narrow)
+{
+	// check if this line shows the cursor
+	u32 cur = CTextCursor;
+	u8 attr = (u8)(cur >> 24);
+	int fonth = segm->par3;
+	int row = cur & 0xff;
+	int fy = y - row*fonth;
+	if ((attr == 0) || (fy < 0) || (fy >= (int)((cur >> 8) & 0xff)*fonth)) return;
+	while (fy >= fonth) { fy -= fonth; row++; }
+
+	// row info: attributes in low byte (B0 double width, B1/B2 double height top/bottom), physical row in high byte
+	u16 ri = ((const u16*)segm->par2)[row];
+	int pw = narrow ? 6 : 8;
+	int cw = (ri & B0) ? 2*pw : pw;
+	int col = (cur >> 16) & 0xff;
+	int px = col*cw - (x & ~3);
+	if (narrow)
+	{
+		// same left border as RenderCText6
+		int cells = (w & ~3)*5462 >> 16;
+		px += (((w & ~3) - cells*12) >> 3) << 2;
+	}
+	if ((px < 0) || (px + cw > (w & ~3))) return;
+
+	if (ri & B1)
+		fy >>= 1;
+	else if (ri & B2)
+		fy = (fy >> 1) + (fonth >> 1);
+
+	// character with the cursor attributes toggled (bit 4 swaps foreground and background)
+	u32 ch = ((const u32*)((const u8*)segm->data + (ri >> 8)*segm->wb))[col];
+	u8 bg = (u8)(ch >> 16);
+	u8 fg = (u8)(ch >> 24);
+	if (((attr & B4) != 0) != (RenderCTextMask != RenderTextMask)) { u8 t = fg; fg = bg; bg = t; }
+	ch ^= (attr & 0x0f) << 8;
+	u32 fa = CTextFontAttr[fy];
+	u8 m = ((const u8*)segm->par)[fy*256*4 + (ch & 0x3ff)];
+	if ((ch & B11) && (((ch & B8) ? (fa >> 8) : fa) & B0)) m = 0xff;
+	if (ch & B10) m ^= (u8)(fa >> 16);
+	if (narrow) m = RenderTextNarrow[m];
+
+	u8* p = dbuf + px;
+	for (int i = 0; i < pw; i++, m <<= 1)
+	{
+		u8 c = (m & B7) ? fg : bg;
+		*p++ = c;
+		if (cw > pw) *p++ = c;
+	}
+}
+
+// render GF_CTEXT line and draw the text cursor over it
+u8* __not_in_flash_func(RenderCTextCursor)(u8* dbuf, int x, int y, int w, sSegm* segm)
+{
+	u8* d = RenderCText(dbuf, x, y, w, segm);
+	DrawCTextCursor(dbuf, x, y, w, segm, False);
+	return d;
+}
+
+// render GF_CTEXT6 line and draw the text cursor over it
+u8* __not_in_flash_func(RenderCText6Cursor)(u8* dbuf, int x, int y, int w, sSegm* segm)
+{
+	u8* d = RenderCText6(dbuf, x, y, w, segm);
+	DrawCTextCursor(dbuf, x, y, w, segm, True);
+	return d;
+}
+
 // render scanline buffers
 u32* __not_in_flash_func(VgaBufRender)(u32* cbuf, u32* cbuf0, u8* dbuf, int y0)
 {
@@ -379,10 +475,23 @@ void VgaSetNewFrameCallback(void (*fnc)())
   NewFrameFnc = fnc;
 }
 
+#if VGA_LINE_TIMING
+void (* volatile LineTimeFnc)(u32 cycles) = NULL; // called with the time of image scanlines
+
+void VgaSetLineTimeCallback(void (*fnc)(u32 cycles))
+{
+  LineTimeFnc = fnc;
+}
+#endif
+
 
 // VGA DMA handler - called on end of every scanline
 extern "C" void __not_in_flash_func(VgaLine)()
 {
+#if VGA_LINE_TIMING
+	u32 t0 = systick_hw->cvr;
+#endif
+
 	// process scanline buffers (will save integer divider state into DividerState)
 	int bufinx = VgaBufProcess();
 
@@ -481,6 +590,14 @@ extern "C" void __not_in_flash_func(VgaLine)()
 
 	// restore integer divider state
 	hw_divider_restore_state(&DividerState);
+
+#if VGA_LINE_TIMING
+	// SysTick counts down, 24 bits
+	u32 t = (t0 - systick_hw->cvr) & 0xffffff;
+	VgaLineTime = t;
+	if (t > VgaLineTimeMax) VgaLineTimeMax = t;
+	if ((linetype >= LINE_IMG) && (LineTimeFnc != NULL)) LineTimeFnc(t);
+#endif
 }
 
 // initialize VGA DMA
@@ -931,6 +1048,7 @@ void VgaInit(const sVmode* vmode)
 		if ((i & B5) != 0) m |= 0xff << 16;
 		if ((i & B4) != 0) m |= 0xff << 24;
 		RenderTextMask[2*i] = m;
+		RenderTextMaskInv[2*i] = ~m;
 
 		// lower 4 bits
 		m = 0;
@@ -939,6 +1057,20 @@ void VgaInit(const sVmode* vmode)
 		if ((i & B1) != 0) m |= 0xff << 16;
 		if ((i & B0) != 0) m |= 0xff << 24;
 		RenderTextMask[2*i+1] = m;
+		RenderTextMaskInv[2*i+1] = ~m;
+	}
+
+	// prepare narrowing of 8-pixel font samples to 6 pixels
+	for (i = 0; i < 256; i++)
+	{
+		u8 m = 0;
+		if ((i & B7) != 0) m |= B7;
+		if ((i & (B6|B5)) != 0) m |= B6;
+		if ((i & B4) != 0) m |= B5;
+		if ((i & (B3|B2)) != 0) m |= B4;
+		if ((i & B1) != 0) m |= B3;
+		if ((i & B0) != 0) m |= B2;
+		RenderTextNarrow[i] = m;
 	}
 
 	// prepare double-width render font pixel mask
@@ -948,21 +1080,25 @@ void VgaInit(const sVmode* vmode)
 		if ((i & B7) != 0) m |= 0xffff;
 		if ((i & B6) != 0) m |= 0xffff << 16;
 		RenderTextMaskDW[4*i+0] = m;
+		RenderTextMaskDWInv[4*i+0] = ~m;
 
 		m = 0;
 		if ((i & B5) != 0) m |= 0xffff;
 		if ((i & B4) != 0) m |= 0xffff << 16;
 		RenderTextMaskDW[4*i+1] = m;
+		RenderTextMaskDWInv[4*i+1] = ~m;
 
 		m = 0;
 		if ((i & B3) != 0) m |= 0xffff;
 		if ((i & B2) != 0) m |= 0xffff << 16;
 		RenderTextMaskDW[4*i+2] = m;
+		RenderTextMaskDWInv[4*i+2] = ~m;
 
 		m = 0;
 		if ((i & B1) != 0) m |= 0xffff;
 		if ((i & B0) != 0) m |= 0xffff << 16;
 		RenderTextMaskDW[4*i+3] = m;
+		RenderTextMaskDWInv[4*i+3] = ~m;
 	}
 
 	// emergency check of structure definitions
@@ -978,6 +1114,14 @@ void VgaInit(const sVmode* vmode)
 	// clear buffer with black color
 	memset(LineBuf0, COL_BLACK, BLACK_MAX);
 
+#if VGA_LINE_TIMING
+	// free running SysTick on the VGA core, counting processor clock cycles
+	systick_hw->rvr = 0xffffff;
+	systick_hw->cvr = 0;
+	systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+	VgaLineTimeMax = 0;
+#endif
+
 	// save current videomode
 	memcpy(&CurVmode, vmode, sizeof(sVmode));
 
@@ -57,6 +57,41 @@ extern int	CtrlBufSize[LAYERS_MAX]; // size of control buffers
 extern u32 RenderTextMask[512];
 extern u32 RenderTextMaskDW[1024];
 
+// render font pixel mask with inverted pixels (foreground and background swapped)
+extern u32 RenderTextMaskInv[512];
+extern u32 RenderTextMaskDWInv[1024];
+
+// font pixel masks used by GF_CTEXT (point to the inverted masks to swap colors of all text)
+extern u32* RenderCTextMask;
+extern u32* RenderCTextMaskDW;
+
+// text cursor drawn over GF_CTEXT segments: row info index of the first row | number of rows << 8 |
+// column << 16 | character attributes to toggle << 24 (bits 0-3 bold/soft font/blink/underline, bit 4 swaps colors; 0 = off)
+extern volatile u32 CTextCursor;
+
+// underline and blink of GF_CTEXT characters, one entry per font line: B0 = underline row
+// of the normal font, B8 = underline row of the bold font, bits 16-23 = 0xff to invert
+// blinking characters (character attributes: B0 bold font, B1 soft font, B2 blink, B3 underline)
+extern u32 CTextFontAttr[16];
+
+// render GF_CTEXT (RenderCText) and draw the text cursor over it
+extern "C" u8* RenderCText(u8* dbuf, int x, int y, int w, sSegm* segm);
+extern "C" u8* RenderCTextCursor(u8* dbuf, int x, int y, int w, sSegm* segm);
+
+// 8-pixel font sample narrowed to 6 pixels in bits 7..2 (columns 1+2 and 4+5 merged)
+extern u8 RenderTextNarrow[256];
+
+// render GF_CTEXT6 (RenderCText6) and draw the text cursor over it
+extern "C" u8* RenderCText6(u8* dbuf, int x, int y, int w, sSegm* segm);
+extern "C" u8* RenderCText6Cursor(u8* dbuf, int x, int y, int w, sSegm* segm);
+
+#if VGA_LINE_TIMING
+// clock cycles spent in the last and in the longest scanline handler (the render
+// time of one line must stay below the scanline time: clk_sys * htot)
+extern volatile u32 VgaLineTime;
+extern volatile u32 VgaLineTimeMax;
+#endif
+
 // fill memory buffer with u32 words
 //  buf ... data buffer, must be 32-bit aligned
 //  data ... data word to store
@@ -136,5 +171,11 @@ void WaitVSync();
 // VgaSetNewFrameCallback()
 void VgaSetNewFrameCallback(void (*fnc)());
 
+#if VGA_LINE_TIMING
+// set function called (on core 1, from the scanline interrupt) with the clock cycles
+// spent in the handler of each image scanline
+void VgaSetLineTimeCallback(void (*fnc)(u32 cycles));
+#endif
+
 
 #endif // _VGA_H
@@ -11,11 +11,19 @@
 #define STRIPMAX	8	// max. number of video strips (size of 1 sStrip = sSegm size*SEGMAX+4 = 228 bytes)
 				// size of sScreen = sStrip size*STRIPMAX+4 = 1828 bytes
 
+#if VERSATERM_VGA_WIDE
+#define MAXX		800	// max. resolution in X direction (must be power of 4)
+#else
 #define MAXX		640	// max. resolution in X direction (must be power of 4)
+#endif
 #define MAXY		480	// max. resolution in Y direction
 
 #define MAXLINE		700	// max. number of scanlines (including sync and dark lines)
 
+#ifndef VGA_LINE_TIMING
+#define VGA_LINE_TIMING	0	// 1 = measure clock cycles of the scanline handler (VgaLineTime, VgaLineTimeMax)
+#endif
+
 // === Scanline render buffers (800 pixels: default size of buffers = 2*4*(800+8+800+24)+800 = 13856 bytes
 //    Requirements by format, base layer 0, 1 wrap X segment:
 //	GF_GRAPH8 ... control buffer 16 bytes
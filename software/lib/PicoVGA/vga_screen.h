@@ -134,7 +134,7 @@ void ScreenSegmFText(sSegm* segm, const void* data, const void* font, u16 fonthe
 
 // set video segment to 8-pixel color text
 //   data = pointer to text buffer (character + background color + foreground color)
-//   font = pointer to 1-bit font of 256 characters of width 8 (total width of image 2048 pixels)
+//   font = pointer to 1-bit normal, bold, soft and bold soft font of 256 characters each of width 8 (total width of image 8192 pixels)
 //   fontheight = font height
 //   wb = pitch - number of bytes between text lines
 void ScreenSegmCText(sSegm* segm, const void* data, const void* font, u16 fontheight, int wb);
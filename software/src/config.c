@@ -21,12 +21,15 @@
 #include "terminal.h"
 #include "keyboard.h"
 #include "serial.h"
+#include "serial_cdc.h"
 #include "config.h"
 #include "font.h"
 #include "flash.h"
 #include "pins.h"
 #include "sound.h"
 #include "xmodem.h"
+#include "zmodem.h"
+#include "stats.h"
 #include <stdarg.h>
 #include <ctype.h>
 #include <string.h>
@@ -37,6 +40,7 @@
 #include "hardware/watchdog.h"
 #include "hardware/clocks.h"
 #include "tusb.h"
+#include "hotfun.h"
 
 #define CONFIG_MAGIC   0x0F1E2D3C
 #define CONFIG_VERSION 0
@@ -46,6 +50,13 @@ void run_tasks(bool processInput);
 
 #define INFLASHFUN __in_flash(".configfun") 
 
+// framebuf_set_screen_size() limits the columns to what the display can show
+#if VERSATERM_DVI_WIDE || VERSATERM_VGA_WIDE
+#define MAX_SCREEN_COLS 132
+#else
+#define MAX_SCREEN_COLS 80
+#endif
+
 bool menuActive = false;
 uint8_t currentConfig = 0;
 
@@ -160,7 +171,9 @@ struct SettingsStruct
     uint16_t rtsmode;
     uint16_t xonxoff;
     uint16_t blink;
-    uint16_t reserved[16];
+    uint16_t rxhighmark;
+    uint16_t rxlowmark;
+    uint16_t reserved[14];
   } Serial;
   
   struct TerminalStruct
@@ -179,7 +192,8 @@ struct SettingsStruct
     uint16_t attr;
     char     answerback[50];
     uint16_t scrolldelay;
-    uint16_t reserved[31];
+    uint16_t zmodemauto;
+    uint16_t reserved[30];
   } Terminal;
 
   struct KeyboardStruct
@@ -215,7 +229,8 @@ struct SettingsStruct
       uint8_t colors[16];
     } AnsiColorVGA, AnsiColorDVI, PetsciiColorVGA, PetsciiColorDVI;
 
-    uint16_t reserved[16];
+    uint16_t syncupdates;
+    uint16_t reserved[15];
   } Screen;
 
   struct BellStruct
@@ -358,6 +373,9 @@ static int user_font_name_fn(const struct MenuItemStruct *item, int callType, in
 static int bell_test_fn(const struct MenuItemStruct *item, int callType, int row, int col);
 static int displaytype_fn(const struct MenuItemStruct *item, int callType, int row, int col);
 static int usbtype_fn(const struct MenuItemStruct *item, int callType, int row, int col);
+static int usb_cdc_stats_fn(const struct MenuItemStruct *item, int callType, int row, int col);
+static int video_timing_fn(const struct MenuItemStruct *item, int callType, int row, int col);
+static int statistics_fn(const struct MenuItemStruct *item, int callType, int row, int col);
 
 
 static const struct MenuItemStruct __in_flash(".configmenus") serialMenu[] =
@@ -368,7 +386,9 @@ static const struct MenuItemStruct __in_flash(".configmenus") serialMenu[] =
      {'5', "RTS control line",    0, NULL, 0, NULL, &settings.Serial.rtsmode,   0,  2, 1, 0, {"Always assert (always low)", "Never assert (always high)", "Assert when ready to receive"}},
      {'6', "CTS control line",    0, NULL, 0, NULL, &settings.Serial.ctsmode,   0,  1, 1, 0, {"Ignore", "Only send data if asserted"}},
      {'7', "XOn/XOff control",    0, NULL, 0, NULL, &settings.Serial.xonxoff,   0,  2, 1, 0, {"Disabled", "Enabled", "Enabled and FIFOs disabled"}},
-     {'8', "LED blink time (ms)", 0, NULL, 0, NULL, &settings.Serial.blink,    0,  1000, 25, 50}};
+     {'8', "LED blink time (ms)", 0, NULL, 0, NULL, &settings.Serial.blink,    0,  1000, 25, 50},
+     {'9', "RX buffer stop level (%)",   0, NULL, 0, NULL, &settings.Serial.rxhighmark, 10, 95, 5, 75},
+     {'a', "RX buffer resume level (%)", 0, NULL, 0, NULL, &settings.Serial.rxlowmark,   5, 90, 5, 25}};
 
 
 static const struct MenuItemStruct __in_flash(".configmenus") bellMenu[] =
@@ -394,7 +414,8 @@ static const struct MenuItemStruct __in_flash(".configmenus") terminalMenu[] =
      {'b', "Default background color", 0, NULL, 0, color16_fn, &settings.Terminal.bgcolor, 0, 15, 1,  0},
      {'c', "Default text color",       0, NULL, 0, color16_fn, &settings.Terminal.fgcolor, 0, 15, 1,  7},
      {'d', "Default text attributes",  0, NULL, 0, attr_fn,    &settings.Terminal.attr,    0, 15, 1,  0},
-     {'e', "Answerback message",       0, NULL, 0, answerback_fn}};
+     {'e', "Answerback message",       0, NULL, 0, answerback_fn},
+     {'f', "ZMODEM auto-start",        0, NULL, 0, NULL, &settings.Terminal.zmodemauto, 0, 1, 1, 0, {"off", "on"}}};
 
 
 
@@ -457,13 +478,15 @@ static const struct MenuItemStruct __in_flash(".configmenus") screenPetsciiColor
 static const struct MenuItemStruct __in_flash(".configmenus") screenMenu[] =
     {{'1', "Display type",               0, NULL, 0, displaytype_fn, &settings.Screen.display,  0,   2, 1,  0, {"Auto-detect", "DVI/HDMI", "VGA"}},
      {'2', "Rows",                       0, NULL, 0, NULL, &settings.Screen.rows,    10,  60, 1, 30},
-     {'3', "Columns",                    0, NULL, 0, NULL, &settings.Screen.cols,    20,  80, 2, 80},
+     {'3', "Columns",                    0, NULL, 0, NULL, &settings.Screen.cols,    20, MAX_SCREEN_COLS, 2, 80},
      {'4', "Double size characters",     0, NULL, 0, NULL, &settings.Screen.dblchars, 0,   1, 1,  1, {"never", "if screen space allows"}},
      {'5', "Show splash screen",         0, NULL, 0, NULL, &settings.Screen.splash,   0,   1, 1,  1, {"no", "yes"}},
      {'6', "Blink period (frames)",      0, NULL, 0, NULL, &settings.Screen.blink,    2, 120, 2, 60},
      {'7', "Color/Monochrome",           0, NULL, 0, NULL, &settings.Screen.mono,     0,   1, 1,  0, {"Color", "Monochrome"}},
      {'8', "Ansi Colors",                0, screenAnsiColorMenu,    NUM_MENU_ITEMS(screenAnsiColorMenu)},
-     {'9', "PETSCII Colors",             0, screenPetsciiColorMenu, NUM_MENU_ITEMS(screenPetsciiColorMenu)}};
+     {'9', "PETSCII Colors",             0, screenPetsciiColorMenu, NUM_MENU_ITEMS(screenPetsciiColorMenu)},
+     {'a', "Tear-free updates",          0, NULL, 0, NULL, &settings.Screen.syncupdates, 0, 1, 1, 0, {"off", "on"}},
+     {'b', "Video timing",               0, NULL, 0, video_timing_fn}};
 
 
 static const struct MenuItemStruct __in_flash(".configmenus") userFontMenu[] =
@@ -486,7 +509,8 @@ static const struct MenuItemStruct __in_flash(".configmenus") fontMenu[] =
 
 static const struct MenuItemStruct __in_flash(".configmenus") usbMenu[] =
     {{'1', "USB port mode",  0, NULL, 0, usbtype_fn, &settings.USB.mode,   0, 3, 1, 3, {"Disabled", "Device", "Host", "Auto-detect"}},
-     {'2', "USB CDC device mode", 0, NULL, 0, NULL, &settings.USB.cdcmode, 0, 3, 1, 2, {"Disabled", "Serial", "Pass-through", "Pass-through (terminal disabled)"}}};
+     {'2', "USB CDC device mode", 0, NULL, 0, NULL, &settings.USB.cdcmode, 0, 3, 1, 2, {"Disabled", "Serial", "Pass-through", "Pass-through (terminal disabled)"}},
+     {'3', "CDC received data",   0, NULL, 0, usb_cdc_stats_fn}};
 
 
 static const struct MenuItemStruct __in_flash(".configmenus") mainMenu[] =
@@ -497,7 +521,8 @@ static const struct MenuItemStruct __in_flash(".configmenus") mainMenu[] =
      {'5', "Font settings",      0, fontMenu, NUM_MENU_ITEMS(fontMenu)},
      {'6', "Bell settings",      0, bellMenu, NUM_MENU_ITEMS(bellMenu)},
      {'7', "USB settings" ,      0, usbMenu, NUM_MENU_ITEMS(usbMenu)},
-     {'8', "Manage configurations", 0, NULL, 0, configs_fn}};
+     {'8', "Manage configurations", 0, NULL, 0, configs_fn},
+     {'9', "Statistics",         0, NULL, 0, statistics_fn}};
 
 
 // -----------------------------------------------------------------------------------------------------------------
@@ -586,7 +611,19 @@ uint16_t  config_get_serial_blink()
   return settings.Serial.blink;
 }
 
-uint8_t config_get_terminal_type()
+uint8_t config_get_serial_rx_highmark()
+{
+  // configurations saved before this setting existed have 0 here
+  return settings.Serial.rxhighmark==0 ? 75 : settings.Serial.rxhighmark;
+}
+
+uint8_t config_get_serial_rx_lowmark()
+{
+  uint8_t high = config_get_serial_rx_highmark();
+  return (settings.Serial.rxlowmark==0 || settings.Serial.rxlowmark>=high) ? MIN(25, high/2) : settings.Serial.rxlowmark;
+}
+
+uint8_t HOTFUN(config_get_terminal_type)()
 {
   return menuActive ? CFG_TTYPE_VT102 : settings.Terminal.ttype;
 }
@@ -596,17 +633,17 @@ uint8_t config_get_terminal_localecho()
   return menuActive ? 0 : settings.Terminal.echo;
 }
 
-uint8_t config_get_terminal_cursortype()
+uint8_t HOTFUN(config_get_terminal_cursortype)()
 {
   return menuActive ? 0 : settings.Terminal.cursor;
 }
 
-uint8_t config_get_terminal_cr()
+uint8_t HOTFUN(config_get_terminal_cr)()
 {
   return menuActive ? 1 : settings.Terminal.recvCR;
 }
 
-uint8_t config_get_terminal_lf()
+uint8_t HOTFUN(config_get_terminal_lf)()
 {
   return menuActive ? 3 : settings.Terminal.recvLF;
 }
@@ -621,7 +658,7 @@ uint8_t config_get_terminal_del()
   return menuActive ? 2 : settings.Terminal.recvDEL;
 }
 
-bool config_get_terminal_clearBit7()
+bool HOTFUN(config_get_terminal_clearBit7)()
 {
   return menuActive ? false : settings.Terminal.clearBit7!=0;
 }
@@ -636,17 +673,22 @@ uint16_t config_get_terminal_scrolldelay()
   return settings.Terminal.scrolldelay;
 }
 
-uint8_t config_get_terminal_default_fg()
+bool config_get_terminal_zmodem_autostart()
+{
+  return menuActive ? false : settings.Terminal.zmodemauto!=0;
+}
+
+uint8_t HOTFUN(config_get_terminal_default_fg)()
 {
   return menuActive ? 7 : settings.Terminal.fgcolor;
 }
 
-uint8_t config_get_terminal_default_bg()
+uint8_t HOTFUN(config_get_terminal_default_bg)()
 {
   return menuActive ? 0 : settings.Terminal.bgcolor;
 }
 
-uint8_t config_get_terminal_default_attr()
+uint8_t HOTFUN(config_get_terminal_default_attr)()
 {
   return menuActive ? 0 : settings.Terminal.attr;
 }
@@ -691,6 +733,11 @@ uint8_t config_get_screen_display()
   return settings.Screen.display;
 }
 
+bool config_get_screen_sync_updates()
+{
+  return settings.Screen.syncupdates!=0;
+}
+
 bool config_get_screen_monochrome()
 {
   return menuActive ? false : settings.Screen.mono!=0;
@@ -745,7 +792,7 @@ uint8_t config_get_keyboard_delete()
 }
 
 
-uint8_t config_get_keyboard_scroll_lock()
+uint8_t HOTFUN(config_get_keyboard_scroll_lock)()
 {
   return settings.Keyboard.scrolllock;
 }
@@ -964,13 +1011,13 @@ static int INFLASHFUN user_font_upload_fn(const struct MenuItemStruct *item, int
   if( callType==IFT_EDIT )
     {
       static const char __in_flash(".configmenus") message[6][80] =
-        {"Upload user font  via XModem protocol:",
-         "- Windows BMP file format, monochrome, no compression",
-         "- characters must be 8 pixels wide and 8-16 pixels high",
-         "- bitmap width must be a multiple of 32 pixels",
-         "- bitmap height must be a multiple of the character height",
-         "- bitmap width * bitmap height must equal 2048 * character height"};
-      printLines(14, 3, 5, message);
+        {"Upload user font  via XModem or YModem protocol:",
+         "- PSF1/PSF2, BDF or Windows BMP (monochrome, no compression) file",
+         "- characters must be at most 8 pixels wide and 8-16 pixels high",
+         "- BMP width must be a multiple of 32 pixels and its height a",
+         "  multiple of the character height, width * height must equal",
+         "  2048 * character height"};
+      printLines(14, 3, 6, message);
       print("\033[14;20H%i\033[21;3HWaiting for transmission...", get_userfont_num()+1);
 
       const char *error = font_receive_fontdata(get_userfont_num());
@@ -1457,12 +1504,14 @@ static int INFLASHFUN keyboard_key_mapping_fn(const struct MenuItemStruct *item,
 
 static int xmodem_confignum = 0;
 static uint8_t *xmodem_configdata = NULL;
+static uint32_t xmodem_configpos = 0;
 
 static bool INFLASHFUN sendConfigDataPacket(unsigned long no, char* charData, int size)
 {
-  if( no<=4096/128 )
+  // all blocks of a transfer have the same size
+  if( no*size<=4096 )
     {
-      memcpy(charData, flash_get_read_ptr(xmodem_confignum)+(no-1)*128, 128);
+      memcpy(charData, flash_get_read_ptr(xmodem_confignum)+(no-1)*size, size);
       return true;
     }
   else
@@ -1472,7 +1521,9 @@ static bool INFLASHFUN sendConfigDataPacket(unsigned long no, char* charData, in
 
 static bool INFLASHFUN receiveConfigDataPacket(unsigned long no, char* charData, int size)
 {
-  if( no<=4096/128 ) memcpy(xmodem_configdata+(no-1)*128, charData, 128);
+  // block size may change during the transfer (128/1024 bytes)
+  if( xmodem_configpos<4096 ) memcpy(xmodem_configdata+xmodem_configpos, charData, MIN((uint32_t) size, 4096-xmodem_configpos));
+  xmodem_configpos += size;
   return true;
 }
 
@@ -1510,7 +1561,7 @@ static int INFLASHFUN configs_fn(const struct MenuItemStruct *item, int callType
         {"ENTER  : load settings from slot          * : set slot as startup",
          "S      : save current settings to slot    E : send slot data via XModem",
          "N      : change slot name                 I : receive slot data via XModem",
-         "DELETE : clear slot",
+         "DELETE : clear slot                       Y : send slot data via YModem",
          "> current configuration   * startup configuration    ! unsaved changes"};
 
       printLines(5, 5, 4, info);
@@ -1617,13 +1668,17 @@ static int INFLASHFUN configs_fn(const struct MenuItemStruct *item, int callType
                 }
               printPage = true;
             }
-          else if( (c=='e' || c=='E') && (header.magic==CONFIG_MAGIC) )
+          else if( (c=='e' || c=='E' || c=='y' || c=='Y') && (header.magic==CONFIG_MAGIC) )
             {
+              bool ymodem = (c=='y' || c=='Y');
+              char fname[16];
+              snprintf(fname, 16, "config%i.bin", i+1);
               xmodem_confignum = i;
-              print("\033[?25l\033[%i;5HSending configuration data via XModem protocol...", firstItemRow+14);
+              print("\033[?25l\033[%i;5HSending configuration data via %s protocol...", firstItemRow+14, ymodem ? "YModem" : "XModem");
 
               while( serial_xmodem_receive_char(10)!=-1 );
-              if( xmodem_transmit(serial_xmodem_receive_char, serial_xmodem_send_data, sendConfigDataPacket) )
+              if( ymodem ? ymodem_transmit(serial_xmodem_receive_char, serial_xmodem_send_data, sendConfigDataPacket, fname, 4096)
+                  : xmodem_transmit(serial_xmodem_receive_char, serial_xmodem_send_data, sendConfigDataPacket) )
                 print("\033[?25l\033[%i;5HSuccessfully sent configuration data. Press any key...", firstItemRow+14);
               else
                 print("\033[?25l\033[%i;5HTransmission of configuration data failed. Press any key...", firstItemRow+14);
@@ -1649,6 +1704,7 @@ static int INFLASHFUN configs_fn(const struct MenuItemStruct *item, int callType
                       print("\033[?25l\033[%i;5HReceiving configuration data via XModem protocol...", firstItemRow+14);
                       print("\r\n");
 
+                      xmodem_configpos = 0;
                       while( serial_xmodem_receive_char(10)!=-1 );
                       int res = xmodem_receive(serial_xmodem_receive_char, serial_xmodem_send_data, receiveConfigDataPacket);
                       if( res && *((uint32_t *) xmodem_configdata)==CONFIG_MAGIC )
@@ -2056,6 +2112,107 @@ static int usbtype_fn(const struct MenuItemStruct *item, int callType, int row,
 }
 
 
+static int INFLASHFUN usb_cdc_stats_fn(const struct MenuItemStruct *item, int callType, int row, int col)
+{
+  int res = 0;
+
+  if( callType==IFT_QUERY )
+    res = IFT_PRINT | IFT_EDIT;
+  else if( callType==IFT_PRINT )
+    {
+      uint32_t total, rate, peak;
+      serial_cdc_get_rx_stats(&total, &rate, &peak);
+      print("%lu KB, %lu B/s (peak %lu B/s)", (unsigned long) (total/1024), (unsigned long) rate, (unsigned long) peak);
+    }
+  else if( callType==IFT_EDIT )
+    {
+      // read-only, redraw the menu to show the current numbers
+      res = 1;
+    }
+  
+  return res;
+}
+
+
+static int INFLASHFUN video_timing_fn(const struct MenuItemStruct *item, int callType, int row, int col)
+{
+  int res = 0;
+  framebuf_timing_t t;
+
+  if( callType==IFT_QUERY )
+    res = IFT_PRINT | IFT_EDIT;
+  else if( callType==IFT_PRINT )
+    {
+      if( framebuf_get_timing(&t) )
+        print("max %lu of %lu cycles/line, %lu underruns", (unsigned long) t.line_max, (unsigned long) t.line_budget, (unsigned long) t.underruns);
+      else
+        print("not available (build option)");
+    }
+  else if( callType==IFT_EDIT && framebuf_get_timing(&t) )
+    {
+      uint8_t c;
+      do
+        {
+          print("\033[2J\033[3;5HVideo timing (clock cycles spent on core 1)");
+          print("\033[5;5HScanline: min %7lu  avg %7lu  max %7lu  (budget %lu)", 
+                (unsigned long) t.line_min, (unsigned long) t.line_avg, (unsigned long) t.line_max, (unsigned long) t.line_budget);
+          print("\033[6;5HFrame   : min %7lu  avg %7lu  max %7lu", 
+                (unsigned long) t.frame_min, (unsigned long) t.frame_avg, (unsigned long) t.frame_max);
+          print("\033[7;5HFrames  : %lu, underruns: %lu", (unsigned long) t.frames, (unsigned long) t.underruns);
+          print("\033[9;5H[R]eset, [D]ump to USB serial, [Enter] refresh, other keys exit");
+
+          c = toupper(waitkey(false));
+          if( c=='R' )
+            framebuf_reset_timing();
+          else if( c=='D' && serial_cdc_is_connected() )
+            {
+              char buf[100];
+              snprintf(buf, 100, "line %lu/%lu/%lu budget %lu, frame %lu/%lu/%lu, frames %lu, underruns %lu\r\n",
+                       (unsigned long) t.line_min, (unsigned long) t.line_avg, (unsigned long) t.line_max, (unsigned long) t.line_budget,
+                       (unsigned long) t.frame_min, (unsigned long) t.frame_avg, (unsigned long) t.frame_max,
+                       (unsigned long) t.frames, (unsigned long) t.underruns);
+              serial_cdc_send_string(buf);
+            }
+
+          framebuf_get_timing(&t);
+        }
+      while( c=='R' || c=='D' || c==KEY_ENTER );
+
+      res = 1;
+    }
+  
+  return res;
+}
+
+
+static int INFLASHFUN statistics_fn(const struct MenuItemStruct *item, int callType, int row, int col)
+{
+  int res = 0;
+
+  if( callType==IFT_QUERY )
+    res = IFT_EDIT;
+  else if( callType==IFT_EDIT )
+    {
+      uint8_t c;
+      do
+        {
+          print("\033[2J\033[3;5HStatistics (since power-up or reset)");
+          for(int i=0; i<STAT_NUM; i++)
+            print("\033[%i;%iH%-24s %10lu", 5+i%9, i<9 ? 5 : 44, stats_get_name(i), (unsigned long) stats_get(i));
+
+          print("\033[15;5H[R]eset, [Enter] refresh, other keys exit");
+          c = toupper(waitkey(false));
+          if( c=='R' ) stats_reset();
+        }
+      while( c=='R' || c==KEY_ENTER );
+
+      res = 1;
+    }
+  
+  return res;
+}
+
+
 // -----------------------------------------------------------------------------------------------------------------
 
 
@@ -2335,6 +2492,113 @@ bool config_menu_active()
 }
 
 
+// ZMODEM uploads started by the remote side (e.g. "sz font.bdf"), the data decides
+// what is received: configuration data (as sent from the configuration menu) goes
+// into slot N for file "configN.bin" or the current slot, anything else must be a
+// font and goes into the user font slot of the same name or the first empty one
+
+static char zmodem_filename[64];
+static bool zmodem_started, zmodem_isconfig, zmodem_changed;
+
+static bool INFLASHFUN zmodemFileStart(const char *fileName, long fileSize)
+{
+  const char *base = strrchr(fileName, '/');
+  snprintf(zmodem_filename, sizeof(zmodem_filename), "%s", base==NULL ? fileName : base+1);
+  zmodem_started = false;
+  return true;
+}
+
+
+static bool INFLASHFUN zmodemDataPacket(unsigned long no, char* charData, int size)
+{
+  if( !zmodem_started )
+    {
+      uint32_t magic = 0;
+      if( size>=4 ) memcpy(&magic, charData, 4);
+      zmodem_started  = true;
+      zmodem_isconfig = magic==CONFIG_MAGIC;
+      xmodem_configpos = 0;
+      if( zmodem_isconfig ? (xmodem_configdata = (uint8_t *) malloc(4096))==NULL : font_receive_start()!=NULL )
+        return false;
+    }
+
+  return zmodem_isconfig ? receiveConfigDataPacket(no, charData, size) : font_receive_data(no, charData, size);
+}
+
+
+static uint8_t INFLASHFUN zmodemFontSlot()
+{
+  uint32_t bw, bh;
+  uint8_t i, ch, ur;
+  size_t len = strcspn(zmodem_filename, ".");
+
+  for(i=0; i<4; i++)
+    if( strlen(font_get_name(FONT_ID_USER1+i))==len && strncmp(font_get_name(FONT_ID_USER1+i), zmodem_filename, len)==0 )
+      return i;
+
+  for(i=0; i<4; i++)
+    if( font_get_font_info(FONT_ID_USER1+i, &bw, &bh, &ch, &ur) && ch==0 )
+      return i;
+
+  return 0xFF;
+}
+
+
+static void INFLASHFUN zmodemFileEnd(bool ok)
+{
+  const char *error = NULL;
+  int n = 0;
+
+  if( !zmodem_started )
+    error = "No data received";
+  else if( zmodem_isconfig )
+    {
+      struct SettingsHeaderStruct *header = (struct SettingsHeaderStruct *) xmodem_configdata;
+      // only store configurations whose file name says which slot to overwrite
+      if( sscanf(zmodem_filename, "config%d", &n)!=1 || n<1 || n>10 )
+        error = "File name must be config1.bin to config10.bin";
+      else if( xmodem_configdata==NULL )
+        error = "Not enough memory";
+      else if( !ok )
+        error = "Transmission failed or canceled";
+      else if( header->version!=CONFIG_VERSION || header->size!=sizeof(struct SettingsStruct) )
+        error = "Incompatible configuration data";
+      else if( flash_write(n-1, xmodem_configdata, 4096)==0 )
+        error = "Writing configuration data to flash failed";
+      else if( n-1==currentConfig )
+        zmodem_changed = loadConfig(currentConfig);
+
+      free(xmodem_configdata);
+      xmodem_configdata = NULL;
+    }
+  else
+    {
+      uint8_t slot = zmodemFontSlot();
+      error = font_receive_finish(slot, ok && slot<4, zmodem_filename);
+      if( slot>=4 )
+        error = "No empty user font slot";
+      else if( error==NULL )
+        zmodem_changed = true;
+      n = slot+1;
+    }
+
+  if( error!=NULL )
+    print("\r\nZMODEM: %s: %s\r\n", zmodem_filename, error);
+  else
+    print("\r\nZMODEM: %s stored as %s %i\r\n", zmodem_filename, zmodem_isconfig ? "configuration" : "user font", n);
+}
+
+
+bool INFLASHFUN config_zmodem_receive()
+{
+  zmodem_changed = false;
+  if( !zmodem_receive(serial_xmodem_receive_char, serial_xmodem_send_data, zmodemFileStart, zmodemDataPacket, zmodemFileEnd) )
+    print("\r\nZMODEM: transfer failed or canceled\r\n");
+
+  return zmodem_changed;
+}
+
+
 bool INFLASHFUN config_load(uint8_t n)
 {
   bool res = false;
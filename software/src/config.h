@@ -43,6 +43,8 @@ uint8_t  config_get_serial_ctsmode();
 uint8_t  config_get_serial_rtsmode();
 uint8_t  config_get_serial_xonxoff();
 uint16_t config_get_serial_blink();
+uint8_t  config_get_serial_rx_highmark();
+uint8_t  config_get_serial_rx_lowmark();
 
 uint8_t config_get_screen_rows();
 uint8_t config_get_screen_cols();
@@ -52,6 +54,7 @@ uint8_t config_get_screen_font_bold();
 uint8_t config_get_screen_blink_period();
 uint8_t config_get_screen_display();
 bool    config_get_screen_monochrome();
+bool    config_get_screen_sync_updates();
 uint8_t config_get_screen_monochrome_backgroundcolor(bool dvi);
 uint8_t config_get_screen_monochrome_textcolor_normal(bool dvi);
 uint8_t config_get_screen_monochrome_textcolor_bold(bool dvi);
@@ -67,6 +70,7 @@ uint8_t config_get_terminal_del();
 bool    config_get_terminal_clearBit7();
 bool    config_get_terminal_uppercase();
 uint16_t config_get_terminal_scrolldelay();
+bool    config_get_terminal_zmodem_autostart();
 uint8_t config_get_terminal_default_fg();
 uint8_t config_get_terminal_default_bg();
 uint8_t config_get_terminal_default_attr();
@@ -95,6 +99,7 @@ uint8_t config_get_usb_cdcmode();
 
 void config_show_splash();
 bool config_load(uint8_t n);
+bool config_zmodem_receive();
 bool config_menu_active();
 void config_init();
 int  config_menu();
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <ctype.h>
 #include "hardware/flash.h"
 #include "pico/stdlib.h"
 #include "hardware/sync.h"
@@ -34,6 +35,7 @@
 #include "xmodem.h"
 #include "framebuf.h"
 #include "serial.h"
+#include "hotfun.h"
 
 #ifndef _IMG_ASSET_SECTION
 #define _IMG_ASSET_SECTION ".data"
@@ -98,29 +100,34 @@ struct FontInfoStruct
 
 
 static uint8_t cur_font_normal = 0, cur_font_bold = 0, font_char_height = 16;
-static uint8_t __attribute__((aligned(4), section(_IMG_ASSET_SECTION ".font"))) font_blinkoff[8*256*16];
-static uint8_t __attribute__((aligned(4), section(_IMG_ASSET_SECTION ".font"))) font_blinkon[8*256*16];
+static uint8_t font_underline_row[2] = {0xFF, 0xFF};
 
+// font bitmaps: pixel row r of character c is at r*256*4+c (normal font),
+// r*256*4+256+c (bold font), r*256*4+512+c (soft font loaded via DECDLD)
+// and r*256*4+768+c (bold soft font), underline and blink are applied by
+// the frame buffers while rendering
+static uint8_t __attribute__((aligned(4), section(_IMG_ASSET_SECTION ".font"))) font_data[4*256*16];
 
-bool font_have_boldfont()
+
+bool HOTFUN(font_have_boldfont)()
 {
   return cur_font_normal != cur_font_bold;
 }
 
 
-const uint8_t *font_get_data_blinkon()  
-{ 
-  return font_blinkon;  
+const uint8_t *font_get_data()
+{
+  return font_data;
 }
 
 
-const uint8_t *font_get_data_blinkoff() 
-{ 
-  return font_blinkoff; 
+uint8_t HOTFUN(font_get_underline_row)(bool bold)
+{
+  return font_underline_row[bold ? 1 : 0];
 }
 
 
-uint8_t font_get_char_height()
+uint8_t HOTFUN(font_get_char_height)()
 {
   return font_char_height;
 }
@@ -274,6 +281,10 @@ void INFLASHFUN font_set_underline_row(uint8_t fontNum, uint8_t underlineRow)
     {
       userFontInfo[fontNum-FONT_ID_USER1].underlineRow = underlineRow;
       flash_write(11, userFontInfo, sizeof(userFontInfo));
+
+      // underline is drawn while rendering so this takes effect right away
+      if( fontNum==cur_font_normal ) font_underline_row[0] = underlineRow;
+      if( fontNum==cur_font_bold )   font_underline_row[1] = underlineRow;
     }
 }
 
@@ -281,124 +292,305 @@ void INFLASHFUN font_set_underline_row(uint8_t fontNum, uint8_t underlineRow)
 // -----------------------------------------------------------------------------------------------------------------
 
 
-static uint8_t state;
-static uint32_t byteCounter, bitmapWidth, bitmapHeight, fontBaseAddr, fontCharHeight;
+// Received fonts are converted to the bitmap layout of the built-in fonts while
+// the data comes in and collected in RAM, the flash sector is written once after
+// the transfer is complete. Programming flash (with interrupts disabled) during
+// the transfer would stall the serial and USB interrupts and make the sender time out.
+// Supported formats:
+// - Windows BMP: stored as is (the bitmap layout of the built-in fonts)
+// - PSF1/PSF2 (Linux console fonts) and BDF (X11 fonts): the first 256 glyphs
+//   (by encoding for BDF) are stored as a bitmap of 2048 x character height pixels
+
+#define FF_NONE 0
+#define FF_BMP  1
+#define FF_PSF  2
+#define FF_BDF  3
+
+static uint8_t format, *fontSector = NULL;
+static uint32_t byteCounter, bitmapWidth, bitmapHeight, fontCharHeight, glyphStart, glyphSize, glyphCount;
 static const char *error = NULL;
 
+// BDF parser state
+static char bdfLine[64];
+static uint8_t bdfLineLen;
+static int bdfBox[4], bdfCharBox[4], bdfChar, bdfRow;
+
+
+static uint32_t INFLASHFUN get_le32(const uint8_t *data)
+{
+  return data[0]+(data[1]<<8)+(data[2]<<16)+(data[3]<<24);
+}
+
+
+static void INFLASHFUN set_glyph_row(uint32_t c, uint32_t r, uint8_t d)
+{
+  // store pixel row r of character c in a bottom-up 2048 pixel wide bitmap
+  if( c<256 && r<fontCharHeight )
+    fontSector[(fontCharHeight-1-r)*256+c] = d;
+}
+
+
+static const char *INFLASHFUN set_char_size(uint32_t width, uint32_t height)
+{
+  if( width>8 )
+    return "Characters must be at most 8 pixels wide";
+  else if( height<8 || height>16 )
+    return "Character height must be between 8 and 16 pixels (inclusive)";
+
+  fontCharHeight = height;
+  bitmapWidth    = 2048;
+  bitmapHeight   = height;
+  return NULL;
+}
+
+
+static const char *INFLASHFUN receive_header(const uint8_t *data, int size)
+{
+  if( size>=0x22 && data[0]=='B' && data[1]=='M' )
+    {
+      bitmapWidth  = get_le32(data+0x12);
+      bitmapHeight = get_le32(data+0x16);
+
+      if( (bitmapWidth % 32) != 0 )
+        return "Bitmap width must be a multiple of 32 (multiple of 4 characters wide)";
+      else if( ((bitmapHeight*bitmapWidth) % 2048)!=0 )
+        return "Product of bitmap height and width must be a multiple of 2048 (256 characters * 8 pixel width)";
+
+      fontCharHeight = (bitmapHeight*bitmapWidth) / 2048;
+      if( fontCharHeight<8 || fontCharHeight>16 )
+        return "Character height must be between 8 and 16 pixels (inclusive)";
+      else if( (bitmapHeight % fontCharHeight) != 0 )
+        return "Bitmap height must be a multiple of the character height";
+      else if( (data[0x1c]+(data[0x1d]<<8)) != 1 )
+        return "Bitmap must be monochrome (2 colors)";
+      else if( get_le32(data+0x1e)!=0 )
+        return "Bitmap file must contain uncompressed data";
+
+      // the bitmap is stored as one "glyph"
+      format     = FF_BMP;
+      glyphStart = get_le32(data+0x0a);
+      glyphSize  = fontCharHeight*256;
+      glyphCount = 1;
+      return NULL;
+    }
+  else if( size>=4 && data[0]==0x36 && data[1]==0x04 )
+    {
+      // PSF1: 8 pixel wide glyphs, 256 or 512 of them
+      format     = FF_PSF;
+      glyphStart = 4;
+      glyphSize  = data[3];
+      glyphCount = (data[2] & 1) ? 512 : 256;
+      return set_char_size(8, data[3]);
+    }
+  else if( size>=32 && get_le32(data)==0x864AB572 )
+    {
+      // PSF2: glyphs with one byte per pixel row if at most 8 pixels wide
+      format     = FF_PSF;
+      glyphStart = get_le32(data+8);
+      glyphCount = get_le32(data+16);
+      glyphSize  = get_le32(data+20);
+      const char *err = set_char_size(get_le32(data+28), get_le32(data+24));
+      return (err==NULL && glyphSize!=fontCharHeight) ? "Invalid PSF2 glyph size" : err;
+    }
+  else if( size>=9 && memcmp(data, "STARTFONT", 9)==0 )
+    {
+      format = FF_BDF;
+      fontCharHeight = 0;
+      bdfChar = -1;
+      bdfRow = -1;
+      bdfLineLen = 0;
+      return NULL;
+    }
+
+  return "Unknown font file format (expected BMP, PSF or BDF)";
+}
 
-bool INFLASHFUN receiveFontDataPacket(unsigned long no, char* charData, int size)
+
+static int INFLASHFUN bdf_get_params(const char *s, int *params, int n)
 {
-  static uint8_t dataPage[256];
-  uint8_t *data = (uint8_t *) charData;
+  // read up to n integer values following the keyword at the start of s
+  int i;
+  while( *s!=0 && *s!=' ' ) s++;
+  for(i=0; i<n; i++)
+    {
+      char *end;
+      params[i] = strtol(s, &end, 10);
+      if( end==s ) break;
+      s = end;
+    }
+
+  return i;
+}
+
 
-  if( error==NULL )
+static const char *INFLASHFUN bdf_process_line(const char *line)
+{
+  if( bdfRow>=0 )
     {
-      if( state==0 )
+      if( strcmp(line, "ENDCHAR")==0 )
+        bdfRow = -1;
+      else if( bdfChar>=0 )
         {
-          // beginning of file (header)
-          bitmapWidth  = data[0x12]+(data[0x13]<<8)+(data[0x14]<<16)+(data[0x15]<<24);
-          bitmapHeight = data[0x16]+(data[0x17]<<8)+(data[0x18]<<16)+(data[0x19]<<24);
-
-          if( data[0]!='B' || data[1]!='M' )
-            error = "Invalid or unhandled BMP file format (expected BM signature)";
-          else if( (bitmapWidth % 32) != 0 )
-            error = "Bitmap width must be a multiple of 32 (multiple of 4 characters wide)";
-          else if( ((bitmapHeight*bitmapWidth) % 2048)!=0 )
-            error = "Product of bitmap height and width must be a multiple of 2048 (256 characters * 8 pixel width)";
-          else 
-            { 
-              fontCharHeight = (bitmapHeight*bitmapWidth) / 2048;
-
-              if( fontCharHeight<8 || fontCharHeight>16 )
-                error = "Character height must be between 8 and 16 pixels (inclusive)";
-              else if( (bitmapHeight % fontCharHeight) != 0 )
-                error = "Bitmap height must be a multiple of the character height";
-              else if( (data[0x1c]+(data[0x1d]<<8)) != 1 )
-                error = "Bitmap must be monochrome (2 colors)";
-              else if( data[0x1e]!=0 || data[0x1f]!=0 || data[0x20]!=0 || data[0x21]!=0 )
-                error = "Bitmap file must contain uncompressed data";
-              else
-                {
-                  state = 1; 
-                  byteCounter = data[0x0a]+(data[0x0b]<<8)+(data[0x0c]<<16)+(data[0x0d]<<24); 
-                  uint32_t ints = save_and_disable_interrupts();
-                  flash_range_erase(fontBaseAddr, FLASH_SECTOR_SIZE);
-                  restore_interrupts(ints);
-                }
-            }
+          // one row of glyph pixels in hex, leftmost pixel in the MSB, place it in
+          // the character cell (font bounding box) according to the glyph's bounding box
+          uint32_t v = 0;
+          int bits = 0;
+          for(const char *s=line; isxdigit((int) *s) && bits<32; s++, bits+=4)
+            v = (v << 4) | (isdigit((int) *s) ? *s-'0' : (toupper((int) *s)-'A'+10));
+
+          int shift = bits - 8 + (bdfCharBox[2]-bdfBox[2]);
+          uint8_t d = (shift>=0 && shift<32) ? v >> shift : ((shift<0 && shift>-8) ? v << -shift : 0);
+          int r = (bdfBox[1]+bdfBox[3]) - (bdfCharBox[1]+bdfCharBox[3]) + bdfRow;
+          if( r>=0 ) set_glyph_row(bdfChar, r, d);
+          bdfRow++;
         }
-      
-      if( state==1 )
+    }
+  else if( strncmp(line, "FONTBOUNDINGBOX ", 16)==0 )
+    {
+      if( bdf_get_params(line, bdfBox, 4)!=4 )
+        return "Invalid BDF font bounding box";
+      return set_char_size(bdfBox[0], bdfBox[1]);
+    }
+  else if( strncmp(line, "ENCODING ", 9)==0 )
+    {
+      if( bdf_get_params(line, &bdfChar, 1)!=1 || bdfChar>255 ) bdfChar = -1;
+    }
+  else if( strncmp(line, "BBX ", 4)==0 )
+    {
+      if( bdf_get_params(line, bdfCharBox, 4)!=4 )
+        return "Invalid BDF character bounding box";
+    }
+  else if( strcmp(line, "BITMAP")==0 )
+    {
+      if( fontCharHeight==0 )
+        return "BDF font bounding box missing";
+      bdfRow = 0;
+    }
+  else if( strncmp(line, "STARTCHAR", 9)==0 )
+    {
+      // glyph bounding box defaults to the font bounding box
+      memcpy(bdfCharBox, bdfBox, sizeof(bdfBox));
+      bdfChar = -1;
+    }
+
+  return NULL;
+}
+
+
+bool INFLASHFUN font_receive_data(unsigned long no, char* charData, int size)
+{
+  const uint8_t *data = (const uint8_t *) charData;
+
+  if( error==NULL && format==FF_NONE )
+    error = receive_header(data, size);
+
+  if( error==NULL && format==FF_BDF )
+    {
+      // text format => process complete lines (lines longer than the buffer are cut off)
+      for(int i=0; i<size && error==NULL; i++)
         {
-          // waiting for bitmap data start
-          if( byteCounter > size )
-            byteCounter -= size;
-          else
+          char c = data[i];
+          if( c=='\n' )
             {
-              memcpy(dataPage, data+byteCounter, size-byteCounter);
-              state = 2;
-              byteCounter = size-byteCounter;
+              bdfLine[bdfLineLen] = 0;
+              error = bdf_process_line(bdfLine);
+              bdfLineLen = 0;
             }
+          else if( c!='\r' && bdfLineLen<sizeof(bdfLine)-1 )
+            bdfLine[bdfLineLen++] = c;
         }
-      else if( state==2 )
+    }
+  else if( error==NULL )
+    {
+      // binary formats => glyph data starts at glyphStart, glyphSize bytes per glyph
+      for(int i=0; i<size; i++)
         {
-          // receiving data
-          uint8_t pagePos = byteCounter%256;
-          if( pagePos+size >= 256 )
+          uint32_t pos = byteCounter+i;
+          if( pos>=glyphStart && pos<glyphStart+glyphSize*glyphCount )
             {
-              memcpy(dataPage+pagePos, data, 256-pagePos);
-              
-              uint32_t ints = save_and_disable_interrupts();
-              flash_range_program(fontBaseAddr + (byteCounter&~255), dataPage, FLASH_PAGE_SIZE);
-              restore_interrupts(ints);
-
-              size -= 256-pagePos;
-              data += 256-pagePos;
-              byteCounter += 256-pagePos;
-              pagePos = 0;
+              pos -= glyphStart;
+              if( format==FF_BMP )
+                fontSector[pos] = data[i];
+              else
+                set_glyph_row(pos/glyphSize, pos%glyphSize, data[i]);
             }
-
-          memcpy(dataPage+pagePos, data, size);
-          byteCounter += size;
-          if( byteCounter>=4096 ) state = 3;
-        }
-      else if( state==3 )
-        {
-          // done receiving => ignore additional data
         }
     }
 
+  byteCounter += size;
   return true; //error==NULL;
 }
 
 
-const char *INFLASHFUN font_receive_fontdata(uint8_t userFontNum)
+const char *INFLASHFUN font_receive_start()
 {
-  state = 0;
+  format = FF_NONE;
+  byteCounter = 0;
   error = NULL;
-  if( userFontNum<4 )
-    {
-      fontBaseAddr = flash_get_write_offset(userFontNum+12);
+  if( (fontSector = (uint8_t *) malloc(FLASH_SECTOR_SIZE))==NULL )
+    error = "Not enough memory";
+  else
+    memset(fontSector, 0, FLASH_SECTOR_SIZE);
+
+  return error;
+}
+
 
-      while( serial_xmodem_receive_char(10)!=-1 );
-      if( !xmodem_receive(serial_xmodem_receive_char, serial_xmodem_send_data, receiveFontDataPacket) )
-        error = "Transmission failed or canceled";
-      else if( error==NULL )
+const char *INFLASHFUN font_receive_finish(uint8_t userFontNum, bool ok, const char *fname)
+{
+  if( fontSector==NULL )
+    return error;
+  else if( error==NULL && !ok )
+    error = "Transmission failed or canceled";
+  else if( error==NULL && userFontNum>=4 )
+    error = "Invalid font number";
+  else if( error==NULL && format==FF_NONE )
+    error = "No data received";
+  else if( error==NULL && fontCharHeight==0 )
+    error = "BDF font bounding box missing";
+  else if( error==NULL )
+    {
+      if( !flash_write(userFontNum+12, fontSector, FLASH_SECTOR_SIZE) )
+        error = "Writing font data to flash failed";
+      else
         {
           userFontInfo[userFontNum].bitmapWidth = bitmapWidth;
           userFontInfo[userFontNum].bitmapHeight = bitmapHeight;
           userFontInfo[userFontNum].charHeight = fontCharHeight;
           userFontInfo[userFontNum].underlineRow = (fontCharHeight<13) ? fontCharHeight-1 : fontCharHeight-2;
+
+          // name the font after the file if the protocol provided a file name
+          if( fname!=NULL && fname[0]!=0 )
+            {
+              const char *base = strrchr(fname, '/');
+              base = base==NULL ? fname : base+1;
+              size_t len = strcspn(base, ".");
+              if( len>0 ) snprintf(userFontInfo[userFontNum].name, 32, "%.*s", (int) len, base);
+            }
+
           flash_write(11, userFontInfo, sizeof(userFontInfo));
         }
     }
-  else
-    error = "Invalid font number";
-  
+
+  free(fontSector);
+  fontSector = NULL;
   return error;
 }
 
 
+const char *INFLASHFUN font_receive_fontdata(uint8_t userFontNum)
+{
+  if( userFontNum>=4 )
+    return "Invalid font number";
+  else if( font_receive_start()!=NULL )
+    return error;
+
+  while( serial_xmodem_receive_char(10)!=-1 );
+  bool ok = xmodem_receive(serial_xmodem_receive_char, serial_xmodem_send_data, font_receive_data);
+  return font_receive_finish(userFontNum, ok, xmodem_get_filename());
+}
+
+
 // -----------------------------------------------------------------------------------------------------------------
 
 
@@ -426,20 +618,13 @@ static bool INFLASHFUN set_font_data(uint32_t font_offset, uint32_t bitmapWidth,
             int cr = (bitmapHeight-br-1) % charHeight;
             int cn = ((bitmapHeight-br-1)/charHeight)*(bitmapWidth/8) + bc;
 
-            uint32_t offset = cr*256*8+cn;
+            uint32_t offset = cr*256*4+cn;
             uint8_t d   = bitmapData[br*bitmapWidth/8+bc];
             if( framebuf_is_dvi() ) d = reverse_bits(d);
-            uint8_t du  = cr==underlineRow ? 255 : d;
-            font_blinkoff[font_offset+offset+256*0] = d;
-            font_blinkoff[font_offset+offset+256*1] = du;
-            font_blinkoff[font_offset+offset+256*2] = d;
-            font_blinkoff[font_offset+offset+256*3] = du;
-            font_blinkon[font_offset+offset+256*0]  = d;
-            font_blinkon[font_offset+offset+256*1]  = du;
-            font_blinkon[font_offset+offset+256*2]  = ~d;
-            font_blinkon[font_offset+offset+256*3]  = ~du;
+            font_data[font_offset+offset] = d;
           }
       
+      font_underline_row[font_offset ? 1 : 0] = underlineRow;
       return true;
     }
 
@@ -447,6 +632,29 @@ static bool INFLASHFUN set_font_data(uint32_t font_offset, uint32_t bitmapWidth,
 }
 
 
+void INFLASHFUN font_set_soft_glyphs(uint8_t first, uint8_t num, const uint8_t *glyphs)
+{
+  // copy soft font glyphs (16 rows of 8 pixels each, leftmost pixel in bit 7)
+  // for characters first..first+num-1 into the font, the bold soft font
+  // gets the same glyphs with each pixel extended one to the right
+  for(uint8_t i=0; i<num; i++)
+    for(int r=0; r<16; r++)
+      {
+        uint8_t d = glyphs[i*16+r], db = d | (d >> 1);
+        if( framebuf_is_dvi() ) { d = reverse_bits(d); db = reverse_bits(db); }
+        font_data[r*256*4+512+first+i] = d;
+        font_data[r*256*4+768+first+i] = db;
+      }
+}
+
+
+void INFLASHFUN font_clear_soft_glyphs()
+{
+  for(int r=0; r<16; r++)
+    memset(font_data+r*256*4+512, 0, 2*256);
+}
+
+
 bool INFLASHFUN font_apply_font(uint8_t font, bool bold)
 {
   bool res = false;
@@ -459,7 +667,7 @@ bool INFLASHFUN font_apply_font(uint8_t font, bool bold)
       if( font!=(bold ? cur_font_bold : cur_font_normal) )
         {
           if( font_get_font_info(font, &bitmapWidth, &bitmapHeight, &charHeight, &underlineRow) )
-            if( set_font_data(bold ? 4*256 : 0, bitmapWidth, bitmapHeight, charHeight, underlineRow, font_get_bmpdata(font)) )
+            if( set_font_data(bold ? 256 : 0, bitmapWidth, bitmapHeight, charHeight, underlineRow, font_get_bmpdata(font)) )
               {
                 if( bold )
                   cur_font_bold = font;
@@ -35,8 +35,8 @@
 #define FONT_ID_USER4    10
 
 bool           font_have_boldfont();
-const uint8_t *font_get_data_blinkon();
-const uint8_t *font_get_data_blinkoff();
+const uint8_t *font_get_data();
+uint8_t        font_get_underline_row(bool bold);
 
 uint8_t        font_get_char_height();
 bool           font_get_font_info(uint8_t fontNum, uint32_t *bitmapWidth, uint32_t *bitmapHeight, uint8_t *charHeight, uint8_t *underlineRow);
@@ -48,9 +48,17 @@ const uint8_t *font_get_graphics_char_mapping(uint8_t fontNum);
 bool font_set_graphics_char_mapping(uint8_t fontNum, const uint8_t *mapping);
 void font_set_underline_row(uint8_t fontNum, uint8_t underlineRow);
 void font_set_name(uint8_t fontNum, const char *name);
+void font_set_soft_glyphs(uint8_t first, uint8_t num, const uint8_t *glyphs);
+void font_clear_soft_glyphs();
 
 const char *font_receive_fontdata(uint8_t fontNum);
 
+// receiving font data via a file transfer protocol: start, pass all received
+// data blocks to font_receive_data, then finish to store the font in a user font slot
+const char *font_receive_start();
+bool        font_receive_data(unsigned long no, char *data, int size);
+const char *font_receive_finish(uint8_t fontNum, bool ok, const char *fileName);
+
 bool font_apply_font(uint8_t font, bool bold);
 
 void font_apply_settings();
@@ -20,7 +20,9 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include "pico/stdlib.h"
 #include "hardware/uart.h"
+#include "hardware/sync.h"
 
 #include "pins.h"
 #include "font.h"
@@ -30,12 +32,14 @@
 #include "framebuf.h"
 #include "framebuf_dvi.h"
 #include "framebuf_vga.h"
+#include "hotfun.h"
 
 // defined in main.c
 void wait(uint32_t milliseconds);
 
-static __attribute__((aligned(4))) uint8_t framebuf_data[80*60*4];  // shared data buffer
-static __attribute__((aligned(4))) uint8_t framebuf_rowattr[60];    // row attributes
+static __attribute__((aligned(4))) uint8_t framebuf_data[MAX_COLS*FRAMEBUF_ROWMAP_SIZE*4];  // shared data buffer
+static __attribute__((aligned(4))) uint16_t framebuf_rowinfo[FRAMEBUF_ROWMAP_SIZE];   // row attributes (low byte) and physical row (high byte)
+static __attribute__((aligned(4))) uint16_t framebuf_rowinfo_shown[FRAMEBUF_ROWMAP_SIZE]; // row info used by the display backend
 int16_t framebuf_flash_counter = 0;
 uint8_t framebuf_flash_color = 0;
 
@@ -43,150 +47,378 @@ uint8_t framebuf_flash_color = 0;
 static bool screen_inverted = false, double_size_chars = false;
 static uint8_t num_rows = 0, num_cols = 0, xborder = 0, yborder = 0;
 static bool is_dvi = true;
-static uint8_t color_map_inv[256];
+// color_map maps the 256-color index space (0-15: configured palette, 16-231:
+// 6x6x6 color cube, 232-255: gray ramp) to display colors (RGB332 on VGA,
+// RRGGBB on DVI), color_map_inv maps display colors back to palette colors
+// (0xFF if not a palette color)
+static uint8_t color_map[256], color_map_inv[256];
+static uint32_t rgb_cache_key[64];  // 24-bit color => color index cache for framebuf_map_rgb
+static uint8_t  rgb_cache_color[64];
+static bool monochrome = false;
+static uint8_t mono_bg = 0, mono_normal = 0, mono_bold = 0;
 static uint16_t scroll_delay = 0;
 
-#define MKIDX(x, y) (((x)+xborder) + (((y)+yborder) * MAX_COLS))
+// cursor as handed to the display backend (row info index of first row, number of rows,
+// column, attributes to toggle), the display draws it so the frame buffer never holds it
+static uint8_t cursor_row = 0, cursor_rows = 0, cursor_col = 0, cursor_attr = 0;
+
+// tear-free updates: while an update is in progress (framebuf_begin_update), rows
+// that are currently shown are copied to a spare physical row before being
+// changed, the new row info is handed to the display at the next frame start.
+// Core 0 holds update_lock during an update, the display core publishes only
+// while holding it. If the VGA interrupt finds it taken it records the missed
+// publish and the next update waits for the display, so it lags at most one frame.
+static bool sync_updates = false, cow_active = false, update_changed = false;
+static uint8_t update_depth = 0;
+static uint32_t shown_rows[(FRAMEBUF_ROWMAP_SIZE+31)/32];  // bit set for each physical row the display is showing
+static spin_lock_t *update_lock = NULL;
+static volatile bool commit_pending = false, publish_missed = false;
+
+// alternate screen: while active, the row info entries of the normal screen's rows
+// are parked in the last num_rows row info entries (the end of the spare rows)
+// and the screen shows the physical rows that were there before
+static bool alt_screen = false;
+
+// scrollback: rows scrolled out at the top of the (normal) screen are stored in
+// sb_data, each line as row attribute byte followed by runs of characters with
+// the same attribute/colors ([count][attr][bg][fg][count characters]), the
+// last run has count 0 and gives the attribute/colors of the (not stored)
+// trailing blanks. sb_line holds the start offset of each line (ring buffer).
+// While looking at the scrollback (sb_view>0) the screen's rows are parked
+// as for the alternate screen, the view shows scrollback lines in the spare
+// rows they replaced (sb_spare) and points to the parked rows for the rest.
+#ifndef SCROLLBACK_SIZE
+#define SCROLLBACK_SIZE 16384
+#endif
+#define SCROLLBACK_LINES 1024
+static uint8_t  sb_data[SCROLLBACK_SIZE];
+static uint16_t sb_line[SCROLLBACK_LINES];
+static uint16_t sb_first = 0, sb_count = 0, sb_wpos = 0, sb_view = 0;
+static uint16_t sb_spare[FRAMEBUF_ROWMAP_SIZE/2];  // row info of the spare rows replaced by the parked rows
+
+// frame buffer access functions of the active (DVI or VGA) backend,
+// selected once in framebuf_init()
+typedef struct
+{
+  void     (*charmemset)(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n);
+  void     (*charmemmove)(uint32_t toidx, uint32_t fromidx, size_t n);
+  uint8_t  (*get_char)(uint32_t idx);
+  void     (*set_char)(uint32_t idx, uint8_t c);
+  uint8_t  (*get_attr)(uint32_t idx);
+  void     (*set_attr)(uint32_t idx, uint8_t a);
+  void     (*set_color)(uint32_t idx, uint8_t fg, uint8_t bg);
+  void     (*get_color)(uint32_t idx, uint8_t *fg, uint8_t *bg);
+  void     (*set_char_and_attr)(uint32_t idx, uint32_t c);
+  uint32_t (*get_char_and_attr)(uint32_t idx);
+  void     (*get_chars_and_attrs)(uint32_t idx, uint32_t *buf, size_t n);
+  void     (*set_inverted)(bool invert);
+  void     (*set_cursor)(uint8_t row, uint8_t nrows, uint8_t col, uint8_t attr);
+  uint8_t  (*set_columns)(uint8_t ncols);
+} FramebufBackend;
+
+static const FramebufBackend backend_dvi =
+  {framebuf_dvi_charmemset, framebuf_dvi_charmemmove, framebuf_dvi_get_char, framebuf_dvi_set_char,
+   framebuf_dvi_get_attr, framebuf_dvi_set_attr, framebuf_dvi_set_color, framebuf_dvi_get_color,
+   framebuf_dvi_set_char_and_attr, framebuf_dvi_get_char_and_attr, framebuf_dvi_get_chars_and_attrs,
+   framebuf_dvi_set_inverted, framebuf_dvi_set_cursor, framebuf_dvi_set_columns};
+
+static const FramebufBackend backend_vga =
+  {framebuf_vga_charmemset, framebuf_vga_charmemmove, framebuf_vga_get_char, framebuf_vga_set_char,
+   framebuf_vga_get_attr, framebuf_vga_set_attr, framebuf_vga_set_color, framebuf_vga_get_color,
+   framebuf_vga_set_char_and_attr, framebuf_vga_get_char_and_attr, framebuf_vga_get_chars_and_attrs,
+   framebuf_vga_set_inverted, framebuf_vga_set_cursor, framebuf_vga_set_columns};
+
+static const FramebufBackend *backend = &backend_dvi;
+
+#define MKIDX(x, y) (((x)+xborder) + (ROW_INFO_PHYS(framebuf_rowinfo[(y)+yborder]) * MAX_COLS))
+#define ROWATTR(y)  ROW_INFO_ATTR(framebuf_rowinfo[(y)+yborder])
+#define WRIDX(x, y) ((cow_active ? make_row_private((y)+yborder) : (void) 0), MKIDX(x, y))
+#define ROW_SHOWN(p) (shown_rows[(p)/32] & (1u << ((p)%32)))
+
+
+static void __not_in_flash_func(publish_rowmap)()
+{
+  uint32_t shown[(FRAMEBUF_ROWMAP_SIZE+31)/32] = {0};
+  memcpy(framebuf_rowinfo_shown, framebuf_rowinfo, sizeof(framebuf_rowinfo));
+  for(uint8_t i=0, n=MAX_ROWS; i<n; i++)
+    {
+      uint8_t p = ROW_INFO_PHYS(framebuf_rowinfo[i]);
+      shown[p/32] |= 1u << (p%32);
+    }
+  memcpy(shown_rows, shown, sizeof(shown_rows));
+  backend->set_inverted(screen_inverted);
+  backend->set_cursor(cursor_row, cursor_rows, cursor_col, sb_view>0 ? 0 : cursor_attr);
+}
 
 
-static uint8_t mapcolor(uint8_t color16)
+static void rowmap_changed()
 {
-  return config_get_screen_color(color16, is_dvi);
+  if( cow_active )
+    update_changed = true;
+  else
+    publish_rowmap();
 }
 
 
-static uint8_t mapcolor_inv(uint8_t fullcolor)
+static void make_row_private(uint8_t y)
 {
-  return color_map_inv[fullcolor];
+  uint8_t phys = ROW_INFO_PHYS(framebuf_rowinfo[y]);
+  if( ROW_SHOWN(phys) )
+    {
+      // row info entries beyond the displayed rows hold the spare physical rows,
+      // swap with one that is not shown anymore. If there is none then the row
+      // is changed in place.
+      uint8_t spare_end = (alt_screen || sb_view>0) ? FRAMEBUF_ROWMAP_SIZE-num_rows : FRAMEBUF_ROWMAP_SIZE;
+      for(uint8_t s=MAX_ROWS; s<spare_end; s++)
+        {
+          uint8_t p = ROW_INFO_PHYS(framebuf_rowinfo[s]);
+          if( !ROW_SHOWN(p) )
+            {
+              backend->charmemmove(p * MAX_COLS, phys * MAX_COLS, MAX_COLS);
+              framebuf_rowinfo[s] = phys << 8;
+              framebuf_rowinfo[y] = (p << 8) | ROW_INFO_ATTR(framebuf_rowinfo[y]);
+              update_changed = true;
+              break;
+            }
+        }
+    }
 }
 
 
+static void wait_visible(uint32_t ms)
+{
+  // end an update in progress while waiting so the display
+  // shows the changes made so far
+  uint8_t depth = update_depth;
+  if( depth>0 ) { update_depth = 1; framebuf_end_update(); }
+  wait(ms);
+  if( depth>0 ) { framebuf_begin_update(); update_depth = depth; }
+}
 
-static void charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n)
+
+static void set_rowattr(uint8_t y, uint8_t attr)
+{
+  framebuf_rowinfo[y] = (framebuf_rowinfo[y] & 0xFF00) | attr;
+  rowmap_changed();
+}
+
+
+static void reset_rowmap()
+{
+  // map each screen row back to its own physical row in the frame buffer,
+  // keeping the row attributes
+  for(int i=0; i<FRAMEBUF_ROWMAP_SIZE; i++)
+    framebuf_rowinfo[i] = (i << 8) | ROW_INFO_ATTR(framebuf_rowinfo[i]);
+  alt_screen = false;
+  sb_view = 0;
+  rowmap_changed();
+}
+
+
+static void rotate_rows(uint8_t start, uint8_t end, int8_t n)
 {
-  if( config_get_screen_monochrome() )
+  // rotate row info entries [start..end] by n rows (n>0: up, n<0: down)
+  // so scrolling only re-points rows instead of moving their content
+  uint16_t tmp[FRAMEBUF_ROWMAP_SIZE];
+  uint8_t len = end-start+1;
+  if( n>0 )
     {
-      fg = (a & ATTR_BOLD) ? config_get_screen_monochrome_textcolor_bold(is_dvi) : config_get_screen_monochrome_textcolor_normal(is_dvi);
-      bg = config_get_screen_monochrome_backgroundcolor(is_dvi);
+      memcpy(tmp, framebuf_rowinfo+start, n*2);
+      memmove(framebuf_rowinfo+start, framebuf_rowinfo+start+n, (len-n)*2);
+      memcpy(framebuf_rowinfo+end+1-n, tmp, n*2);
     }
   else
     {
-      fg = mapcolor(fg);
-      bg = mapcolor(bg);
+      n = -n;
+      memcpy(tmp, framebuf_rowinfo+end+1-n, n*2);
+      memmove(framebuf_rowinfo+start+n, framebuf_rowinfo+start, (len-n)*2);
+      memcpy(framebuf_rowinfo+start, tmp, n*2);
     }
-  
-  if( screen_inverted )
-    { uint8_t c = fg; fg = bg; bg = c; }
 
-  if( is_dvi )
-    return framebuf_dvi_charmemset(idx, c, a, fg, bg, n);
-  else
-    return framebuf_vga_charmemset(idx, c, a, fg, bg, n);
+  rowmap_changed();
 }
 
 
-static void charmemmove(uint32_t toidx, uint32_t fromidx, size_t n)
+static uint8_t mapcolor(uint8_t color)
 {
-  if( is_dvi )
-    return framebuf_dvi_charmemmove(toidx, fromidx, n);
-  else
-    return framebuf_vga_charmemmove(toidx, fromidx, n);
+  return color_map[color];
 }
 
 
-static void set_char_and_attr(uint32_t idx, uint32_t c)
+static uint8_t mapcolor_nobold(uint8_t color, bool bold)
 {
-  if( is_dvi )
-    framebuf_dvi_set_char_and_attr(idx, c);
-  else
-    framebuf_vga_set_char_and_attr(idx, c);
+  // without a bold font, bold is shown by using the bright palette
+  // colors (8-15) which are otherwise not available
+  return color_map[color<16 ? ((color & 7) | (bold ? 8 : 0)) : color];
 }
 
 
-static uint32_t get_char_and_attr(uint32_t idx)
+static uint8_t mapcolor_inv(uint8_t fullcolor)
 {
-  if( is_dvi )
-    return framebuf_dvi_get_char_and_attr(idx);
+  return color_map_inv[fullcolor];
+}
+
+
+static void get_color_rgb(uint8_t color, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+  // standard (xterm) RGB values of the extended colors 16-255
+  static const uint8_t levels[6] = {0, 95, 135, 175, 215, 255};
+  if( color>=232 )
+    *r = *g = *b = 8 + (color-232)*10;
   else
-    return framebuf_vga_get_char_and_attr(idx);
+    {
+      color -= 16;
+      *r = levels[color/36];
+      *g = levels[(color/6)%6];
+      *b = levels[color%6];
+    }
 }
 
 
-static void set_char(uint32_t idx, uint8_t c)
+static uint8_t rgb_to_display(uint8_t r, uint8_t g, uint8_t b)
 {
   if( is_dvi )
-    framebuf_dvi_set_char(idx, c);
+    return ((r*3+127)/255)<<4 | ((g*3+127)/255)<<2 | ((b*3+127)/255);
   else
-    framebuf_vga_set_char(idx, c);
+    return ((r*7+127)/255)<<5 | ((g*7+127)/255)<<2 | ((b*3+127)/255);
 }
 
 
-static uint8_t get_char(uint32_t idx)
+static void display_to_rgb(uint8_t c, int *r, int *g, int *b)
 {
   if( is_dvi )
-    return framebuf_dvi_get_char(idx);
+    { *r = ((c>>4)&3)*85; *g = ((c>>2)&3)*85; *b = (c&3)*85; }
   else
-    return framebuf_vga_get_char(idx);
+    { *r = ((c>>5)&7)*255/7; *g = ((c>>2)&7)*255/7; *b = (c&3)*85; }
 }
 
 
-static uint8_t get_attr(uint32_t idx)
+static uint8_t find_nearest_color(uint8_t r, uint8_t g, uint8_t b)
 {
-  if( is_dvi )
-    return framebuf_dvi_get_attr(idx);
+  // search the extended colors (not the palette colors which are subject to
+  // configuration and bold/bright mapping) for the one whose displayed color
+  // is nearest to the given color
+  uint32_t best_dist = 0xFFFFFFFF;
+  uint8_t best = 16;
+  for(int i=16; i<256 && best_dist>0; i++)
+    {
+      int cr, cg, cb;
+      display_to_rgb(color_map[i], &cr, &cg, &cb);
+      uint32_t dist = 3*(cr-r)*(cr-r) + 4*(cg-g)*(cg-g) + 2*(cb-b)*(cb-b);
+      if( dist<best_dist ) { best_dist = dist; best = i; }
+    }
+
+  return best;
+}
+
+
+uint8_t HOTFUN(framebuf_map_rgb)(uint8_t r, uint8_t g, uint8_t b)
+{
+  uint32_t key = 0x1000000 | r<<16 | g<<8 | b;
+  uint8_t  h   = (r ^ (g>>2) ^ (b>>4) ^ (g<<3) ^ (b<<5)) & 63;
+  if( rgb_cache_key[h]!=key )
+    {
+      rgb_cache_key[h]   = key;
+      rgb_cache_color[h] = find_nearest_color(r, g, b);
+    }
+
+  return rgb_cache_color[h];
+}
+
+
+
+static void charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n)
+{
+  if( monochrome )
+    {
+      fg = (a & ATTR_BOLD) ? mono_bold : mono_normal;
+      bg = mono_bg;
+    }
   else
-    return framebuf_vga_get_attr(idx);
+    {
+      fg = mapcolor(fg);
+      bg = mapcolor(bg);
+    }
+  
+  backend->charmemset(idx, c, a, fg, bg, n);
+}
+
+
+static inline void charmemmove(uint32_t toidx, uint32_t fromidx, size_t n)
+{
+  backend->charmemmove(toidx, fromidx, n);
+}
+
+
+static inline void set_char_and_attr(uint32_t idx, uint32_t c)
+{
+  backend->set_char_and_attr(idx, c);
+}
+
+
+static inline uint32_t get_char_and_attr(uint32_t idx)
+{
+  return backend->get_char_and_attr(idx);
+}
+
+
+static inline void set_char(uint32_t idx, uint8_t c)
+{
+  backend->set_char(idx, c);
+}
+
+
+static inline uint8_t get_char(uint32_t idx)
+{
+  return backend->get_char(idx);
+}
+
+
+static inline uint8_t get_attr(uint32_t idx)
+{
+  return backend->get_attr(idx);
 }
 
 
 static void set_fullcolor(uint32_t idx, uint8_t fg, uint8_t bg)
 {
-  bool char_inverted = (get_attr(idx) & ATTR_INVERSE)!=0;
-  if( char_inverted != screen_inverted )
+  if( get_attr(idx) & ATTR_INVERSE )
     { uint8_t c = fg; fg = bg; bg = c; }
 
-  if( is_dvi )
-    return framebuf_dvi_set_color(idx, fg, bg);
-  else
-    return framebuf_vga_set_color(idx, fg, bg);
+  backend->set_color(idx, fg, bg);
 }
 
 
 static void get_fullcolor(uint32_t idx, uint8_t *fg, uint8_t *bg)
 {
-  bool char_inverted = (get_attr(idx) & ATTR_INVERSE)!=0;
-  if( char_inverted != screen_inverted )
+  if( get_attr(idx) & ATTR_INVERSE )
     { uint8_t *c = fg; fg = bg; bg = c; }
   
-  if( is_dvi )
-    framebuf_dvi_get_color(idx, fg, bg);
-  else
-    framebuf_vga_get_color(idx, fg, bg);
+  backend->get_color(idx, fg, bg);
 }
 
 
-static void set_attr(uint32_t idx, uint8_t attr)
+static void HOTFUN(set_attr)(uint32_t idx, uint8_t attr)
 {
   uint8_t prev_attr = get_attr(idx);
   
   if( !font_have_boldfont() && (config_get_terminal_type()!=CFG_TTYPE_PETSCII) && (attr & ATTR_BOLD) != (prev_attr & ATTR_BOLD) )
     {
       // "bold" setting has changed and we are emulating bold via bright color setting
-      if( config_get_screen_monochrome() )
+      if( monochrome )
         {
           if( attr & ATTR_BOLD )
-            set_fullcolor(idx, config_get_screen_monochrome_textcolor_bold(is_dvi), config_get_screen_monochrome_backgroundcolor(is_dvi));
+            set_fullcolor(idx, mono_bold, mono_bg);
           else
-            set_fullcolor(idx, config_get_screen_monochrome_textcolor_normal(is_dvi), config_get_screen_monochrome_backgroundcolor(is_dvi));
+            set_fullcolor(idx, mono_normal, mono_bg);
         }
       else
         {
-          uint8_t fg, bg;
+          // only palette colors have a bright variant
+          uint8_t fg, bg, c;
           get_fullcolor(idx, &fg, &bg);
-          if( attr & ATTR_BOLD )
-            set_fullcolor(idx, mapcolor(mapcolor_inv(fg) | 8), bg);
-          else
-            set_fullcolor(idx, mapcolor(mapcolor_inv(fg) & 7), bg);
+          c = mapcolor_inv(fg);
+          if( c<16 ) set_fullcolor(idx, mapcolor((attr & ATTR_BOLD) ? (c | 8) : (c & 7)), bg);
         }
     }
   
@@ -198,21 +430,18 @@ static void set_attr(uint32_t idx, uint8_t attr)
       set_fullcolor(idx,  bg,  fg);
     }
       
-  if( is_dvi )
-    framebuf_dvi_set_attr(idx, attr);
-  else
-    framebuf_vga_set_attr(idx, attr);
+  backend->set_attr(idx, attr);
 }
 
 
-static void set_color(uint32_t idx, uint8_t fg, uint8_t bg)
+static void HOTFUN(set_color)(uint32_t idx, uint8_t fg, uint8_t bg)
 {
-  if( config_get_screen_monochrome() )
+  if( monochrome )
     {
       if( get_attr(idx) & ATTR_BOLD )
-        set_fullcolor(idx, config_get_screen_monochrome_textcolor_bold(is_dvi), config_get_screen_monochrome_backgroundcolor(is_dvi));
+        set_fullcolor(idx, mono_bold, mono_bg);
       else
-        set_fullcolor(idx, config_get_screen_monochrome_textcolor_normal(is_dvi), config_get_screen_monochrome_backgroundcolor(is_dvi));
+        set_fullcolor(idx, mono_normal, mono_bg);
     }
   else
     {
@@ -220,35 +449,35 @@ static void set_color(uint32_t idx, uint8_t fg, uint8_t bg)
         set_fullcolor(idx, mapcolor(fg), mapcolor(bg));
       else
         {
-          uint8_t bold = (get_attr(idx) & ATTR_BOLD) ? 8 : 0;
-          set_fullcolor(idx, mapcolor((fg & 7) | bold), mapcolor(bg & 7));
+          bool bold = (get_attr(idx) & ATTR_BOLD)!=0;
+          set_fullcolor(idx, mapcolor_nobold(fg, bold), mapcolor_nobold(bg, false));
         }
     }
 }
 
 
-uint8_t framebuf_get_nrows()
+uint8_t HOTFUN(framebuf_get_nrows)()
 {
   return double_size_chars ? num_rows/2 : num_rows;
 }
 
 
-uint8_t framebuf_get_ncols(int row)
+uint8_t HOTFUN(framebuf_get_ncols)(int row)
 {
-  if( row>=0 && row<framebuf_get_nrows() && !double_size_chars && (framebuf_rowattr[row+yborder] & ROW_ATTR_DBL_WIDTH)!=0 )
+  if( row>=0 && row<framebuf_get_nrows() && !double_size_chars && (ROWATTR(row) & ROW_ATTR_DBL_WIDTH)!=0 )
     return num_cols / 2;
   else
     return num_cols;
 }
 
 
-void framebuf_set_char(uint8_t x, uint8_t y, uint8_t c)
+void HOTFUN(framebuf_set_char)(uint8_t x, uint8_t y, uint8_t c)
 {
   if( double_size_chars ) y *= 2;
   if( y < num_rows && x < framebuf_get_ncols(y) )
     {
-      set_char(MKIDX(x, y), c);
-      if( double_size_chars ) set_char(MKIDX(x, y+1), c);
+      set_char(WRIDX(x, y), c);
+      if( double_size_chars ) set_char(WRIDX(x, y+1), c);
     }
 }
 
@@ -263,13 +492,13 @@ uint8_t framebuf_get_char(uint8_t x, uint8_t y)
 }
 
 
-void framebuf_set_attr(uint8_t x, uint8_t y, uint8_t attr)
+void HOTFUN(framebuf_set_attr)(uint8_t x, uint8_t y, uint8_t attr)
 {
   if( double_size_chars ) y *= 2;
   if( y < num_rows && x < framebuf_get_ncols(y) )
     {
-      set_attr(MKIDX(x, y), attr);
-      if( double_size_chars ) set_attr(MKIDX(x, y+1), attr);
+      set_attr(WRIDX(x, y), attr);
+      if( double_size_chars ) set_attr(WRIDX(x, y+1), attr);
     }
 }
 
@@ -286,24 +515,24 @@ uint8_t framebuf_get_attr(uint8_t x, uint8_t y)
 
 void framebuf_set_row_attr(uint8_t row, uint8_t attr)
 {
-  if( !double_size_chars && row<framebuf_get_nrows() && framebuf_rowattr[row+yborder]!=attr )
-    framebuf_rowattr[row+yborder] = attr;
+  if( !double_size_chars && row<framebuf_get_nrows() && ROWATTR(row)!=attr )
+    set_rowattr(row+yborder, attr);
 }
 
 
 uint8_t framebuf_get_row_attr(uint8_t y)
 {
-  return y<num_rows ? framebuf_rowattr[y+yborder] : 0;
+  return y<num_rows ? ROWATTR(y) : 0;
 }
 
 
-void framebuf_set_color(uint8_t x, uint8_t y, uint8_t fg, uint8_t bg)
+void HOTFUN(framebuf_set_color)(uint8_t x, uint8_t y, uint8_t fg, uint8_t bg)
 {
   if( double_size_chars ) y *= 2;
   if( y < num_rows && x < framebuf_get_ncols(y) )
     {
-      set_color(MKIDX(x, y), fg, bg);
-      if( double_size_chars ) set_color(MKIDX(x, y+1), fg, bg);
+      set_color(WRIDX(x, y), fg, bg);
+      if( double_size_chars ) set_color(WRIDX(x, y+1), fg, bg);
     }
 }
 
@@ -313,8 +542,61 @@ void framebuf_set_fullcolor(uint8_t x, uint8_t y, uint8_t fg, uint8_t bg)
   if( double_size_chars ) y *= 2;
   if( y < num_rows && x < framebuf_get_ncols(y) )
     {
-      set_fullcolor(MKIDX(x, y), fg, bg);
-      if( double_size_chars ) set_fullcolor(MKIDX(x, y+1), fg, bg);
+      set_fullcolor(WRIDX(x, y), fg, bg);
+      if( double_size_chars ) set_fullcolor(WRIDX(x, y+1), fg, bg);
+    }
+}
+
+
+void framebuf_get_fullcolor(uint8_t x, uint8_t y, uint8_t *fg, uint8_t *bg)
+{
+  if( double_size_chars ) y *= 2;
+  if( y < num_rows && x < framebuf_get_ncols(y) )
+    get_fullcolor(MKIDX(x, y), fg, bg);
+  else
+    *fg = *bg = 0;
+}
+
+
+void HOTFUN(framebuf_set_chars)(uint8_t x, uint8_t y, const char *chars, uint8_t n, uint8_t attr, uint8_t fg, uint8_t bg)
+{
+  if( double_size_chars ) y *= 2;
+  if( y < num_rows && x < framebuf_get_ncols(y) )
+    {
+      // compute the colors to store once for the whole span, the result is the
+      // same as calling set_color(), set_attr() and set_char() for each character
+      if( monochrome )
+        {
+          fg = (attr & ATTR_BOLD) ? mono_bold : mono_normal;
+          bg = mono_bg;
+        }
+      else if( font_have_boldfont() || config_get_terminal_type()==CFG_TTYPE_PETSCII )
+        {
+          fg = mapcolor(fg);
+          bg = mapcolor(bg);
+        }
+      else
+        {
+          fg = mapcolor_nobold(fg, (attr & ATTR_BOLD)!=0);
+          bg = mapcolor_nobold(bg, false);
+        }
+
+      if( attr & ATTR_INVERSE )
+        { uint8_t c = fg; fg = bg; bg = c; }
+
+      uint32_t v = (attr << 8) | (bg << 16) | (fg << 24);
+      if( n > framebuf_get_ncols(y)-x ) n = framebuf_get_ncols(y)-x;
+
+      uint32_t idx = WRIDX(x, y);
+      for(int i=0; i<n; i++)
+        set_char_and_attr(idx+i, v | (uint8_t) chars[i]);
+
+      if( double_size_chars )
+        {
+          idx = WRIDX(x, y+1);
+          for(int i=0; i<n; i++)
+            set_char_and_attr(idx+i, v | (uint8_t) chars[i]);
+        }
     }
 }
 
@@ -332,13 +614,13 @@ void framebuf_fill_region(uint8_t xs, uint8_t ys, uint8_t xe, uint8_t ye, char c
     {
       if( xs>0 )
         {
-          charmemset(MKIDX(xs, ys), c, config_get_terminal_default_attr(), fg, bg, num_cols-xs);
+          charmemset(WRIDX(xs, ys), c, config_get_terminal_default_attr(), fg, bg, num_cols-xs);
           ys++;
         }
 
       if( xe<framebuf_get_ncols(ye)-1 )
         {
-          charmemset(MKIDX(0, ye), c, config_get_terminal_default_attr(), fg, bg, xe+1);
+          charmemset(WRIDX(0, ye), c, config_get_terminal_default_attr(), fg, bg, xe+1);
           if( ye>0 )
             ye--;
           else
@@ -347,20 +629,58 @@ void framebuf_fill_region(uint8_t xs, uint8_t ys, uint8_t xe, uint8_t ye, char c
       
       while( ys<=ye )
         {
-          charmemset(MKIDX(0, ys), c, config_get_terminal_default_attr(), fg, bg, num_cols);
+          charmemset(WRIDX(0, ys), c, config_get_terminal_default_attr(), fg, bg, num_cols);
           ys++;
         }
     }
 }
 
 
+static void HOTFUN(scrollback_add_row)(uint8_t y)
+{
+  static uint32_t cells[MAX_COLS];
+  static uint8_t  line[1 + MAX_COLS*5 + 4];
+
+  backend->get_chars_and_attrs(MKIDX(0, y), cells, num_cols);
+
+  // trailing blanks with the same attribute/colors as the last character are not stored
+  uint32_t fill = (cells[num_cols-1] & 0xFFFFFF00) | ' ';
+  int n = num_cols;
+  while( n>0 && cells[n-1]==fill ) n--;
+
+  uint8_t *p = line;
+  *p++ = double_size_chars ? 0 : ROWATTR(y);
+  for(int i=0; i<n; )
+    {
+      uint32_t a = cells[i] & 0xFFFFFF00;
+      int j = i+1;
+      while( j<n && j-i<255 && (cells[j] & 0xFFFFFF00)==a ) j++;
+      *p++ = j-i; *p++ = a>>8; *p++ = a>>16; *p++ = a>>24;
+      while( i<j ) *p++ = cells[i++];
+    }
+  *p++ = 0; *p++ = fill>>8; *p++ = fill>>16; *p++ = fill>>24;
+
+  // store the line, dropping the oldest lines if their data would be
+  // overwritten or there are too many lines
+  uint16_t len = p-line;
+  if( sb_wpos+len > SCROLLBACK_SIZE ) sb_wpos = 0;
+  while( sb_count>0 && (sb_count==SCROLLBACK_LINES || (sb_line[sb_first]>=sb_wpos && sb_line[sb_first]<sb_wpos+len)) )
+    { sb_first = (sb_first+1) % SCROLLBACK_LINES; sb_count--; }
+
+  memcpy(sb_data+sb_wpos, line, len);
+  sb_line[(sb_first+sb_count) % SCROLLBACK_LINES] = sb_wpos;
+  sb_count++;
+  sb_wpos += len;
+}
+
+
 void framebuf_scroll_screen(int8_t n, uint8_t fg, uint8_t bg)
 {
   framebuf_scroll_region(0, framebuf_get_nrows()-1, n, fg, bg);
 }
 
 
-void framebuf_scroll_region(uint8_t start, uint8_t end, int8_t n, uint8_t fg, uint8_t bg)
+void HOTFUN(framebuf_scroll_region)(uint8_t start, uint8_t end, int8_t n, uint8_t fg, uint8_t bg)
 {
   if( double_size_chars ) {start *= 2; end=end*2+1; n *= 2; }
   if( n!=0 && start<num_rows && end<num_rows )
@@ -370,43 +690,46 @@ void framebuf_scroll_region(uint8_t start, uint8_t end, int8_t n, uint8_t fg, ui
           size_t n = keyboard_num_keypress();
           while( (keyboard_get_led_status() & KEYBOARD_LED_SCROLLLOCK)!=0  )
             { 
-              wait(10); 
+              wait_visible(10); 
               if( keyboard_num_keypress()>n ) { sound_play_tone(880, 50, config_get_audible_bell_volume(), false); n=keyboard_num_keypress(); }
             }
         }
 
-      if( scroll_delay>0 ) wait(scroll_delay);
+      if( scroll_delay>0 ) wait_visible(scroll_delay);
 
       if( n>0 )
         {
           // scrolling up
+          // rows scrolled out at the top of the screen go into the scrollback buffer
+          if( start==0 && !alt_screen && sb_view==0 )
+            for(int y=0; y<n && y<=end; y += double_size_chars ? 2 : 1)
+              scrollback_add_row(y);
+
+          // rows scrolled out at the top are re-used as the new (cleared) rows at the bottom
           if( n <= end-start )
-            {
-              if( !double_size_chars ) memmove(framebuf_rowattr+yborder+start, framebuf_rowattr+start+yborder+n, end-start+1-n);
-              for(int y=start; y<=end-n; y++)
-                charmemmove(MKIDX(0, y), MKIDX(0, y+n), MAX_COLS-xborder*2);
-            }
+            rotate_rows(start+yborder, end+yborder, n);
           
           if( n>end-start+1 ) n = end-start+1;
-          if( !double_size_chars ) memset(framebuf_rowattr+(end+yborder+1-n), 0, n);
           for(int y=0; y<n; y++)
-            charmemset(MKIDX(0, end+y+1-n), ' ', config_get_terminal_default_attr(), fg, bg, num_cols);
+            {
+              if( !double_size_chars ) set_rowattr(end+y+1-n+yborder, 0);
+              charmemset(WRIDX(0, end+y+1-n), ' ', config_get_terminal_default_attr(), fg, bg, num_cols);
+            }
         }
       else if( n<0 )
         {
           // scrolling down
           n = -n;
+          // rows scrolled out at the bottom are re-used as the new (cleared) rows at the top
           if( n <= end-start )
-            {
-              if( !double_size_chars ) memmove(framebuf_rowattr+start+yborder+n, framebuf_rowattr+start+yborder, end-start+1-n);
-              for(int y=end-n; y>=start; y--)
-                charmemmove(MKIDX(0, y+n), MKIDX(0, y), MAX_COLS-xborder*2);
-            }
+            rotate_rows(start+yborder, end+yborder, -n);
           
           if( n>end-start+1 ) n = end-start+1;
-          if( !double_size_chars ) memset(framebuf_rowattr+start+yborder, 0, n);
           for(int i=0; i<n; i++)
-            charmemset(MKIDX(0, start+i), ' ', config_get_terminal_default_attr(), fg, bg, num_cols);
+            {
+              if( !double_size_chars ) set_rowattr(start+i+yborder, 0);
+              charmemset(WRIDX(0, start+i), ' ', config_get_terminal_default_attr(), fg, bg, num_cols);
+            }
         }
     }
 }
@@ -420,19 +743,19 @@ void framebuf_insert(uint8_t x, uint8_t y, uint8_t n, uint8_t fg, uint8_t bg)
       for(int i=0; i<((int) num_cols)-(x+n); i++)
         {
           int col = num_cols-i-1;
-          set_char_and_attr(MKIDX(col, y), get_char_and_attr(MKIDX(col-n, y)));
-          if( double_size_chars ) set_char_and_attr(MKIDX(col, y+1), get_char_and_attr(MKIDX(col-n, y+1)));
+          set_char_and_attr(WRIDX(col, y), get_char_and_attr(MKIDX(col-n, y)));
+          if( double_size_chars ) set_char_and_attr(WRIDX(col, y+1), get_char_and_attr(MKIDX(col-n, y+1)));
         }
       
       for(int i=0; i<n && x+i<num_cols; i++)
         {
-          uint32_t idx = MKIDX(x+i, y);
+          uint32_t idx = WRIDX(x+i, y);
           set_char(idx, ' ');
           set_attr(idx, 0);
           set_color(idx, fg, bg);
           if( double_size_chars )
             {
-              idx += MAX_COLS;
+              idx = WRIDX(x+i, y+1);
               set_char(idx, ' ');
               set_attr(idx, 0);
               set_color(idx, fg, bg);
@@ -449,19 +772,19 @@ void framebuf_delete(uint8_t x, uint8_t y, uint8_t n, uint8_t fg, uint8_t bg)
     {
       for(int i=0; i<((int) num_cols)-(x+n); i++)
         {
-          set_char_and_attr(MKIDX(x+i, y), get_char_and_attr(MKIDX(x+n+i, y)));
-          if( double_size_chars ) set_char_and_attr(MKIDX(x+i, y+1), get_char_and_attr(MKIDX(x+n+i, y+1)));
+          set_char_and_attr(WRIDX(x+i, y), get_char_and_attr(MKIDX(x+n+i, y)));
+          if( double_size_chars ) set_char_and_attr(WRIDX(x+i, y+1), get_char_and_attr(MKIDX(x+n+i, y+1)));
         }
       
       for(int i=0; i<n && i<num_cols-x; i++)
         {
-          uint32_t idx = MKIDX(num_cols-1-i, y);
+          uint32_t idx = WRIDX(num_cols-1-i, y);
           set_char(idx, ' ');
           set_attr(idx, 0);
           set_color(idx, fg, bg);
           if( double_size_chars )
             {
-              idx += MAX_COLS;
+              idx = WRIDX(num_cols-1-i, y+1);
               set_char(idx, ' ');
               set_attr(idx, 0);
               set_color(idx, fg, bg);
@@ -473,63 +796,198 @@ void framebuf_delete(uint8_t x, uint8_t y, uint8_t n, uint8_t fg, uint8_t bg)
 
 void framebuf_set_screen_size(uint8_t ncols, uint8_t nrows)
 {
+  uint8_t max_cols = backend->set_columns(ncols);
   if( nrows>MAX_ROWS ) nrows = MAX_ROWS;
-  if( ncols>MAX_COLS ) ncols = MAX_COLS;
+  if( ncols>max_cols ) ncols = max_cols;
 
   if( num_rows!=nrows || num_cols!=ncols )
     {
       screen_inverted = false;
       charmemset(0, ' ', config_get_terminal_default_attr(), config_get_terminal_default_fg(), config_get_terminal_default_bg(), MAX_ROWS * MAX_COLS);
-      memset(framebuf_rowattr, 0, MAX_ROWS);
+      for(int i=0; i<FRAMEBUF_ROWMAP_SIZE; i++) framebuf_rowinfo[i] = i << 8;
+      alt_screen = false;
+      sb_view = 0;
+      publish_rowmap();
 
-      double_size_chars = (ncols*8*2)<=FRAME_WIDTH && (nrows*font_get_char_height()*2)<=FRAME_HEIGHT && config_get_screen_dblchars();
+      double_size_chars = ncols*2<=max_cols && (nrows*font_get_char_height()*2)<=FRAME_HEIGHT && config_get_screen_dblchars();
       if( double_size_chars )
         {
           num_rows = nrows*2;
           num_cols = ncols;
-          xborder = (MAX_COLS-ncols*2)/4;
+          xborder = (max_cols-ncols*2)/4;
           yborder = (MAX_ROWS-nrows*2)/2;
           for(int i=0; i<num_rows; i++)
-            framebuf_rowattr[i+yborder] = ROW_ATTR_DBL_WIDTH | ((i&1) ? ROW_ATTR_DBL_HEIGHT_BOT : ROW_ATTR_DBL_HEIGHT_TOP);
+            set_rowattr(i+yborder, ROW_ATTR_DBL_WIDTH | ((i&1) ? ROW_ATTR_DBL_HEIGHT_BOT : ROW_ATTR_DBL_HEIGHT_TOP));
         }
       else
         {
           num_rows = nrows;
           num_cols = ncols;
-          xborder = (MAX_COLS-ncols)/2;
+          xborder = (max_cols-ncols)/2;
           yborder = (MAX_ROWS-nrows)/2;
         }
     }
 }
 
 
-void framebuf_set_screen_inverted(bool invert)
+static void swap_parked_rows(bool park)
 {
-  if( invert != screen_inverted )
+  // swaps the screen's row info entries with the parked ones, rows coming
+  // in from the spare rows start out without row attributes (except for
+  // the fixed ones in double size mode)
+  uint8_t first = FRAMEBUF_ROWMAP_SIZE-num_rows;
+  for(uint8_t i=0; i<num_rows; i++)
     {
-      uint8_t fg, bg;
-      if( is_dvi )
+      uint16_t r = framebuf_rowinfo[i+yborder], p = framebuf_rowinfo[first+i];
+      if( park ) p = (p & 0xFF00) | (double_size_chars ? ROW_INFO_ATTR(r) : 0);
+      framebuf_rowinfo[i+yborder] = p;
+      framebuf_rowinfo[first+i] = r;
+    }
+
+  rowmap_changed();
+}
+
+
+void framebuf_set_alternate_screen(bool alt)
+{
+  if( alt != alt_screen )
+    {
+      framebuf_set_scrollback_view(0);
+      swap_parked_rows(alt);
+      alt_screen = alt;
+
+      // the alternate screen's rows come from the spare rows which hold
+      // whatever was last written there => start out cleared
+      if( alt )
+        for(uint8_t y=0; y<num_rows; y++)
+          charmemset(WRIDX(0, y), ' ', config_get_terminal_default_attr(), config_get_terminal_default_fg(), config_get_terminal_default_bg(), num_cols);
+    }
+}
+
+
+bool framebuf_get_alternate_screen()
+{
+  return alt_screen;
+}
+
+
+static void scrollback_show_line(uint16_t line, uint8_t y)
+{
+  // shows the line'th most recent scrollback line in screen row y
+  const uint8_t *p = sb_data + sb_line[(sb_first+sb_count-line) % SCROLLBACK_LINES];
+  uint32_t idx = MKIDX(0, y);
+  if( !double_size_chars ) framebuf_rowinfo[y+yborder] = (framebuf_rowinfo[y+yborder] & 0xFF00) | *p;
+  p++;
+
+  uint8_t x = 0;
+  for(; p[0]>0; p+=4+p[0])
+    {
+      uint32_t a = p[1]<<8 | p[2]<<16 | p[3]<<24;
+      for(uint8_t i=0; i<p[0] && x<num_cols; i++)
+        set_char_and_attr(idx+x++, a | p[4+i]);
+    }
+
+  if( x<num_cols ) backend->charmemset(idx+x, ' ', p[1], p[3], p[2], num_cols-x);
+}
+
+
+uint16_t framebuf_set_scrollback_view(uint16_t lines)
+{
+  if( alt_screen ) lines = 0;
+  if( lines>sb_count ) lines = sb_count;
+
+  if( lines!=sb_view )
+    {
+      uint8_t step = double_size_chars ? 2 : 1;
+      uint8_t park = FRAMEBUF_ROWMAP_SIZE-num_rows;
+
+      if( sb_view==0 )
         {
-          for(uint32_t idx=0; idx<MAX_COLS*MAX_ROWS; idx++)
+          // park the screen's rows, the spare rows they replace hold the scrollback lines
+          for(uint8_t i=0; i<num_rows; i++)
             {
-              framebuf_dvi_get_color(idx, &fg, &bg);
-              framebuf_dvi_set_color(idx,  bg,  fg);
+              sb_spare[i] = framebuf_rowinfo[park+i];
+              framebuf_rowinfo[park+i] = framebuf_rowinfo[i+yborder];
+            }
+        }
+
+      sb_view = lines;
+      if( lines==0 )
+        {
+          // back to the screen's own rows
+          for(uint8_t i=0; i<num_rows; i++)
+            {
+              framebuf_rowinfo[i+yborder] = framebuf_rowinfo[park+i];
+              framebuf_rowinfo[park+i] = sb_spare[i];
             }
         }
       else
         {
-          for(uint32_t idx=0; idx<MAX_COLS*MAX_ROWS; idx++)
+          // top part of the view shows scrollback lines, the rest points
+          // to the (parked) top rows of the screen
+          for(uint8_t y=0; y<num_rows; y+=step)
             {
-              framebuf_vga_get_color(idx, &fg, &bg);
-              framebuf_vga_set_color(idx,  bg,  fg);
+              uint16_t line = y/step < lines ? lines - y/step : 0;
+              for(uint8_t i=0; i<step; i++)
+                {
+                  uint8_t attr = ROW_INFO_ATTR(framebuf_rowinfo[park+y+i]);
+                  if( line>0 )
+                    {
+                      framebuf_rowinfo[y+i+yborder] = (sb_spare[y+i] & 0xFF00) | (double_size_chars ? attr : 0);
+                      scrollback_show_line(line, y+i);
+                    }
+                  else
+                    {
+                      uint16_t r = framebuf_rowinfo[park + y - lines*step + i];
+                      framebuf_rowinfo[y+i+yborder] = (r & 0xFF00) | (double_size_chars ? attr : ROW_INFO_ATTR(r));
+                    }
+                }
             }
         }
-      
+
+      rowmap_changed();
+    }
+
+  return sb_view;
+}
+
+
+uint16_t framebuf_get_scrollback_view()
+{
+  return sb_view;
+}
+
+
+void framebuf_set_screen_inverted(bool invert)
+{
+  if( invert != screen_inverted )
+    {
+      // the display backend swaps the colors when rendering, the
+      // change is handed to it together with the row info
       screen_inverted = invert;
+      rowmap_changed();
     }
 }
 
 
+void HOTFUN(framebuf_set_cursor)(uint8_t x, uint8_t y, uint8_t attr)
+{
+  uint8_t nrows = 1;
+  if( double_size_chars ) { y *= 2; nrows = 2; }
+  if( y >= num_rows || x >= framebuf_get_ncols(y) ) attr = 0;
+
+  cursor_row  = y+yborder;
+  cursor_rows = nrows;
+  cursor_col  = x+xborder;
+  cursor_attr = attr & (ATTR_UNDERLINE|ATTR_BLINK|ATTR_BOLD|ATTR_INVERSE);
+
+  if( cow_active )
+    update_changed = true;
+  else
+    backend->set_cursor(cursor_row, cursor_rows, cursor_col, sb_view>0 ? 0 : cursor_attr);
+}
+
+
 void framebuf_set_scroll_delay(uint16_t ms)
 {
   scroll_delay = ms;
@@ -548,6 +1006,150 @@ void framebuf_flash_screen(uint8_t color, uint8_t nframes)
 }
 
 
+void HOTFUN(framebuf_begin_update)()
+{
+  // changes to the screen return from the scrollback view
+  if( sb_view>0 && update_depth==0 ) framebuf_set_scrollback_view(0);
+
+  if( update_depth++==0 && sync_updates )
+    {
+      // the display could not publish the previous update because another one
+      // was in progress, give it the next frame start to do so
+      while( publish_missed && commit_pending );
+
+      spin_lock_unsafe_blocking(update_lock);
+      cow_active = true;
+    }
+}
+
+
+void HOTFUN(framebuf_end_update)()
+{
+  if( update_depth>0 && --update_depth==0 && cow_active )
+    {
+      cow_active = false;
+      if( update_changed ) { commit_pending = true; update_changed = false; }
+      spin_unlock_unsafe(update_lock);
+    }
+}
+
+
+#if VERSATERM_VIDEO_TIMING
+
+// written by the video core only (except for the reset request)
+static uint32_t timing_budget = 0, timing_frame_cycles = 0;
+static volatile uint32_t timing_line_min, timing_line_max, timing_lines;
+static volatile uint32_t timing_frame_min, timing_frame_max, timing_frames;
+static volatile uint32_t timing_underruns;
+static volatile uint64_t timing_line_total, timing_frame_total;
+static volatile bool timing_reset = true;
+
+
+void framebuf_timing_init(uint32_t line_budget)
+{
+  timing_budget = line_budget;
+  timing_reset = true;
+}
+
+
+void __not_in_flash_func(framebuf_timing_line)(uint32_t cycles)
+{
+  if( cycles<timing_line_min ) timing_line_min = cycles;
+  if( cycles>timing_line_max ) timing_line_max = cycles;
+  timing_line_total += cycles;
+  timing_lines++;
+  timing_frame_cycles += cycles;
+}
+
+
+void __not_in_flash_func(framebuf_timing_underrun)()
+{
+  timing_underruns++;
+}
+
+
+static void __not_in_flash_func(timing_new_frame)()
+{
+  if( timing_reset )
+    {
+      timing_line_min = timing_frame_min = 0xFFFFFFFF;
+      timing_line_max = timing_frame_max = 0;
+      timing_line_total = timing_frame_total = 0;
+      timing_lines = timing_frames = timing_underruns = 0;
+      timing_reset = false;
+    }
+  else if( timing_frame_cycles>0 )
+    {
+      if( timing_frame_cycles<timing_frame_min ) timing_frame_min = timing_frame_cycles;
+      if( timing_frame_cycles>timing_frame_max ) timing_frame_max = timing_frame_cycles;
+      timing_frame_total += timing_frame_cycles;
+      timing_frames++;
+    }
+
+  timing_frame_cycles = 0;
+}
+
+#endif
+
+
+bool framebuf_get_timing(framebuf_timing_t *t)
+{
+#if VERSATERM_VIDEO_TIMING
+  // read while the video core keeps updating, the numbers may be off by a line
+  uint32_t lines = timing_lines, frames = timing_frames;
+  t->line_min    = lines>0 ? timing_line_min : 0;
+  t->line_max    = timing_line_max;
+  t->line_avg    = lines>0 ? (uint32_t) (timing_line_total / lines) : 0;
+  t->frame_min   = frames>0 ? timing_frame_min : 0;
+  t->frame_max   = timing_frame_max;
+  t->frame_avg   = frames>0 ? (uint32_t) (timing_frame_total / frames) : 0;
+  t->line_budget = timing_budget;
+  t->frames      = frames;
+  t->underruns   = timing_underruns;
+  return true;
+#else
+  memset(t, 0, sizeof(framebuf_timing_t));
+  return false;
+#endif
+}
+
+
+void framebuf_reset_timing()
+{
+#if VERSATERM_VIDEO_TIMING
+  // the video core clears the numbers at the start of the next frame
+  timing_reset = true;
+#endif
+}
+
+
+void __not_in_flash_func(framebuf_new_frame)()
+{
+#if VERSATERM_VIDEO_TIMING
+  timing_new_frame();
+#endif
+
+  if( commit_pending )
+    {
+      // DVI calls this from core 1's frame loop which can wait for an update
+      // in progress to end. VGA calls it from the scanline interrupt which
+      // must not wait, reading a hardware spin lock claims it if it is free.
+      if( is_dvi )
+        spin_lock_unsafe_blocking(update_lock);
+      else if( *update_lock==0 )
+        {
+          publish_missed = true;
+          return;
+        }
+
+      publish_rowmap();
+      commit_pending = false;
+      publish_missed = false;
+      spin_unlock_unsafe(update_lock);
+    }
+}
+
+
 bool framebuf_is_dvi()
 {
   return is_dvi;
@@ -558,9 +1160,30 @@ void framebuf_apply_settings()
 {
   font_apply_settings();
   memset(framebuf_data, 0, sizeof(framebuf_data));
+  reset_rowmap();
+
+  // the color settings only change when settings are applied, so look them
+  // up once here instead of for every character written
+  monochrome  = config_get_screen_monochrome();
+  mono_bg     = config_get_screen_monochrome_backgroundcolor(is_dvi);
+  mono_normal = config_get_screen_monochrome_textcolor_normal(is_dvi);
+  mono_bold   = config_get_screen_monochrome_textcolor_bold(is_dvi);
+  for(int i=0; i<16; i++)  color_map[i] = config_get_screen_color(i, is_dvi);
+  for(int i=16; i<256; i++)
+    {
+      uint8_t r, g, b;
+      get_color_rgb(i, &r, &g, &b);
+      color_map[i] = rgb_to_display(r, g, b);
+    }
+  for(int i=0; i<256; i++) color_map_inv[i] = 0xFF;
+  for(int i=15; i>=0; i--) color_map_inv[color_map[i]] = i;
+  memset(rgb_cache_key, 0, sizeof(rgb_cache_key));
+
+  sync_updates = config_get_screen_sync_updates();
   framebuf_set_screen_size(config_get_screen_cols(), config_get_screen_rows());
-  for(int i=0; i<256; i++) color_map_inv[i] = 0;
-  for(int i=0; i<16; i++)  color_map_inv[mapcolor(i)] = i;
+  commit_pending = false;
+  publish_missed = false;
+  publish_rowmap();
   scroll_delay = 0;
 }
 
@@ -581,13 +1204,22 @@ void framebuf_init(bool forceDVI)
     is_dvi = config_get_screen_display()==1;
   
   font_init();
+  update_lock = spin_lock_instance(spin_lock_claim_unused(true));
   memset(framebuf_data, 0, sizeof(framebuf_data));
+  for(int i=0; i<FRAMEBUF_ROWMAP_SIZE; i++) framebuf_rowinfo[i] = i << 8;
+  publish_rowmap();
   screen_inverted = false;
 
   if( is_dvi )
-    framebuf_dvi_init(framebuf_data, framebuf_rowattr);
+    {
+      backend = &backend_dvi;
+      framebuf_dvi_init(framebuf_data, framebuf_rowinfo_shown);
+    }
   else
-    framebuf_vga_init(framebuf_data, framebuf_rowattr);
+    {
+      backend = &backend_vga;
+      framebuf_vga_init(framebuf_data, framebuf_rowinfo_shown);
+    }
 
   framebuf_apply_settings();
 
@@ -25,18 +25,59 @@
 
 #define FRAME_WIDTH  640
 #define FRAME_HEIGHT 480
-#define MAX_COLS     ((uint32_t) (FRAME_WIDTH / FONT_CHAR_WIDTH))
+
+// With VERSATERM_DVI_WIDE (VERSATERM_VGA_WIDE) the DVI (VGA) output runs at
+// 800x480 and shows up to 100 columns of 8 pixel wide characters or 132 columns
+// of 6 pixel wide characters. MAX_COLS is the length of a row in the frame buffer
+// (rounded up to a multiple of 8 so DVI color rows start on a word boundary), the
+// number of columns the display actually shows is returned by the backend's
+// set_columns function.
+#if VERSATERM_DVI_WIDE
+#define DVI_FRAME_WIDTH 800
+#else
+#define DVI_FRAME_WIDTH FRAME_WIDTH
+#endif
+#if VERSATERM_VGA_WIDE
+#define VGA_FRAME_WIDTH 800
+#else
+#define VGA_FRAME_WIDTH FRAME_WIDTH
+#endif
+#if VERSATERM_DVI_WIDE || VERSATERM_VGA_WIDE
+#define MAX_COLS        ((uint32_t) 136)
+#else
+#define MAX_COLS        ((uint32_t) (FRAME_WIDTH / FONT_CHAR_WIDTH))
+#endif
 #define MAX_ROWS     ((uint32_t) (FRAME_HEIGHT / font_get_char_height()))
 
 #define ATTR_UNDERLINE 0x01
 #define ATTR_BLINK     0x02
 #define ATTR_BOLD      0x04
 #define ATTR_INVERSE   0x08
+#define ATTR_SOFTFONT  0x10
+
+// the DVI and VGA frame buffers store attributes in the order bold, soft font,
+// blink, underline, inverse so the renderers find the glyph (character, bold and
+// soft font) in the lower 10 bits of the character/attribute halfword,
+// ATTR_TO_FB converts to that order and ATTR_FROM_FB back
+#define ATTR_TO_FB(a)   ((((a) & ATTR_BOLD) >> 2) | (((a) & ATTR_SOFTFONT) >> 3) | (((a) & ATTR_BLINK) << 1) | \
+                         (((a) & ATTR_UNDERLINE) << 3) | (((a) & ATTR_INVERSE) << 1))
+#define ATTR_FROM_FB(a) ((((a) & 0x01) << 2) | (((a) & 0x02) << 3) | (((a) & 0x04) >> 1) | (((a) & 0x08) >> 3) | (((a) & 0x10) >> 1))
 
 #define ROW_ATTR_DBL_WIDTH       0x01
 #define ROW_ATTR_DBL_HEIGHT_TOP  0x02
 #define ROW_ATTR_DBL_HEIGHT_BOT  0x04
 
+// each screen row has a 16-bit row info entry holding the row attributes
+// (low byte) and the physical row within the frame buffer (high byte)
+#define ROW_INFO_ATTR(ri) ((ri) & 0xFF)
+#define ROW_INFO_PHYS(ri) ((ri) >> 8)
+
+// number of row info entries, the frame buffer has as many physical rows,
+// those beyond the screen's rows are used as spare rows. Twice the most rows
+// a screen can have (8 pixel font) so the alternate screen and the scrollback
+// view can always park all of the screen's rows in spare rows.
+#define FRAMEBUF_ROWMAP_SIZE (2*FRAME_HEIGHT/8)
+
 void framebuf_init(bool forceDVI);
 void framebuf_apply_settings();
 bool framebuf_is_dvi();
@@ -52,6 +93,12 @@ uint8_t framebuf_get_row_attr(uint8_t row);
 
 void framebuf_set_color(uint8_t column, uint8_t row, uint8_t foreground, uint8_t background);
 void framebuf_set_fullcolor(uint8_t x, uint8_t y, uint8_t fg, uint8_t bg);
+void framebuf_get_fullcolor(uint8_t x, uint8_t y, uint8_t *fg, uint8_t *bg);
+
+// returns the 256-color index (16-255) that is displayed nearest to the given 24-bit color
+uint8_t framebuf_map_rgb(uint8_t r, uint8_t g, uint8_t b);
+
+void framebuf_set_chars(uint8_t column, uint8_t row, const char *chars, uint8_t n, uint8_t attr, uint8_t fg, uint8_t bg);
 
 void framebuf_fill_screen(char character, uint8_t fg, uint8_t bg);
 void framebuf_fill_region(uint8_t col_start, uint8_t row_start, uint8_t col_end, uint8_t row_end, char character, uint8_t fg, uint8_t bg);
@@ -68,6 +115,49 @@ uint8_t framebuf_get_ncols(int row);
 void framebuf_set_scroll_delay(uint16_t ms);
 void framebuf_set_screen_size(uint8_t ncols, uint8_t nrows);
 void framebuf_set_screen_inverted(bool invert);
+
+// switches between the normal and alternate screen (only the row map changes,
+// the normal screen's rows are parked in spare rows)
+void framebuf_set_alternate_screen(bool alt);
+bool framebuf_get_alternate_screen();
+
+// shows the screen scrolled back by the given number of lines into the scrollback
+// buffer (0 = current screen), returns the number of lines actually scrolled back
+uint16_t framebuf_set_scrollback_view(uint16_t lines);
+uint16_t framebuf_get_scrollback_view();
+
+// the cursor is drawn by the display by toggling the given character
+// attributes at the given position (attr==0 hides the cursor)
+void framebuf_set_cursor(uint8_t x, uint8_t y, uint8_t attr);
 void framebuf_flash_screen(uint8_t color, uint8_t nframes);
 
+// group changes so they are shown together, if tear-free updates are enabled
+// the changes become visible at the start of the next frame after framebuf_end_update()
+void framebuf_begin_update();
+void framebuf_end_update();
+
+// called by the display backends at the start of each frame
+void framebuf_new_frame();
+
+// render time statistics of the video core (only with VERSATERM_VIDEO_TIMING),
+// all times in clock cycles
+typedef struct
+{
+  uint32_t line_min, line_avg, line_max;    // render one scanline
+  uint32_t frame_min, frame_avg, frame_max; // render all scanlines of a frame
+  uint32_t line_budget;                     // time between two scanlines
+  uint32_t frames, underruns;               // frames measured, scanlines not ready in time
+} framebuf_timing_t;
+
+// returns false if the firmware was built without timing instrumentation
+bool framebuf_get_timing(framebuf_timing_t *t);
+void framebuf_reset_timing();
+
+#if VERSATERM_VIDEO_TIMING
+// called by the display backends on the video core
+void framebuf_timing_init(uint32_t line_budget);
+void framebuf_timing_line(uint32_t cycles);
+void framebuf_timing_underrun();
+#endif
+
 #endif
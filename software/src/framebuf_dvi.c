@@ -18,12 +18,16 @@
 // -----------------------------------------------------------------------------
 
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
 #include "hardware/irq.h"
 #include "hardware/vreg.h"
 #include "hardware/structs/bus_ctrl.h"
+#if VERSATERM_VIDEO_TIMING
+#include "hardware/structs/systick.h"
+#endif
 #include "dvi.h"
 #include "dvi_serialiser.h"
 #include "common_dvi_pin_configs.h"
@@ -34,9 +38,49 @@
 #include "framebuf_dvi.h"
 #include "font.h"
 #include "config.h"
-
+#include "hotfun.h"
+
+#if VERSATERM_VIDEO_TIMING
+// clock cycles spent encoding a scanline (SysTick counts down, 24 bits)
+#define LINE_TIMING_START() uint32_t line_t0 = systick_hw->cvr
+#define LINE_TIMING_END()   framebuf_timing_line((line_t0 - systick_hw->cvr) & 0xFFFFFF)
+#else
+#define LINE_TIMING_START()
+#define LINE_TIMING_END()
+#endif
+
+#if VERSATERM_DVI_WIDE
+// 295.2MHz system clock, a bit more core voltage than for 640x480 to be safe
+#define DVI_TIMING             dvi_timing_800x480p_60hz
+#define DVI_VREG_VOLTAGE       VREG_VOLTAGE_1_25
+#else
 #define DVI_TIMING             dvi_timing_640x480p_60hz
-#define COLOR_PLANE_SIZE_WORDS (MAX_ROWS * MAX_COLS * 4 / 32)
+#define DVI_VREG_VOLTAGE       VREG_VOLTAGE_1_20
+#endif
+
+// number of columns with 6 pixel wide characters, the 8 pixels left over
+// (4 at either side) are black
+#define NARROW_COLS            132
+
+// color planes have room for all physical rows (not just MAX_ROWS) since
+// framebuf.c may use the rows beyond MAX_ROWS as spare rows
+#define COLOR_PLANE_SIZE_WORDS (FRAMEBUF_ROWMAP_SIZE * MAX_COLS * 4 / 32)
+#define COLOR_ROW_WORDS        (MAX_COLS * 4 / 32)
+#define TMDS_PLANE_WORDS       (DVI_FRAME_WIDTH / DVI_SYMBOLS_PER_WORD)
+#define TMDS_LINE_WORDS        (3 * TMDS_PLANE_WORDS)
+
+// Number of encoded scanlines kept for lines that show only a single (background) 
+// color, e.g. empty rows or the blank top/bottom pixel rows of text rows.
+// Each one takes TMDS_LINE_WORDS*4 (3840 or 4800) bytes of RAM.
+#define LINE_CACHE_SIZE 4
+
+// character buffer entries are character | attributes << 8 in frame buffer
+// order (see ATTR_TO_FB) so the lower 10 bits select the glyph
+#define CHAR_GLYPH     0x03FF
+#define CHAR_BOLD      0x0100
+#define CHAR_BLINK     0x0400
+#define CHAR_UNDERLINE 0x0800
+#define CHAR_INVERSE   0x1000
 
 // defined in framebuf.c
 extern int16_t framebuf_flash_counter;
@@ -45,12 +89,65 @@ extern uint8_t framebuf_flash_color;
 struct dvi_inst dvi0;
 static uint16_t *charbuf  = NULL;
 static uint32_t *colorbuf = NULL;
-static uint8_t  *rowattr  = NULL;
+static uint16_t *rowinfo  = NULL;
+
+// per physical row: "dirty" is set by the writers below (core 0) after changing
+// the row and cleared by core 1 when it starts re-checking the row.
+// blank_valid/blank (one bit per font pixel row) record for which pixel rows
+// none of the characters in the row have foreground pixels, row_bg holds the
+// background color shared by all characters in the row (or 0xFF if they differ),
+// row_fg the same for the foreground color (a blank line shows it if the screen is inverted),
+// row_attrs has all (character buffer) attribute bits used in the row.
+static volatile bool row_dirty[FRAMEBUF_ROWMAP_SIZE];
+static uint32_t row_blank_valid[FRAMEBUF_ROWMAP_SIZE], row_blank[FRAMEBUF_ROWMAP_SIZE];
+static uint8_t  row_bg[FRAMEBUF_ROWMAP_SIZE], row_fg[FRAMEBUF_ROWMAP_SIZE], row_attrs[FRAMEBUF_ROWMAP_SIZE];
+
+// screen inversion (DECSCNM) is done while encoding, the frame buffer colors stay unchanged
+static volatile bool screen_inverted = false;
+
+// show 6 pixel wide characters (VERSATERM_DVI_WIDE only)
+static volatile bool narrow_chars = false;
+
+// cursor, applied while encoding: row info index of first row | number of rows << 8 |
+// column << 16 | attributes to toggle << 24 (no cursor if 0), set with a single store
+static volatile uint32_t cursor = 0;
+
+// copy of the row being displayed if it needs changes (inverted screen, cursor,
+// blinking or underlined characters), ul_colors has the colors for the
+// underline pixel row
+static uint16_t scratch_chars[MAX_COLS];
+static uint32_t scratch_colors[3 * COLOR_ROW_WORDS];
+static uint32_t ul_colors[3 * COLOR_ROW_WORDS];
+
+typedef struct
+{
+  uint32_t *buf;
+  uint8_t   color;
+  uint8_t   inflight;
+} LineCacheEntry;
+
+static LineCacheEntry line_cache[LINE_CACHE_SIZE];
+static uint8_t line_cache_size = 0, line_cache_next = 0;
+
+// TMDS buffers of the DVI buffer pool that are not circulating because a
+// cached line was queued in their place
+static uint32_t *spare_bufs[DVI_N_TMDS_BUFFERS];
+static uint8_t num_spare_bufs = 0;
+
+
+static inline void mark_dirty(uint32_t idx, size_t n)
+{
+  if( n>0 )
+    for(uint32_t row=idx/MAX_COLS; row<=(idx+n-1)/MAX_COLS; row++)
+      row_dirty[row] = true;
+}
 
 
 void framebuf_dvi_charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n)
 {
-  uint16_t v = c | (a<<8);
+  uint32_t idx0 = idx;
+  size_t n0 = n;
+  uint16_t v = c | (ATTR_TO_FB(a)<<8);
   for(size_t i=0; i<n; i++) charbuf[idx+i] = v;
 
   if( (idx&1)==1 ) { framebuf_dvi_set_color(idx, fg, bg); idx++; n--; }
@@ -65,6 +162,8 @@ void framebuf_dvi_charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uin
         fg >>= 2;
         bg >>= 2;
       }
+
+  mark_dirty(idx0, n0);
 }
 
 
@@ -96,6 +195,8 @@ void framebuf_dvi_charmemmove(uint32_t toidx, uint32_t fromidx, size_t n)
           framebuf_dvi_set_color(toidx+i, fg, bg);
         }
     }
+
+  mark_dirty(toidx, n);
 }
 
 
@@ -105,26 +206,28 @@ uint8_t framebuf_dvi_get_char(uint32_t idx)
 }
 
 
-void framebuf_dvi_set_char(uint32_t idx, uint8_t c)
+void HOTFUN(framebuf_dvi_set_char)(uint32_t idx, uint8_t c)
 {
   charbuf[idx] = (charbuf[idx] & 0xFF00) | c;
+  mark_dirty(idx, 1);
 }
 
 
-uint8_t framebuf_dvi_get_attr(uint32_t idx)
+uint8_t HOTFUN(framebuf_dvi_get_attr)(uint32_t idx)
 {
-  return charbuf[idx] / 256;
+  return ATTR_FROM_FB(charbuf[idx] / 256);
 }
 
-void framebuf_dvi_set_attr(uint32_t idx, uint8_t a)
+void HOTFUN(framebuf_dvi_set_attr)(uint32_t idx, uint8_t a)
 {
-  charbuf[idx] = (charbuf[idx] & 0x00FF) | (a<<8);
+  charbuf[idx] = (charbuf[idx] & 0x00FF) | (ATTR_TO_FB(a)<<8);
+  mark_dirty(idx, 1);
 }
 
 
 
 // Pixel format RGB222
-void framebuf_dvi_set_color(uint32_t char_index, uint8_t fg, uint8_t bg)
+void HOTFUN(framebuf_dvi_set_color)(uint32_t char_index, uint8_t fg, uint8_t bg)
 {
   uint bit_index  = char_index % 8 * 4;
   uint word_index = char_index / 8;
@@ -136,6 +239,8 @@ void framebuf_dvi_set_color(uint32_t char_index, uint8_t fg, uint8_t bg)
       bg >>= 2;
       word_index += COLOR_PLANE_SIZE_WORDS;
     }
+
+  mark_dirty(char_index, 1);
 }
 
 
@@ -156,9 +261,9 @@ void framebuf_dvi_get_color(uint32_t char_index, uint8_t *fg, uint8_t *bg)
 }
 
 
-void framebuf_dvi_set_char_and_attr(uint32_t idx, uint32_t c)
+void HOTFUN(framebuf_dvi_set_char_and_attr)(uint32_t idx, uint32_t c)
 {
-  charbuf[idx] = c & 0xFFFF;
+  charbuf[idx] = (c & 0xFF) | (ATTR_TO_FB((c >> 8) & 0xFF) << 8);
   framebuf_dvi_set_color(idx, c >> 24, c >> 16);
 }
 
@@ -167,7 +272,283 @@ uint32_t framebuf_dvi_get_char_and_attr(uint32_t idx)
 {
   uint8_t fg, bg;
   framebuf_dvi_get_color(idx, &fg, &bg);
-  return charbuf[idx] | (bg << 16) | (fg << 24);
+  uint16_t v = charbuf[idx];
+  return (v & 0xFF) | (ATTR_FROM_FB(v >> 8) << 8) | (bg << 16) | (fg << 24);
+}
+
+
+void framebuf_dvi_get_chars_and_attrs(uint32_t idx, uint32_t *buf, size_t n)
+{
+  for(size_t i=0; i<n; i++) buf[i] = framebuf_dvi_get_char_and_attr(idx+i);
+}
+
+
+#if VERSATERM_DVI_WIDE
+// 6 pixel wide characters: tmds_narrow_map narrows each 8 pixel font row by
+// merging columns 1+2 and 4+5 (column 7 usually is the blank spacing column),
+// tmds_narrow_lut holds the 3 TMDS words for each palette and narrowed font row
+uint8_t  tmds_narrow_map[256];
+uint32_t tmds_narrow_lut[16 * 64 * 4];
+
+static void init_narrow_tables()
+{
+  for(uint b = 0; b < 256; b++)
+    tmds_narrow_map[b] = (b & 1) | (((b >> 1) | (b >> 2)) & 1) << 1 | ((b >> 3) & 1) << 2 |
+      (((b >> 4) | (b >> 5)) & 1) << 3 | ((b >> 6) & 1) << 4 | ((b >> 7) & 1) << 5;
+
+  // each TMDS word of the 8 pixel table only depends on its own two pixels
+  for(uint pal = 0; pal < 16; pal++)
+    for(uint n = 0; n < 64; n++)
+      {
+        const uint32_t *lo = &palettised_1bpp_tables_sw[(pal * 16 + (n & 15)) * 2];
+        const uint32_t *hi = &palettised_1bpp_tables_sw[(pal * 16 + (n >> 4)) * 2];
+        uint32_t *e = &tmds_narrow_lut[(pal * 64 + n) * 4];
+        e[0] = lo[0]; e[1] = lo[1]; e[2] = hi[0]; e[3] = 0;
+      }
+}
+#endif
+
+
+static void __not_in_flash_func(encode_chars)(const uint16_t *chars, const uint32_t *colors, uint32_t *tmds, uint first, uint n,
+                                              const uint8_t *font_line, bool dbl_width, bool narrow)
+{
+  // encodes characters first..first+n-1 of a scanline for one color plane, same
+  // as the assembly encoders (each TMDS word of their tables only depends on its own pixels)
+  for(uint i = first; i < first+n; i++)
+    {
+      uint bits = font_line[chars[i] & CHAR_GLYPH];
+      uint pal  = (colors[i / 8] >> (i % 8 * 4)) & 0xF;
+      const uint32_t *e;
+#if VERSATERM_DVI_WIDE
+      if( narrow ) bits = tmds_narrow_map[bits];
+      if( narrow && !dbl_width )
+        {
+          e = &tmds_narrow_lut[(pal * 64 + bits) * 4];
+          *tmds++ = e[0]; *tmds++ = e[1]; *tmds++ = e[2];
+          continue;
+        }
+#endif
+      if( dbl_width )
+        {
+          e = &palettised_1bpp_tables_dw[(pal * 16 + (bits & 15)) * 4];
+          *tmds++ = e[0]; *tmds++ = e[1]; *tmds++ = e[2]; *tmds++ = e[3];
+          e = &palettised_1bpp_tables_dw[(pal * 16 + (bits >> 4)) * 4];
+          *tmds++ = e[0]; *tmds++ = e[1];
+          if( !narrow ) { *tmds++ = e[2]; *tmds++ = e[3]; }
+        }
+      else
+        {
+          e = &palettised_1bpp_tables_sw[(pal * 16 + (bits & 15)) * 2];
+          *tmds++ = e[0]; *tmds++ = e[1];
+          e = &palettised_1bpp_tables_sw[(pal * 16 + (bits >> 4)) * 2];
+          *tmds++ = e[0]; *tmds++ = e[1];
+        }
+    }
+}
+
+
+static void __not_in_flash_func(encode_plane)(const uint16_t *chars, const uint32_t *colors, uint32_t *tmds,
+                                              const uint8_t *font_line, bool dbl_width, bool narrow)
+{
+  // encodes a scanline for one color plane, the assembly encoders work on blocks
+  // of 8 characters so characters after the last full block are done by encode_chars()
+  uint char_width = (narrow ? 6 : FONT_CHAR_WIDTH) * (dbl_width ? 2 : 1);
+  uint nchars = DVI_FRAME_WIDTH / char_width, nblk = 0;
+#if VERSATERM_DVI_WIDE
+  if( narrow )
+    {
+      tmds[0] = tmds[1] = tmds[TMDS_PLANE_WORDS-2] = tmds[TMDS_PLANE_WORDS-1] = palettised_1bpp_tables_sw[0];
+      tmds += 2;
+      nchars = dbl_width ? NARROW_COLS/2 : NARROW_COLS;
+
+      // no assembly encoder for double width 6 pixel characters, with half
+      // as many characters per line encode_chars() is fast enough
+      if( !dbl_width )
+        {
+          nblk = nchars & ~7;
+          tmds_encode_font_2bpp_nw(chars, colors, tmds, nblk * char_width, font_line);
+        }
+    }
+  else
+#endif
+    {
+      nblk = nchars & ~7;
+      if( dbl_width )
+        tmds_encode_font_2bpp_dw(chars, colors, tmds, nblk * char_width, font_line);
+      else
+        tmds_encode_font_2bpp_sw(chars, colors, tmds, nblk * char_width, font_line);
+    }
+
+  if( nblk < nchars )
+    encode_chars(chars, colors, tmds + nblk * char_width / DVI_SYMBOLS_PER_WORD, nblk, nchars - nblk, font_line, dbl_width, narrow);
+}
+
+
+static void __not_in_flash_func(check_row)(uint row)
+{
+  // updates the information kept for the given (physical) row if it has changed
+  if( row_dirty[row] )
+    {
+      // clear the flag before looking at the data so changes made
+      // while we are checking will mark the row dirty again
+      row_dirty[row] = false;
+      row_blank_valid[row] = 0;
+
+      bool bg_mixed = false, fg_mixed = false;
+      uint8_t bg = 0, fg = 0;
+      uint32_t plane_words = COLOR_PLANE_SIZE_WORDS;
+      const uint32_t *cb = colorbuf + row * COLOR_ROW_WORDS;
+      for(int plane = 0; plane < 3 && !(bg_mixed && fg_mixed); ++plane)
+        {
+          // the 2-bit foreground/background color of each character is in bits 0-1/2-3 of its nibble
+          const uint32_t *p = cb + plane * plane_words;
+          uint32_t b = p[0] & 0xCCCCCCCC, f = p[0] & 0x33333333;
+          bg_mixed |= b != ((b & 0xC) * 0x11111111);
+          fg_mixed |= f != ((f & 0x3) * 0x11111111);
+          for(uint i = 1; i < COLOR_ROW_WORDS && !(bg_mixed && fg_mixed); i++)
+            {
+              bg_mixed |= (p[i] & 0xCCCCCCCC) != b;
+              fg_mixed |= (p[i] & 0x33333333) != f;
+            }
+          bg |= ((b >> 2) & 3) << (2*plane);
+          fg |= (f & 3) << (2*plane);
+        }
+
+      row_bg[row] = bg_mixed ? 0xFF : bg;
+      row_fg[row] = fg_mixed ? 0xFF : fg;
+
+      const uint16_t *chars = charbuf + row * MAX_COLS;
+      uint16_t attrs = 0;
+      for(uint i = 0; i < MAX_COLS; i++) attrs |= chars[i];
+      row_attrs[row] = attrs >> 8;
+    }
+}
+
+
+static int __not_in_flash_func(get_solid_line_color)(uint row, uint glyph_row, const uint8_t *font, bool inverted)
+{
+  // returns the color if all pixels of the given pixel row of the given
+  // (physical) character row show the same color, -1 otherwise
+  uint8_t color = inverted ? row_fg[row] : row_bg[row];
+  if( color==0xFF )
+    return -1;
+
+  uint32_t bit = 1u << glyph_row;
+  if( !(row_blank_valid[row] & bit) )
+    {
+      // check whether any character in the row has foreground pixels in this pixel row
+      const uint16_t *chars = charbuf + row * MAX_COLS;
+      const uint8_t  *bits  = font + glyph_row * 256 * 4;
+      uint i;
+      for(i = 0; i < MAX_COLS; i++)
+        if( bits[chars[i] & CHAR_GLYPH] ) break;
+
+      if( i==MAX_COLS )
+        row_blank[row] |= bit;
+      else
+        row_blank[row] &= ~bit;
+      row_blank_valid[row] |= bit;
+    }
+
+  return (row_blank[row] & bit) ? color : -1;
+}
+
+
+static uint32_t *__not_in_flash_func(get_solid_line)(uint8_t color, const uint8_t *font, bool narrow)
+{
+  // returns a TMDS scanline of the given solid color from the cache
+  // (encoding it if necessary) or NULL if no cache entry is available
+  for(int i = 0; i < line_cache_size; i++)
+    if( line_cache[i].color==color && line_cache[i].buf!=NULL )
+      return line_cache[i].buf;
+
+  // find an entry to replace that is not currently queued for output
+  for(int n = 0; n < line_cache_size; n++)
+    {
+      LineCacheEntry *e = &line_cache[line_cache_next];
+      line_cache_next = (line_cache_next+1) % line_cache_size;
+      if( e->inflight==0 )
+        {
+          // foreground and background are the same so the characters don't matter
+          static uint32_t solid[COLOR_ROW_WORDS];
+          for(int plane = 0; plane < 3; ++plane) 
+            {
+              uint8_t c = (color >> (2*plane)) & 3;
+              memset(solid, c | (c<<2) | (c<<4) | (c<<6), sizeof(solid));
+              encode_plane(charbuf, solid, e->buf + plane * TMDS_PLANE_WORDS, font, false, narrow);
+            }
+
+          e->color = color;
+          return e->buf;
+        }
+    }
+
+  return NULL;
+}
+
+
+static void __not_in_flash_func(make_scratch_row)(uint row, bool inverted, bool blink_on, int cursor_col, uint8_t cursor_attr)
+{
+  // set up scratch_chars and scratch_colors to show the given physical row with
+  // inverted colors, the cursor (if cursor_col>=0) and blinking characters
+  // in their "on" phase (shown with foreground and background swapped)
+  memcpy(scratch_chars, charbuf + row * MAX_COLS, sizeof(scratch_chars));
+  if( cursor_col>=0 ) scratch_chars[cursor_col] ^= (cursor_attr << 8) & ~CHAR_INVERSE;
+
+  uint32_t swap[COLOR_ROW_WORDS];
+  for(uint i = 0; i < COLOR_ROW_WORDS; i++)
+    {
+      uint32_t m = 0;
+      if( blink_on )
+        for(uint j = 0; j < 8; j++)
+          if( scratch_chars[i * 8 + j] & CHAR_BLINK ) m |= 0xFu << (j * 4);
+      swap[i] = inverted ? ~m : m;
+    }
+
+  for(int plane = 0; plane < 3; ++plane)
+    for(uint i = 0; i < COLOR_ROW_WORDS; i++)
+      {
+        // swap foreground (bits 0-1) and background (bits 2-3) of the selected color nibbles
+        uint32_t w = colorbuf[row * COLOR_ROW_WORDS + plane * COLOR_PLANE_SIZE_WORDS + i];
+        uint32_t s = ((w & 0x33333333) << 2) | ((w >> 2) & 0x33333333);
+        scratch_colors[plane * COLOR_ROW_WORDS + i] = (w & ~swap[i]) | (s & swap[i]);
+      }
+
+  if( cursor_col>=0 )
+    {
+      if( (cursor_attr << 8) & CHAR_INVERSE )
+        for(int plane = 0; plane < 3; ++plane)
+          {
+            uint32_t *w = &scratch_colors[plane * COLOR_ROW_WORDS + cursor_col / 8];
+            uint bit_index = cursor_col % 8 * 4;
+            uint32_t n = (*w >> bit_index) & 0xF;
+            *w = (*w & ~(0xFu << bit_index)) | ((((n & 3) << 2) | (n >> 2)) << bit_index);
+          }
+    }
+}
+
+
+static void __not_in_flash_func(make_underline_colors)(uint glyph_row, uint8_t ul_row, uint8_t ul_row_bold)
+{
+  // set up ul_colors from the scratch row, underlined characters show their
+  // foreground color on all pixels of their font's underline row
+  for(uint i = 0; i < COLOR_ROW_WORDS; i++)
+    {
+      uint32_t m = 0;
+      for(uint j = 0; j < 8; j++)
+        {
+          uint16_t c = scratch_chars[i * 8 + j];
+          if( (c & CHAR_UNDERLINE) && glyph_row==((c & CHAR_BOLD) ? ul_row_bold : ul_row) )
+            m |= 0xFu << (j * 4);
+        }
+
+      for(int plane = 0; plane < 3; ++plane)
+        {
+          uint32_t w = scratch_colors[plane * COLOR_ROW_WORDS + i];
+          uint32_t f = w & 0x33333333;
+          ul_colors[plane * COLOR_ROW_WORDS + i] = (w & ~m) | ((f | (f << 2)) & m);
+        }
+    }
 }
 
 
@@ -177,13 +558,25 @@ void __not_in_flash_func(core1_main)()
   dvi_register_irqs_this_core(&dvi0, DMA_IRQ_0);
   dvi_start(&dvi0);
 
+#if VERSATERM_VIDEO_TIMING
+  // free running SysTick on this core, the system clock is the TMDS bit clock (10 per pixel)
+  systick_hw->rvr = 0xFFFFFF;
+  systick_hw->cvr = 0;
+  systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+  framebuf_timing_init(10 * (DVI_TIMING.h_front_porch + DVI_TIMING.h_sync_width + DVI_TIMING.h_back_porch + DVI_TIMING.h_active_pixels));
+#endif
+
   uint8_t frameCtr = 0;
-  const uint8_t* font = font_get_data_blinkon();
+  bool blink_on = true, prevBlinkOn = false;
+  uint8_t prevCharHeight = 0;
+  bool prevNarrow = false;
   static uint32_t solidcolor[MAX_COLS * 4 / 32];
   memset(solidcolor, 0, sizeof(solidcolor));
 
   while( true )
     {
+      framebuf_new_frame();
+
       if( framebuf_flash_counter<0 )
         {
           framebuf_flash_counter = -framebuf_flash_counter;
@@ -196,77 +589,184 @@ void __not_in_flash_func(core1_main)()
         }
       else if( ++frameCtr>=config_get_screen_blink_period()/2 )
         {
-          if( font == font_get_data_blinkon() )
-            font = font_get_data_blinkoff();
-          else
-            font = font_get_data_blinkon();
-          
+          blink_on = !blink_on;
           frameCtr = 0;
         }
       
+      const uint8_t *font                = font_get_data();
+      uint8_t  ul_row                    = font_get_underline_row(false);
+      uint8_t  ul_row_bold               = font_get_underline_row(true);
       uint8_t  char_height               = font_get_char_height();
       uint32_t color_plane_size_words    = COLOR_PLANE_SIZE_WORDS;
-      uint32_t color_plane_words_per_row = COLOR_PLANE_SIZE_WORDS / MAX_ROWS;
+      uint32_t color_plane_words_per_row = COLOR_ROW_WORDS;
       uint32_t num_y                     = font_get_char_height()*MAX_ROWS;
+      bool     inverted                  = screen_inverted;
+      bool     narrow                    = narrow_chars;
+      uint32_t cur                       = cursor;
+      uint8_t  cursor_attr               = cur >> 24;
+      int      scratch_row               = -1;
+
+      if( blink_on!=prevBlinkOn || char_height!=prevCharHeight )
+        {
+          // blank pixel rows depend on the font data, re-check them
+          // regularly in case a different font was loaded
+          for(int i = 0; i < FRAMEBUF_ROWMAP_SIZE; i++) row_blank_valid[i] = 0;
+          prevBlinkOn = blink_on;
+          prevCharHeight = char_height;
+        }
+
+      if( narrow!=prevNarrow )
+        {
+          // cached lines were encoded for the other character width
+          for(int i = 0; i < line_cache_size; i++) line_cache[i].color = 0xFF;
+          prevNarrow = narrow;
+        }
         
       for(uint y = 0; y < FRAME_HEIGHT; ++y)
         {
           queue_remove_blocking(&dvi0.q_tmds_free, &tmdsbuf);
+#if VERSATERM_VIDEO_TIMING
+          // the DMA is already sending the last queued line
+          if( y>0 && queue_is_empty(&dvi0.q_tmds_valid) ) framebuf_timing_underrun();
+#endif
+          LINE_TIMING_START();
+
+          // if the returned buffer is a cached line then continue with one
+          // of the pool buffers that was held back when the line was queued
+          for(int i = 0; i < line_cache_size; i++)
+            if( tmdsbuf==line_cache[i].buf )
+              {
+                line_cache[i].inflight--;
+                tmdsbuf = spare_bufs[--num_spare_bufs];
+                break;
+              }
+
+          uint     text_row = y / char_height;
+          uint16_t ri  = rowinfo[text_row];
+          uint row     = ROW_INFO_PHYS(ri);
+          uint8_t attr = ROW_INFO_ATTR(ri);
+          uint glyph_row;
+
+          if( attr & ROW_ATTR_DBL_HEIGHT_TOP )
+            glyph_row = (y % char_height)/2;
+          else if( attr & ROW_ATTR_DBL_HEIGHT_BOT )
+            glyph_row = ((y % char_height)+char_height)/2;
+          else
+            glyph_row = y % char_height;
 
-          uint row = y / char_height;
-          
-          void (*tmds_encode_font_2bpp)(const uint16_t *, const uint32_t *, uint32_t *, uint, const uint8_t *) = 
-            (rowattr[row] & ROW_ATTR_DBL_WIDTH) ? tmds_encode_font_2bpp_dw : tmds_encode_font_2bpp_sw;
+          bool cursor_line = cursor_attr!=0 && text_row-(cur & 0xFF) < ((cur >> 8) & 0xFF);
 
-          if( rowattr[row] & ROW_ATTR_DBL_HEIGHT_TOP )
+          // blinking characters in their "on" phase and underlined characters
+          // on their underline pixel row are shown by changing their colors
+          bool blink_row = false, ul_line = false;
+          if( y<num_y )
             {
-              for(int plane = 0; plane < 3; ++plane) 
-                tmds_encode_font_2bpp((const uint16_t*)&charbuf[row * MAX_COLS],
-                                      (y<num_y&&framebuf_flash_counter==0) ? &colorbuf[row * color_plane_words_per_row + plane * color_plane_size_words] : solidcolor,
-                                      tmdsbuf + plane * (FRAME_WIDTH / DVI_SYMBOLS_PER_WORD),
-                                      FRAME_WIDTH,
-                                      (const uint8_t*)&font[(y % char_height)/2 * 256 * 8]);
+              check_row(row);
+              uint16_t a = (row_attrs[row] | (cursor_line ? cursor_attr : 0)) << 8;
+              blink_row = blink_on && (a & CHAR_BLINK);
+              ul_line   = (a & CHAR_UNDERLINE) && (glyph_row==ul_row || glyph_row==ul_row_bold);
             }
-          else if( rowattr[row] & ROW_ATTR_DBL_HEIGHT_BOT )
+
+          if( framebuf_flash_counter==0 && line_cache_size>0 && !cursor_line && !blink_row && !ul_line )
             {
-              for(int plane = 0; plane < 3; ++plane) 
-                tmds_encode_font_2bpp((const uint16_t*)&charbuf[row * MAX_COLS],
-                                      (y<num_y&&framebuf_flash_counter==0) ? &colorbuf[row * color_plane_words_per_row + plane * color_plane_size_words] : solidcolor,
-                                      tmdsbuf + plane * (FRAME_WIDTH / DVI_SYMBOLS_PER_WORD),
-                                      FRAME_WIDTH,
-                                      (const uint8_t*)&font[(((y % char_height)+char_height))/2 * 256 * 8]);
+              // lines showing only one color are queued directly from the cache
+              int color = y<num_y ? get_solid_line_color(row, glyph_row, font, inverted) : 0;
+              uint32_t *line = color>=0 ? get_solid_line(color, font, narrow) : NULL;
+              if( line!=NULL )
+                {
+                  for(int i = 0; i < line_cache_size; i++)
+                    if( line==line_cache[i].buf ) { line_cache[i].inflight++; break; }
+
+                  spare_bufs[num_spare_bufs++] = tmdsbuf;
+                  LINE_TIMING_END();
+                  queue_add_blocking(&dvi0.q_tmds_valid, &line);
+                  continue;
+                }
             }
-          else
+          
+          const uint16_t *chars  = &charbuf[row * MAX_COLS];
+          const uint32_t *colors = &colorbuf[row * color_plane_words_per_row];
+          uint32_t plane_words   = color_plane_size_words;
+          if( (inverted || cursor_line || blink_row || ul_line) && y<num_y )
             {
-              for(int plane = 0; plane < 3; ++plane) 
-                tmds_encode_font_2bpp((const uint16_t*)&charbuf[row * MAX_COLS],
-                                      (y<num_y&&framebuf_flash_counter==0) ? &colorbuf[row * color_plane_words_per_row + plane * color_plane_size_words] : solidcolor,
-                                      tmdsbuf + plane * (FRAME_WIDTH / DVI_SYMBOLS_PER_WORD),
-                                      FRAME_WIDTH,
-                                      (const uint8_t*)&font[(y % char_height) * 256 * 8]);
+              // the scratch row is set up once per text row and frame
+              if( text_row!=scratch_row )
+                {
+                  make_scratch_row(row, inverted, blink_on, cursor_line ? (int) ((cur >> 16) & 0xFF) : -1, cursor_attr);
+                  scratch_row = text_row;
+                }
+
+              if( ul_line ) make_underline_colors(glyph_row, ul_row, ul_row_bold);
+              colors      = ul_line ? ul_colors : scratch_colors;
+              plane_words = COLOR_ROW_WORDS;
+              chars       = scratch_chars;
             }
+
+          for(int plane = 0; plane < 3; ++plane) 
+            encode_plane(chars,
+                         (y>=num_y||framebuf_flash_counter!=0) ? solidcolor : &colors[plane * plane_words],
+                         tmdsbuf + plane * TMDS_PLANE_WORDS,
+                         (const uint8_t*)&font[glyph_row * 256 * 4],
+                         (attr & ROW_ATTR_DBL_WIDTH)!=0, narrow);
           
+          LINE_TIMING_END();
           queue_add_blocking(&dvi0.q_tmds_valid, &tmdsbuf);
         }
     }
 }
 
 
-void framebuf_dvi_init(uint8_t *databuf, uint8_t *ra)
+void __not_in_flash_func(framebuf_dvi_set_inverted)(bool invert)
+{
+  screen_inverted = invert;
+}
+
+
+void __not_in_flash_func(framebuf_dvi_set_cursor)(uint8_t row, uint8_t nrows, uint8_t col, uint8_t attr)
+{
+  cursor = row | (nrows << 8) | (col << 16) | (ATTR_TO_FB(attr) << 24);
+}
+
+
+uint8_t framebuf_dvi_set_columns(uint8_t ncols)
+{
+#if VERSATERM_DVI_WIDE
+  // more columns than fit with 8 pixel wide characters need the 6 pixel wide ones
+  narrow_chars = ncols > DVI_FRAME_WIDTH / FONT_CHAR_WIDTH;
+  return narrow_chars ? NARROW_COLS : DVI_FRAME_WIDTH / FONT_CHAR_WIDTH;
+#else
+  return MAX_COLS;
+#endif
+}
+
+
+void framebuf_dvi_init(uint8_t *databuf, uint16_t *ri)
 {
-  vreg_set_voltage(VREG_VOLTAGE_1_20);
+  vreg_set_voltage(DVI_VREG_VOLTAGE);
   sleep_ms(10);
   // Run system at TMDS bit clock
   set_sys_clock_khz(DVI_TIMING.bit_clk_khz, true);
 
   charbuf  = (uint16_t *) databuf;
-  colorbuf = (uint32_t *) (databuf + 60 * 80 * 2);
-  rowattr  = ra;
+  colorbuf = (uint32_t *) (databuf + FRAMEBUF_ROWMAP_SIZE * MAX_COLS * 2);
+  rowinfo  = ri;
 
   dvi0.timing  = &DVI_TIMING;
   dvi0.ser_cfg = DVI_DEFAULT_SERIAL_CONFIG;
   dvi_init(&dvi0, next_striped_spin_lock_num(), next_striped_spin_lock_num());
 
+  for(int i=0; i<FRAMEBUF_ROWMAP_SIZE; i++) row_dirty[i] = true;
+#if VERSATERM_DVI_WIDE
+  init_narrow_tables();
+#endif
+  for(line_cache_size=0; line_cache_size<LINE_CACHE_SIZE; line_cache_size++)
+    {
+      line_cache[line_cache_size].buf = (uint32_t *) malloc(TMDS_LINE_WORDS * sizeof(uint32_t));
+      if( line_cache[line_cache_size].buf==NULL ) break;
+      line_cache[line_cache_size].color    = 0xFF;
+      line_cache[line_cache_size].inflight = 0;
+    }
+
   hw_set_bits(&bus_ctrl_hw->priority, BUSCTRL_BUS_PRIORITY_PROC1_BITS);
   multicore_launch_core1(core1_main);
 }
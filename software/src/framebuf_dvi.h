@@ -20,7 +20,7 @@
 #ifndef FRAMEBUF_DVI_H
 #define FRAMEBUF_DVI_H
 
-void framebuf_dvi_init(uint8_t *databuf, uint8_t *rowattr);
+void framebuf_dvi_init(uint8_t *databuf, uint16_t *rowinfo);
 
 void framebuf_dvi_charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n);
 void framebuf_dvi_charmemmove(uint32_t toidx, uint32_t fromidx, size_t n);
@@ -37,6 +37,18 @@ void framebuf_dvi_get_color(uint32_t char_index, uint8_t *fg, uint8_t *bg);
 
 void framebuf_dvi_set_char_and_attr(uint32_t idx, uint32_t c);
 uint32_t framebuf_dvi_get_char_and_attr(uint32_t idx);
+void framebuf_dvi_get_chars_and_attrs(uint32_t idx, uint32_t *buf, size_t n);
+
+// swap foreground and background colors of all characters when displaying
+void framebuf_dvi_set_inverted(bool invert);
+
+// show the cursor at the given column of nrows rows starting at the given row info
+// index by toggling the given character attributes there (attr==0 hides the cursor)
+void framebuf_dvi_set_cursor(uint8_t row, uint8_t nrows, uint8_t col, uint8_t attr);
+
+// set up the display for (at least) ncols columns if possible, returns
+// the number of columns the display shows
+uint8_t framebuf_dvi_set_columns(uint8_t ncols);
 
 void framebuf_dvi_flash_screen(uint8_t color, uint8_t nframes);
 
@@ -25,11 +25,21 @@ extern "C"
 #include "framebuf.h"
 #include "font.h"
 #include "config.h"
+#include "hotfun.h"
 }
 
+#if VERSATERM_VGA_WIDE
+#include "hardware/vreg.h"
+#endif
+
 
 static uint8_t *charbuf = NULL;
 static sSegm*   textSeg = NULL;
+static uint8_t  textForm = GF_CTEXT;
+static volatile uint32_t cursor = 0;
+#if VERSATERM_VIDEO_TIMING
+static uint32_t line_budget = 0;
+#endif
 
 // defined in framebuf.c
 extern int16_t framebuf_flash_counter;
@@ -38,7 +48,7 @@ extern uint8_t framebuf_flash_color;
 
 void framebuf_vga_charmemset(uint32_t idx, uint8_t c, uint8_t a, uint8_t fg, uint8_t bg, size_t n)
 {
-  uint32_t w = c + (a<<8) + (bg << 16) + (fg << 24);
+  uint32_t w = c + (ATTR_TO_FB(a)<<8) + (bg << 16) + (fg << 24);
   uint32_t *buf = (uint32_t *) (charbuf + idx*4);
   for(size_t i=0; i<n; i++) buf[i] = w;
 }
@@ -50,7 +60,7 @@ void framebuf_vga_charmemmove(uint32_t toidx, uint32_t fromidx, size_t n)
 }
 
 
-void framebuf_vga_set_char(uint32_t idx, uint8_t c)
+void HOTFUN(framebuf_vga_set_char)(uint32_t idx, uint8_t c)
 {
   charbuf[idx*4] = c;
 }
@@ -62,19 +72,19 @@ uint8_t framebuf_vga_get_char(uint32_t idx)
 }
 
 
-void framebuf_vga_set_attr(uint32_t idx, uint8_t a)
+void HOTFUN(framebuf_vga_set_attr)(uint32_t idx, uint8_t a)
 {
-  charbuf[idx*4+1] = a;
+  charbuf[idx*4+1] = ATTR_TO_FB(a);
 }
 
 
-uint8_t framebuf_vga_get_attr(uint32_t idx)
+uint8_t HOTFUN(framebuf_vga_get_attr)(uint32_t idx)
 {
-  return charbuf[idx*4 + 1];
+  return ATTR_FROM_FB(charbuf[idx*4 + 1]);
 }
 
 
-void framebuf_vga_set_color(uint32_t idx, uint8_t fg, uint8_t bg)
+void HOTFUN(framebuf_vga_set_color)(uint32_t idx, uint8_t fg, uint8_t bg)
 {
   charbuf[idx*4 + 2] = bg;
   charbuf[idx*4 + 3] = fg;
@@ -88,22 +98,72 @@ void framebuf_vga_get_color(uint32_t idx, uint8_t *fg, uint8_t *bg)
 }
 
 
-void framebuf_vga_set_char_and_attr(uint32_t idx, uint32_t c)
+void HOTFUN(framebuf_vga_set_char_and_attr)(uint32_t idx, uint32_t c)
 {
-  ((uint32_t *) charbuf)[idx] = c;
+  ((uint32_t *) charbuf)[idx] = (c & 0xFFFF00FF) | (ATTR_TO_FB((c >> 8) & 0xFF) << 8);
 }
 
 
 uint32_t framebuf_vga_get_char_and_attr(uint32_t idx)
 {
-  return ((uint32_t *) charbuf)[idx];
+  uint32_t c = ((uint32_t *) charbuf)[idx];
+  return (c & 0xFFFF00FF) | (ATTR_FROM_FB((c >> 8) & 0xFF) << 8);
+}
+
+
+void framebuf_vga_get_chars_and_attrs(uint32_t idx, uint32_t *buf, size_t n)
+{
+  for(size_t i=0; i<n; i++) buf[i] = framebuf_vga_get_char_and_attr(idx+i);
+}
+
+
+void __not_in_flash_func(framebuf_vga_set_inverted)(bool invert)
+{
+  // the text renderer picks up the pixel mask tables at the start of each line
+  RenderCTextMask   = invert ? RenderTextMaskInv   : RenderTextMask;
+  RenderCTextMaskDW = invert ? RenderTextMaskDWInv : RenderTextMaskDW;
+}
+
+
+void __not_in_flash_func(framebuf_vga_set_cursor)(uint8_t row, uint8_t nrows, uint8_t col, uint8_t attr)
+{
+  // handed to the text renderer at the start of the next frame
+  cursor = row | (nrows << 8) | (col << 16) | (ATTR_TO_FB(attr) << 24);
+}
+
+
+uint8_t framebuf_vga_set_columns(uint8_t ncols)
+{
+#if VERSATERM_VGA_WIDE
+  // more columns than fit with 8 pixel wide characters need the 6 pixel wide ones
+  textForm = ncols > VGA_FRAME_WIDTH / FONT_CHAR_WIDTH ? GF_CTEXT6 : GF_CTEXT;
+  if( textSeg!=NULL && textSeg->form!=GF_COLOR ) textSeg->form = textForm;
+  return textForm==GF_CTEXT6 ? 132 : VGA_FRAME_WIDTH / FONT_CHAR_WIDTH;
+#else
+  return FRAME_WIDTH / FONT_CHAR_WIDTH;
+#endif
+}
+
+
+#if VERSATERM_VIDEO_TIMING
+static void __not_in_flash_func(framebuf_vga_line_time)(u32 cycles)
+{
+  framebuf_timing_line(cycles);
+
+  // the next scanline is rendered while the current one is sent
+  if( cycles>line_budget ) framebuf_timing_underrun();
 }
+#endif
 
 
 static void framebuf_vga_new_frame()
 {
   static uint32_t par, par2;
   static int frameCtr = 0;
+  static bool blink_on = true;
+
+  framebuf_new_frame();
+  CTextCursor = cursor;
 
   if( framebuf_flash_counter<0 )
     {
@@ -118,26 +178,27 @@ static void framebuf_vga_new_frame()
     {
       if( --framebuf_flash_counter == 0 )
         {          
-          textSeg->form = GF_CTEXT;
+          textSeg->form = textForm;
           textSeg->par  = par;
           textSeg->par2 = par2;
         }
     }
   else if( ++frameCtr>=config_get_screen_blink_period()/2 )
     {
-      if( textSeg->par == (uint32_t) font_get_data_blinkon() )
-        textSeg->par = (uint32_t) font_get_data_blinkoff();
-      else
-        textSeg->par  = (uint32_t) font_get_data_blinkon();
-      
+      blink_on = !blink_on;
       frameCtr = 0;
     }
+
+  // underline rows and blink phase for the text renderer
+  uint8_t ul_row = font_get_underline_row(false), ul_row_bold = font_get_underline_row(true);
+  for(int i=0; i<16; i++)
+    CTextFontAttr[i] = (i==ul_row ? 0x0001 : 0) | (i==ul_row_bold ? 0x0100 : 0) | (blink_on ? 0xFF0000 : 0);
   
   textSeg->par3 = font_get_char_height();
 }
 
 
-void framebuf_vga_init(uint8_t *databuf, uint8_t *rowattr)
+void framebuf_vga_init(uint8_t *databuf, uint16_t *rowinfo)
 {
   charbuf = databuf;
   
@@ -146,20 +207,38 @@ void framebuf_vga_init(uint8_t *databuf, uint8_t *rowattr)
   
   // setup videomode
   VgaCfgDef(&Cfg);           // get default configuration
+#if VERSATERM_VGA_WIDE
+  // 800x480 centered in 800x600 timing, 6 clock cycles per pixel (240MHz) leave
+  // the 132 column renderer (about 4850 cycles, estimated from its instruction
+  // cycle counts) enough of the 6336 cycle scanline
+  Cfg.video = &VideoSVGA;    // video timings
+  Cfg.freq = 240000;         // system clock
+#else
   Cfg.video = &VideoVGA;     // video timings
-  Cfg.width = FRAME_WIDTH;   // screen width
+#endif
+  Cfg.width = VGA_FRAME_WIDTH; // screen width
   Cfg.height = FRAME_HEIGHT; // screen height
   VgaCfg(&Cfg, &Vmode);      // calculate videomode setup
   
   // initialize base layer 0
   ScreenClear(pScreen);
   sStrip* t = ScreenAddStrip(pScreen, FRAME_HEIGHT);
-  textSeg = ScreenAddSegm(t, FRAME_WIDTH);
-  ScreenSegmCText(textSeg, charbuf, font_get_data_blinkon(), font_get_char_height(), MAX_COLS*4);
-  textSeg->par2 = (uint32_t) rowattr;
+  textSeg = ScreenAddSegm(t, VGA_FRAME_WIDTH);
+  ScreenSegmCText(textSeg, charbuf, font_get_data(), font_get_char_height(), MAX_COLS*4);
+  textSeg->par2 = (uint32_t) rowinfo;
+  textSeg->form = textForm;
   VgaSetNewFrameCallback(framebuf_vga_new_frame);
+#if VERSATERM_VIDEO_TIMING
+  line_budget = Vmode.htot * Vmode.div;
+  framebuf_timing_init(line_budget);
+  VgaSetLineTimeCallback(framebuf_vga_line_time);
+#endif
   
   // initialize system clock
+#if VERSATERM_VGA_WIDE
+  vreg_set_voltage(VREG_VOLTAGE_1_20);
+  sleep_ms(10);
+#endif
   set_sys_clock_pll(Vmode.vco*1000, Vmode.pd1, Vmode.pd2);
   
   // initialize videomode
@@ -0,0 +1,36 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#ifndef HOTFUN_H
+#define HOTFUN_H
+
+#include "pico/stdlib.h"
+
+// Functions on the per-character receive/display path are defined as
+// HOTFUN(name). With VERSATERM_HOT_IN_RAM (CMake option, on by default) they
+// go into the SDK's ".time_critical" sections which the default linker
+// script copies to SRAM at startup, so they never wait for XIP cache misses.
+// The list of functions comes from host/hotfuns.sh (see ReadMe.md).
+#if VERSATERM_HOT_IN_RAM
+#define HOTFUN(name) __not_in_flash_func(name)
+#else
+#define HOTFUN(name) name
+#endif
+
+#endif
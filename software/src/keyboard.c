@@ -23,6 +23,8 @@
 #include "config.h"
 #include "flash.h"
 #include "sound.h"
+#include "stats.h"
+#include "hotfun.h"
 #include "pico/util/queue.h"
 #include "pico/time.h"
 #include <ctype.h>
@@ -512,6 +514,16 @@ static void INFLASHFUN process_led_keys(uint8_t key, uint8_t modifier)
 }
 
 
+static void INFLASHFUN keyboard_queue_add(uint8_t key, uint8_t modifier)
+{
+  // key and modifier are always queued together, the queue has room for both or neither
+  if( queue_try_add(&keyboard_queue, &key) )
+    queue_try_add(&keyboard_queue, &modifier);
+  else
+    stats_add(STAT_KEY_DROPPED, 1);
+}
+
+
 static void INFLASHFUN keyboard_add_keypress(uint8_t key, uint8_t modifier)
 {
   //print("(%02X%02X-%s)", modifier, key, keyboard_get_keyname(modifier<<8 | key));
@@ -529,8 +541,7 @@ static void INFLASHFUN keyboard_add_keypress(uint8_t key, uint8_t modifier)
         sound_play_tone(880, 50, config_get_audible_bell_volume(), false);
 
       process_led_keys(key,modifier);
-      queue_try_add(&keyboard_queue, &key); 
-      queue_try_add(&keyboard_queue, &modifier); 
+      keyboard_queue_add(key, modifier);
     }
   else if( macro_status==MACRO_NONE && !config_menu_active() && keyboard_find_macro(MACRO_EXTKEY(key, modifier)) )
     {
@@ -540,8 +551,7 @@ static void INFLASHFUN keyboard_add_keypress(uint8_t key, uint8_t modifier)
   else
     {
       process_led_keys(key,modifier);
-      queue_try_add(&keyboard_queue, &key); 
-      queue_try_add(&keyboard_queue, &modifier); 
+      keyboard_queue_add(key, modifier);
     }
 }
 
@@ -738,7 +748,7 @@ bool keyboard_shift_pressed(uint16_t key)
 }
 
 
-uint8_t INFLASHFUN keyboard_get_led_status()
+uint8_t HOTFUN(keyboard_get_led_status)()
 {
   return keyboard_led_status;
 }
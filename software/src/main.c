@@ -62,6 +62,12 @@ void run_tasks(bool processInput)
   // process serial input
   serial_task(processInput);
 
+  // receive files if a ZMODEM sender was started on the remote side
+  if( processInput && terminal_zmodem_requested() )
+    {
+      if( config_zmodem_receive() ) apply_settings();
+    }
+
   // handle bootsel mechanism timeout
   if( bootsel_timeout>0 && get_absolute_time()>=bootsel_timeout )
     {
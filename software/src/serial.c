@@ -100,7 +100,8 @@ int __in_flash(".configfun")  serial_xmodem_receive_char(int msDelay)
         }
       else
         {
-          if( uart_is_readable(PIN_UART_ID) ) return uart_getc(PIN_UART_ID);
+          uint8_t b;
+          if( serial_uart_receive_char_raw(&b) ) return b;
         }
     }
   
@@ -23,6 +23,18 @@
 #include "serial_cdc.h"
 #include "serial_uart.h"
 #include "framebuf.h"
+#include "stats.h"
+#include "hotfun.h"
+
+// CDC input is read in blocks of CDC_RX_CHUNK bytes, at most CDC_RX_MAX_PER_TASK
+// bytes per call of serial_cdc_task() so the other tasks keep running
+#define CDC_RX_CHUNK        256
+#define CDC_RX_MAX_PER_TASK 2048
+
+// receive statistics: the rate is measured over windows of at least one second
+// of continuous input, a pause of more than 100ms starts a new window
+static uint32_t cdc_rx_total = 0, cdc_rx_rate = 0, cdc_rx_peak = 0;
+static uint32_t cdc_rx_window_bytes = 0, cdc_rx_window_start = 0, cdc_rx_last = 0;
 
 
 static void terminal_disabled_message(bool show)
@@ -62,8 +74,10 @@ void serial_cdc_send_char(char c)
 {
   if( tud_cdc_connected() )
     {
-      tud_cdc_write(&c, 1);
+      uint32_t n = tud_cdc_write(&c, 1);
       tud_cdc_write_flush();
+      stats_add(STAT_CDC_TX, n);
+      stats_add(STAT_CDC_TX_DROPPED, 1-n);
     }
 }
 
@@ -72,8 +86,10 @@ void serial_cdc_send_string(const char *s)
 {
   if( tud_cdc_connected() )
     {
-      tud_cdc_write(s, strlen(s));
+      uint32_t len = strlen(s), n = tud_cdc_write(s, len);
       tud_cdc_write_flush();
+      stats_add(STAT_CDC_TX, n);
+      stats_add(STAT_CDC_TX_DROPPED, len-n);
     }
 }
 
@@ -84,11 +100,41 @@ bool serial_cdc_readable()
 }
 
 
-void serial_cdc_task(bool processInput)
+void serial_cdc_get_rx_stats(uint32_t *total, uint32_t *rate, uint32_t *peak)
+{
+  *total = cdc_rx_total;
+  *rate  = cdc_rx_rate;
+  *peak  = cdc_rx_peak;
+}
+
+
+static void cdc_rx_count(uint32_t n)
+{
+  uint32_t now = time_us_32();
+  if( cdc_rx_window_bytes>0 && now-cdc_rx_last > 100000 ) cdc_rx_window_bytes = 0;
+  if( cdc_rx_window_bytes==0 ) cdc_rx_window_start = now;
+  cdc_rx_last = now;
+
+  cdc_rx_total        += n;
+  stats_add(STAT_CDC_RX, n);
+  cdc_rx_window_bytes += n;
+
+  uint32_t elapsed = now-cdc_rx_window_start;
+  if( elapsed >= 1000000 )
+    {
+      cdc_rx_rate = (uint32_t) (((uint64_t) cdc_rx_window_bytes * 1000000) / elapsed);
+      if( cdc_rx_rate > cdc_rx_peak ) cdc_rx_peak = cdc_rx_rate;
+      cdc_rx_window_bytes = 0;
+    }
+}
+
+
+void HOTFUN(serial_cdc_task)(bool processInput)
 {
   if( processInput && tud_inited() && tud_cdc_available() )
     {
-      char count, buf[16];
+      static char buf[CDC_RX_CHUNK];
+      uint32_t count, total = 0;
 
       switch( config_get_usb_cdcmode() )
         {
@@ -96,20 +142,31 @@ void serial_cdc_task(bool processInput)
           break;
 
         case 1: // regular serial
-          count = tud_cdc_read(buf, sizeof(buf));
-          for(int i=0; i<count; i++) terminal_receive_char(buf[i]);
+          while( total<CDC_RX_MAX_PER_TASK && (count = tud_cdc_read(buf, sizeof(buf)))>0 )
+            {
+              terminal_receive_buffer(buf, count);
+              total += count;
+            }
           break;
 
         case 2: // pass-through
         case 3: // pass-through (terminal disabled)
           {
-            count = MIN(serial_uart_can_send(), sizeof(buf));
-            if( count>0 ) count = tud_cdc_read(buf, count);
-            for(int i=0; i<count; i++) serial_uart_send_char(buf[i]);
+            // only read as much as the UART TX buffer can take, the rest
+            // stays in the CDC FIFO (which makes USB throttle the host)
+            while( total<CDC_RX_MAX_PER_TASK && 
+                   (count = MIN(serial_uart_can_send(), sizeof(buf)))>0 &&
+                   (count = tud_cdc_read(buf, count))>0 )
+              {
+                serial_uart_send_buffer(buf, count);
+                total += count;
+              }
 
             break;
           }
         }
+
+      if( total>0 ) cdc_rx_count(total);
     }
 }
 
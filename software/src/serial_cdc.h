@@ -21,6 +21,7 @@
 #define SERIAL_CDC_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 bool serial_cdc_is_connected();
 void serial_cdc_set_break(bool set);
@@ -28,6 +29,9 @@ void serial_cdc_send_char(char c);
 void serial_cdc_send_string(const char *c);
 bool serial_cdc_readable();
 
+// total bytes received, receive rate over the latest full second (bytes/s) and highest rate seen
+void serial_cdc_get_rx_stats(uint32_t *total, uint32_t *rate, uint32_t *peak);
+
 void serial_cdc_task(bool processInput);
 void serial_cdc_apply_settings();
 void serial_cdc_init();
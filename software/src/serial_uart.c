@@ -17,10 +17,11 @@
 // Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
 // -----------------------------------------------------------------------------
 
+#include <string.h>
 #include "pico/stdlib.h"
-#include "pico/util/queue.h"
 #include "hardware/uart.h"
 #include "hardware/clocks.h"
+#include "hardware/dma.h"
 
 #include "serial_uart.h"
 #include "serial_cdc.h"
@@ -28,15 +29,36 @@
 #include "pins.h"
 #include "terminal.h"
 #include "config.h"
+#include "stats.h"
+#include "hotfun.h"
 
 #define XON  17
 #define XOFF 19
 
-// extended TX FIFO (512 bytes) f that is not affected by disabling the UART fifos
-static queue_t uart_tx_queue;
-
-// RX FIFO used for Xon/Xoff flow control
-static queue_t uart_rx_queue;
+// extended TX FIFO (512 bytes) that is not affected by disabling the UART fifos,
+// only used from the main loop so a plain ring buffer (filled with memcpy) will do
+#define UART_TX_BUF_SIZE 512
+static uint8_t  uart_tx_buf[UART_TX_BUF_SIZE];
+static uint32_t uart_tx_head = 0, uart_tx_tail = 0;
+
+// RX ring buffer (8k), filled by DMA in address-wrap mode so no received
+// data is lost while the main loop is busy (e.g. redrawing the menu).
+// PicoVGA uses DMA channels 0-7 without claiming them so use a fixed channel here
+#define UART_RX_DMA_CHANNEL 11
+#define UART_RX_RING_BITS   13
+#define UART_RX_RING_SIZE   (1u << UART_RX_RING_BITS)
+#define UART_RX_RING_MASK   (UART_RX_RING_SIZE-1)
+static uint8_t __attribute__((aligned(UART_RX_RING_SIZE))) uart_rx_ring[UART_RX_RING_SIZE];
+static uint32_t uart_rx_tail = 0, uart_rx_scan = 0;
+
+// total number of bytes written by the DMA in earlier runs and scanned so far,
+// used to notice when the DMA has overtaken the read position
+static uint32_t uart_rx_dma_base = 0, uart_rx_scanned = 0;
+
+// after an overrun reading continues this far behind the DMA write position
+// so the data is not overwritten again while it is being read
+#define UART_RX_OVERRUN_MARGIN 256
+static bool uart_rx_flowoff = false;
 
 // timeout when to turn off blink LED
 static absolute_time_t offtime = 0;
@@ -60,19 +82,45 @@ void serial_uart_set_break(bool set)
 
 int serial_uart_can_send()
 {
-  return 512-queue_get_level(&uart_tx_queue);
+  return UART_TX_BUF_SIZE-(uart_tx_head-uart_tx_tail);
 }
 
 
-void serial_uart_send_char(char c)
+static void uart_tx_flush()
 {
-  if( uart_is_writable(PIN_UART_ID) && queue_is_empty(&uart_tx_queue) )
+  // move buffered data to the UART for as long as it accepts more
+  if( uart_tx_tail!=uart_tx_head && uart_is_writable(PIN_UART_ID) )
     {
       blink_led(config_get_serial_blink());
-      uart_get_hw(PIN_UART_ID)->dr = c;
+      do
+        uart_get_hw(PIN_UART_ID)->dr = uart_tx_buf[uart_tx_tail++ % UART_TX_BUF_SIZE];
+      while( uart_tx_tail!=uart_tx_head && uart_is_writable(PIN_UART_ID) );
     }
-  else
-    queue_try_add(&uart_tx_queue, (uint8_t *) &c);
+}
+
+
+size_t serial_uart_send_buffer(const char *buf, size_t n)
+{
+  // returns the number of bytes accepted (the rest does not fit into the TX buffer)
+  size_t free = serial_uart_can_send();
+  if( n>free ) n = free;
+
+  uint32_t pos = uart_tx_head % UART_TX_BUF_SIZE;
+  size_t n1 = MIN(n, UART_TX_BUF_SIZE-pos);
+  memcpy(uart_tx_buf+pos, buf, n1);
+  memcpy(uart_tx_buf, buf+n1, n-n1);
+  uart_tx_head += n;
+  stats_add(STAT_UART_TX, n);
+
+  uart_tx_flush();
+  return n;
+}
+
+
+void serial_uart_send_char(char c)
+{
+  if( serial_uart_send_buffer(&c, 1)==0 )
+    stats_add(STAT_UART_TX_DROPPED, 1);
 }
 
 
@@ -82,35 +130,135 @@ void serial_uart_send_string(const char *s)
 }
 
 
-bool serial_uart_receive_char(uint8_t *b)
+static uint32_t uart_rx_written()
+{
+  // total number of bytes the DMA has written into the ring (its transfer
+  // count runs down from 0xFFFFFFFF), the next position to be filled in the
+  // ring is this value modulo the ring size
+  return uart_rx_dma_base + (0xFFFFFFFF - dma_channel_hw_addr(UART_RX_DMA_CHANNEL)->transfer_count);
+}
+
+
+static uint32_t uart_rx_head()
+{
+  return uart_rx_written() & UART_RX_RING_MASK;
+}
+
+
+static uint32_t uart_rx_check_overrun(uint32_t written)
+{
+  // if the DMA has overtaken the read position then the unread data was
+  // overwritten => skip to the oldest data that is still valid (minus the
+  // margin for data arriving meanwhile), returns the DMA write position
+  uint32_t unread = ((uart_rx_scan - uart_rx_tail) & UART_RX_RING_MASK) + (written - uart_rx_scanned);
+  if( unread >= UART_RX_RING_SIZE )
+    {
+      uint32_t scanned = written - (UART_RX_RING_SIZE-UART_RX_OVERRUN_MARGIN);
+      stats_add(STAT_UART_RX_OVERRUN, 1);
+      if( (int32_t) (scanned - uart_rx_scanned) > 0 ) stats_add(STAT_UART_RX, scanned - uart_rx_scanned);
+      uart_rx_scanned = scanned;
+      uart_rx_tail = uart_rx_scan = scanned & UART_RX_RING_MASK;
+    }
+
+  return written & UART_RX_RING_MASK;
+}
+
+
+static uint32_t uart_rx_level()
 {
-  bool res = false;
+  return (uart_rx_head() - uart_rx_tail) & UART_RX_RING_MASK;
+}
 
-  if( config_get_serial_xonxoff() )
+
+static void uart_rx_scan_flowcontrol()
+{
+  // react to XON/XOFF characters as soon as they arrive in the ring 
+  // (they are skipped by serial_uart_receive_char)
+  uint32_t written = uart_rx_written();
+  uint32_t head = uart_rx_check_overrun(written);
+  stats_add(STAT_UART_RX, written - uart_rx_scanned);
+  uart_rx_scanned = written;
+  if( config_get_serial_xonxoff()>0 )
     {
-      // if xon/xoff is enabled then we maintain our own RX queue
-      // so we can react faster to XON/XOFF requests.
-      res = queue_try_remove(&uart_rx_queue, b);
+      while( uart_rx_scan!=head )
+        {
+          uint8_t b = uart_rx_ring[uart_rx_scan];
+          if( b==XON || b==XOFF )
+            {
+              // disable UART transmitter when receiving XOff / enable transmitter when receiving XOn
+              hw_write_masked(&uart_get_hw(PIN_UART_ID)->cr, (b==XON) ? (1 << UART_UARTCR_TXE_LSB) : 0, UART_UARTCR_TXE_BITS);
+              stats_add(b==XON ? STAT_XON_RECEIVED : STAT_XOFF_RECEIVED, 1);
+            }
+
+          uart_rx_scan = (uart_rx_scan+1) & UART_RX_RING_MASK;
+        }
     }
   else
+    uart_rx_scan = head;
+}
+
+
+static void uart_rx_set_flowoff(bool off)
+{
+  if( config_get_serial_xonxoff()>0 )
+    {
+      uart_get_hw(PIN_UART_ID)->dr = off ? XOFF : XON;
+      stats_add(off ? STAT_XOFF_SENT : STAT_XON_SENT, 1);
+    }
+
+  if( config_get_serial_rtsmode()==2 )
+    {
+      gpio_put(PIN_UART_RTS, off); // RTS is active low
+      stats_add(STAT_RTS_TOGGLED, 1);
+    }
+
+  uart_rx_flowoff = off;
+}
+
+
+bool serial_uart_receive_char(uint8_t *b)
+{
+  uart_rx_scan_flowcontrol();
+
+  while( uart_rx_tail!=uart_rx_scan )
     {
-      // if xon/xoff is disabled then we use the built-in 
-      // UART RX buffer for better performance
-      if( uart_is_readable(PIN_UART_ID) ) 
+      *b = uart_rx_ring[uart_rx_tail];
+      uart_rx_tail = (uart_rx_tail+1) & UART_RX_RING_MASK;
+      
+      if( config_get_serial_xonxoff()==0 || (*b!=XON && *b!=XOFF) )
         {
           blink_led(config_get_serial_blink());
-          *b = uart_getc(PIN_UART_ID);
-          res = true;
+          return true;
         }
     }
 
-  return res;
+  return false;
+}
+
+
+bool serial_uart_receive_char_raw(uint8_t *b)
+{
+  // receive next character without XON/XOFF handling (for binary transfers)
+  if( uart_rx_tail==uart_rx_check_overrun(uart_rx_written()) )
+    return false;
+
+  if( uart_rx_scan==uart_rx_tail )
+    {
+      uart_rx_scan = (uart_rx_scan+1) & UART_RX_RING_MASK;
+      uart_rx_scanned++;
+      stats_add(STAT_UART_RX, 1);
+    }
+
+  *b = uart_rx_ring[uart_rx_tail];
+  uart_rx_tail = (uart_rx_tail+1) & UART_RX_RING_MASK;
+  return true;
 }
 
 
 bool serial_uart_readable()
 {
-  return config_get_serial_xonxoff() ? !queue_is_empty(&uart_rx_queue) : uart_is_readable(PIN_UART_ID);
+  uart_rx_scan_flowcontrol();
+  return uart_rx_tail!=uart_rx_scan;
 }
 
 
@@ -147,7 +295,12 @@ void serial_uart_apply_settings()
       break;
 
     case 2:
-      gpio_set_function(PIN_UART_RTS, GPIO_FUNC_UART);
+      // RTS is driven from the fill level of the RX ring (the UART's own 
+      // RTS output only looks at the hardware FIFO which the DMA keeps empty)
+      gpio_set_function(PIN_UART_RTS, GPIO_FUNC_NULL);
+      gpio_init(PIN_UART_RTS);
+      gpio_set_dir(PIN_UART_RTS, true); // output
+      gpio_put(PIN_UART_RTS, uart_rx_flowoff);
       break;
     }
 
@@ -164,7 +317,7 @@ void serial_uart_apply_settings()
       break;
     }
 
-  uart_set_hw_flow(PIN_UART_ID, config_get_serial_ctsmode(), config_get_serial_rtsmode());
+  uart_set_hw_flow(PIN_UART_ID, config_get_serial_ctsmode(), false);
 
   // make sure transmitter is always enabled if Xon/Xoff flow control is disabled
   if( config_get_serial_xonxoff()==0 )
@@ -177,76 +330,70 @@ void serial_uart_apply_settings()
 }
 
 
-void serial_uart_task(bool processInput)
+void HOTFUN(serial_uart_task)(bool processInput)
 {
-  static bool isxon = true;
   uint8_t b;
   
   // send serial output if we have some buffered
-  if( !queue_is_empty(&uart_tx_queue) && uart_is_writable(PIN_UART_ID) )
+  uart_tx_flush();
+
+  // re-start the RX DMA if it has used up its (huge) transfer count,
+  // the write address keeps its position within the ring
+  if( !dma_channel_is_busy(UART_RX_DMA_CHANNEL) )
     {
-      if( queue_try_remove(&uart_tx_queue, &b) ) 
-        {
-          blink_led(config_get_serial_blink());
-          uart_get_hw(PIN_UART_ID)->dr = b;
-        }
+      uart_rx_dma_base += 0xFFFFFFFF;
+      dma_channel_set_trans_count(UART_RX_DMA_CHANNEL, 0xFFFFFFFF, true);
     }
 
-  // handle XON/XOFF flow control
-  if( config_get_serial_xonxoff()>0 )
+  // count receive errors, the DMA only copies the data bits from the DR register
+  // but the raw interrupt status keeps the error flags until they are cleared
+  uint32_t ris = uart_get_hw(PIN_UART_ID)->ris & (UART_UARTRIS_OERIS_BITS | UART_UARTRIS_BERIS_BITS | UART_UARTRIS_PERIS_BITS | UART_UARTRIS_FERIS_BITS);
+  if( ris!=0 )
     {
-      // if xon/xoff is enabled then we maintain our own RX queue
-      // so we can react faster to XON/XOFF requests.
-      if( uart_is_readable(PIN_UART_ID) )
-        {
-          blink_led(config_get_serial_blink());
-
-          b = uart_getc(PIN_UART_ID);
-          if( b==XON || b==XOFF )
-            {
-              // disable UART transmitter when receiving XOff / enable transmitter when receiving XOn
-              hw_write_masked(&uart_get_hw(PIN_UART_ID)->cr, (b==XON) ? (1 << UART_UARTCR_TXE_LSB) : 0, UART_UARTCR_TXE_BITS);
-            }
-          else
-            {
-              queue_try_add(&uart_rx_queue, &b);
-
-              // send XOFF if our receive queue is almost full
-              if( queue_get_level(&uart_rx_queue)>20 && isxon )
-                { uart_get_hw(PIN_UART_ID)->dr = XOFF; isxon = false; }
-            }
-        }
-      else if( queue_get_level(&uart_rx_queue)<12 && !isxon )
-        {
-          // send XON if our receive queue is emptying again
-          uart_get_hw(PIN_UART_ID)->dr = XON;
-          isxon = true;
-        }
+      if( ris & UART_UARTRIS_OERIS_BITS ) stats_add(STAT_UART_OVERRUN, 1);
+      if( ris & UART_UARTRIS_BERIS_BITS ) stats_add(STAT_UART_BREAK, 1);
+      if( ris & UART_UARTRIS_PERIS_BITS ) stats_add(STAT_UART_PARITY, 1);
+      if( ris & UART_UARTRIS_FERIS_BITS ) stats_add(STAT_UART_FRAMING, 1);
+      uart_get_hw(PIN_UART_ID)->icr = ris;
     }
 
+  // handle XON/XOFF and RTS flow control based on fill level of RX ring
+  uart_rx_scan_flowcontrol();
+  uint32_t level = uart_rx_level();
+  if( !uart_rx_flowoff && level > UART_RX_RING_SIZE/100*config_get_serial_rx_highmark() )
+    uart_rx_set_flowoff(true);
+  else if( uart_rx_flowoff && level < UART_RX_RING_SIZE/100*config_get_serial_rx_lowmark() )
+    uart_rx_set_flowoff(false);
+
   // handle LED flashing
   if( offtime>0 && get_absolute_time() >= offtime )
     { offtime = 0; gpio_put(PIN_LED, false); }
 
-  // handle serial input
-  if( processInput && serial_uart_receive_char(&b) )
+  // handle serial input (collect what is available so the terminal
+  // can process runs of regular characters in one go)
+  if( processInput )
     {
-      switch( config_get_usb_cdcmode() )
-        {
-        case 0: // disabled
-        case 1: // regular serial
-          terminal_receive_char(b);
-          break;
-
-        case 2: // pass-through
-          terminal_receive_char(b);
-          serial_cdc_send_char(b);
-          break;
-
-        case 3: // pass-through (terminal disabled)
-          serial_cdc_send_char(b);
-          break;
-        }
+      char buf[32];
+      size_t n = 0;
+      while( n<sizeof(buf) && serial_uart_receive_char(&b) ) buf[n++] = b;
+
+      if( n>0 )
+        switch( config_get_usb_cdcmode() )
+          {
+          case 0: // disabled
+          case 1: // regular serial
+            terminal_receive_buffer(buf, n);
+            break;
+            
+          case 2: // pass-through
+            terminal_receive_buffer(buf, n);
+            for(size_t i=0; i<n; i++) serial_cdc_send_char(buf[i]);
+            break;
+            
+          case 3: // pass-through (terminal disabled)
+            for(size_t i=0; i<n; i++) serial_cdc_send_char(buf[i]);
+            break;
+          }
     }
 }
 
@@ -258,7 +405,16 @@ void serial_uart_init()
   gpio_set_dir(PIN_LED, true); // output
   blink_led(1000);
 
-  queue_init(&uart_tx_queue, 1, 512);
-  queue_init(&uart_rx_queue, 1, 32);
+  uart_tx_head = uart_tx_tail = 0;
   serial_uart_apply_settings();
+
+  // set up DMA channel to copy received data into the RX ring
+  dma_channel_claim(UART_RX_DMA_CHANNEL);
+  dma_channel_config c = dma_channel_get_default_config(UART_RX_DMA_CHANNEL);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+  channel_config_set_read_increment(&c, false);
+  channel_config_set_write_increment(&c, true);
+  channel_config_set_ring(&c, true, UART_RX_RING_BITS);
+  channel_config_set_dreq(&c, uart_get_dreq(PIN_UART_ID, false));
+  dma_channel_configure(UART_RX_DMA_CHANNEL, &c, uart_rx_ring, &uart_get_hw(PIN_UART_ID)->dr, 0xFFFFFFFF, true);
 }
@@ -23,7 +23,9 @@
 void serial_uart_set_break(bool set);
 void serial_uart_send_char(char c);
 void serial_uart_send_string(const char *s);
+size_t serial_uart_send_buffer(const char *buf, size_t n);
 bool serial_uart_readable();
+bool serial_uart_receive_char_raw(uint8_t *b);
 int  serial_uart_can_send();
 
 void serial_uart_task(bool processInput);
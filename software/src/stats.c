@@ -0,0 +1,56 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#include <string.h>
+#include "stats.h"
+#include "hotfun.h"
+
+static uint32_t counters[STAT_NUM];
+
+static const char __in_flash(".configmenus") names[STAT_NUM][24] =
+  {"UART bytes received", "UART bytes sent", "CDC bytes received", "CDC bytes sent",
+   "UART overrun errors", "UART framing errors", "UART parity errors", "UART breaks received",
+   "UART RX ring overruns",
+   "UART TX bytes dropped", "CDC TX bytes dropped", "Keypresses dropped",
+   "XOFF received", "XON received", "XOFF sent", "XON sent", "RTS toggled",
+   "Unknown sequences"};
+
+
+void HOTFUN(stats_add)(stats_counter_t c, uint32_t n)
+{
+  counters[c] += n;
+}
+
+
+uint32_t stats_get(stats_counter_t c)
+{
+  return counters[c];
+}
+
+
+const char *stats_get_name(stats_counter_t c)
+{
+  return names[c];
+}
+
+
+void stats_reset()
+{
+  memset(counters, 0, sizeof(counters));
+}
@@ -0,0 +1,55 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+// runtime statistics, shown by "Statistics" in the settings menu and
+// reported to the host for "ESC [ ? 99 n" (in this order)
+typedef enum
+  {
+    STAT_UART_RX = 0,      // bytes received via UART
+    STAT_UART_TX,          // bytes sent via UART
+    STAT_CDC_RX,           // bytes received via USB CDC
+    STAT_CDC_TX,           // bytes sent via USB CDC
+    STAT_UART_OVERRUN,     // UART receive errors
+    STAT_UART_FRAMING,
+    STAT_UART_PARITY,
+    STAT_UART_BREAK,
+    STAT_UART_RX_OVERRUN,  // RX ring overruns (unread data overwritten by the DMA)
+    STAT_UART_TX_DROPPED,  // bytes dropped because the UART TX buffer was full
+    STAT_CDC_TX_DROPPED,   // bytes dropped because the CDC TX FIFO was full
+    STAT_KEY_DROPPED,      // keypresses dropped because the keyboard queue was full
+    STAT_XOFF_RECEIVED,
+    STAT_XON_RECEIVED,
+    STAT_XOFF_SENT,
+    STAT_XON_SENT,
+    STAT_RTS_TOGGLED,
+    STAT_SEQ_UNKNOWN,      // unsupported escape sequences
+    STAT_NUM
+  } stats_counter_t;
+
+void stats_add(stats_counter_t c, uint32_t n);
+uint32_t stats_get(stats_counter_t c);
+const char *stats_get_name(stats_counter_t c);
+void stats_reset();
+
+#endif
@@ -25,7 +25,9 @@
 #include "serial.h"
 #include "sound.h"
 #include "keyboard.h"
+#include "stats.h"
 #include "hardware/uart.h"
+#include "hotfun.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -42,13 +44,18 @@ void wait(uint32_t milliseconds);
 #define TS_READPARAM   3
 #define TS_HASH        4
 #define TS_READCHAR    5
+#define TS_DCS         6
+#define TS_DCS_DSCS    7
+#define TS_DCS_DATA    8
+#define TS_DCS_IGNORE  9
 
 #define CS_TEXT_US  0
 #define CS_TEXT_UK  1
 #define CS_GRAPHICS 2
+#define CS_SOFT     3
 
 static uint8_t terminal_state = TS_NORMAL;
-static uint8_t color_fg, color_bg, attr = 0, cur_attr = 0;
+static uint8_t color_fg, color_bg, attr = 0;
 static int cursor_col = 0, cursor_row = 0, saved_col = 0, saved_row = 0;
 static int scroll_region_start, scroll_region_end;
 static bool cursor_shown = true, origin_mode = false, cursor_eol = false, auto_wrap_mode = true, vt52_mode = false, localecho = false;
@@ -56,9 +63,33 @@ static bool saved_eol = false, saved_origin_mode = false, insert_mode = false;
 static bool petscii_lower_case_charset = true;
 static uint8_t saved_attr, saved_fg, saved_bg, saved_charset_G0, saved_charset_G1, *charset, charset_G0, charset_G1, tabs[255];
 
+// name (intermediate << 8 | final character, 0 if none) and size of the
+// soft font character set loaded via DECDLD
+static uint16_t soft_dscs = 0;
+static bool soft_96 = false;
 
-static uint8_t INFLASHFUN get_charset(char c)
+// DECDLD soft font download in progress: glyphs are decoded into dld_glyphs
+// and copied to the font in one go when the string terminator is received
+static uint8_t  dld_glyphs[96*16], dld_first, dld_max, dld_num, dld_col, dld_band, dld_width, dld_height;
+static uint16_t dld_dscs;
+static bool     dld_erase, dld_96;
+
+// ZMODEM auto-start (if enabled in the terminal settings): a sender ("sz") starts
+// with a ZRQINIT header ("**" ZDLE "B00..."). Once ZDLE "B00" is seen the rest of
+// the received data is dropped until the main loop has run the ZMODEM receiver
+// (see terminal_zmodem_requested)
+static const char zmodem_start[] = "\030B00";
+static uint8_t zmodem_matched = 0;
+static bool zmodem_requested = false;
+
+
+static uint8_t INFLASHFUN get_charset(char inter, char c)
 {
+  if( soft_dscs!=0 && soft_dscs==(((uint8_t) inter << 8) | (uint8_t) c) )
+    return CS_SOFT;
+  else if( inter!=0 )
+    return CS_TEXT_US;
+
   switch( c )
     {
     case 'A' : return CS_TEXT_UK;
@@ -72,8 +103,9 @@ static uint8_t INFLASHFUN get_charset(char c)
 }
 
 
-static void INFLASHFUN show_cursor(bool show)
+static void HOTFUN(show_cursor)(bool show)
 {
+  // the display draws the cursor, it only needs to know where and how
   uint8_t attr = ATTR_INVERSE;
   switch( config_get_terminal_cursortype() )
     {
@@ -81,19 +113,17 @@ static void INFLASHFUN show_cursor(bool show)
     case 2: attr = ATTR_UNDERLINE; break;
     }
   
-  framebuf_set_attr(cursor_col, cursor_row, show ? (cur_attr ^ attr) : cur_attr);
+  framebuf_set_cursor(cursor_col, cursor_row, show ? attr : 0);
 }
 
 
-static void INFLASHFUN move_cursor_wrap(int row, int col)
+static void HOTFUN(move_cursor_wrap)(int row, int col)
 {
   if( row!=cursor_row || col!=cursor_col )
     {
       int top_limit    = scroll_region_start;
       int bottom_limit = scroll_region_end;
-      
-      if( cursor_shown && cursor_row>=0 && cursor_col>=0 ) show_cursor(false);
-      
+
       while( col<0 )                        { col += framebuf_get_ncols(row); row--; }
       while( row<top_limit )                { row++; framebuf_scroll_region(top_limit, bottom_limit, -1, color_fg, color_bg); }
       while( col>=framebuf_get_ncols(row) ) { col -= framebuf_get_ncols(row); row++; }
@@ -103,18 +133,15 @@ static void INFLASHFUN move_cursor_wrap(int row, int col)
       cursor_col = col;
       cursor_eol = false;
       
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
       if( cursor_shown ) show_cursor(true);
     }
 }
 
 
-static void INFLASHFUN move_cursor_within_region(int row, int col, int top_limit, int bottom_limit)
+static void HOTFUN(move_cursor_within_region)(int row, int col, int top_limit, int bottom_limit)
 {
   if( row!=cursor_row || col!=cursor_col )
     {
-      if( cursor_shown && cursor_row>=0 && cursor_col>=0 ) show_cursor(false);
-
       if( col<0 ) 
         col = 0;
       else if( col>=framebuf_get_ncols(row) )
@@ -129,7 +156,6 @@ static void INFLASHFUN move_cursor_within_region(int row, int col, int top_limit
       cursor_col = col;
       cursor_eol = false;
 
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
       if( cursor_shown ) show_cursor(true);
     }
 }
@@ -145,7 +171,7 @@ static void INFLASHFUN move_cursor_limited(int row, int col)
 
 
 
-static void INFLASHFUN init_cursor(int row, int col)
+static void HOTFUN(init_cursor)(int row, int col)
 {
   cursor_row = -1;
   cursor_col = -1;
@@ -153,7 +179,7 @@ static void INFLASHFUN init_cursor(int row, int col)
 }
 
 
-static void INFLASHFUN print_char_vt(char c)
+static void HOTFUN(print_char_vt)(char c)
 {
   if( cursor_eol ) 
     { 
@@ -163,25 +189,23 @@ static void INFLASHFUN print_char_vt(char c)
     }
 
   if( insert_mode )
-    {
-      show_cursor(false);
-      framebuf_insert(cursor_col, cursor_row, 1, color_fg, color_bg);
-    }
+    framebuf_insert(cursor_col, cursor_row, 1, color_fg, color_bg);
 
+  uint8_t a = attr;
   if( *charset==CS_TEXT_UK && c==35 )
     c=font_map_graphics_char(125, (attr & ATTR_BOLD)!=0); // pound sterling symbol
   else if( *charset==CS_GRAPHICS )
     c=font_map_graphics_char(c, (attr & ATTR_BOLD)!=0);
+  else if( *charset==CS_SOFT && (soft_96 || (c>32 && c<127)) )
+    a |= ATTR_SOFTFONT;
   
   framebuf_set_color(cursor_col, cursor_row, color_fg, color_bg);
-  framebuf_set_attr(cursor_col, cursor_row, attr);
+  framebuf_set_attr(cursor_col, cursor_row, a);
   framebuf_set_char(cursor_col, cursor_row, c);
 
   if( auto_wrap_mode && cursor_col==framebuf_get_ncols(cursor_row)-1 )
     {
       // cursor stays in last column but will wrap if another character is typed
-      cur_attr = attr;
-      show_cursor(cursor_shown);
       cursor_eol=true;
     }
   else
@@ -189,7 +213,56 @@ static void INFLASHFUN print_char_vt(char c)
 }
 
 
-static void INFLASHFUN print_char_petscii(char c)
+static void INFLASHFUN print_run_vt(const char *buf, size_t len, uint8_t mask)
+{
+  // print a run of regular characters (US character set, not in insert mode),
+  // writing each row span with a single framebuf_set_chars() call and only
+  // updating the cursor once per span
+  char chars[MAX_COLS];
+
+  while( len>0 )
+    {
+      if( cursor_eol ) 
+        { 
+          // cursor was already past the end of the line => move it to the next line now
+          move_cursor_wrap(cursor_row+1, 0); 
+          cursor_eol=false; 
+        }
+
+      int ncols = framebuf_get_ncols(cursor_row);
+      size_t avail = cursor_col<ncols ? ncols-cursor_col : 1;
+      size_t n = MIN(len, avail);
+      for(size_t i=0; i<n; i++) chars[i] = buf[i] & mask;
+
+      if( !auto_wrap_mode && n<len )
+        {
+          // without auto-wrap, all remaining characters overwrite the last column
+          chars[n-1] = buf[len-1] & mask;
+          n = len;
+        }
+
+      framebuf_set_chars(cursor_col, cursor_row, chars, MIN(n, avail), attr, color_fg, color_bg);
+      buf += n;
+      len -= n;
+
+      if( n>=avail )
+        {
+          if( auto_wrap_mode )
+            {
+              // cursor stays in last column but will wrap if another character is typed
+              if( cursor_col!=ncols-1 ) init_cursor(cursor_row, ncols-1);
+              cursor_eol=true;
+            }
+          else
+            init_cursor(cursor_row, ncols-1);
+        }
+      else
+        init_cursor(cursor_row, cursor_col+n);
+    }
+}
+
+
+static void HOTFUN(print_char_petscii)(char c)
 {
   framebuf_set_color(cursor_col, cursor_row, color_fg, color_bg);
   framebuf_set_attr(cursor_col, cursor_row, attr);
@@ -222,10 +295,13 @@ void INFLASHFUN terminal_reset()
   saved_charset_G0 = CS_TEXT_US;
   saved_charset_G1 = CS_GRAPHICS;
   charset = &charset_G0;
+  soft_dscs = 0;
+  font_clear_soft_glyphs();
   memset(tabs, 0, framebuf_get_ncols(-1));
   framebuf_set_scroll_delay(0);
   localecho = config_get_terminal_localecho();
   petscii_lower_case_charset = true;
+  framebuf_set_alternate_screen(false);
 }
 
 
@@ -253,7 +329,7 @@ static void INFLASHFUN send_string(const char *s)
 }
 
 
-static INFLASHFUN void terminal_process_text(char c)
+static void HOTFUN(terminal_process_text)(char c)
 {
   switch( c )
     {
@@ -285,8 +361,6 @@ static INFLASHFUN void terminal_process_text(char c)
               {
                 framebuf_set_char(cursor_col, cursor_row, ' ');
                 framebuf_set_attr(cursor_col, cursor_row, 0);
-                cur_attr = 0;
-                show_cursor(cursor_shown);
               }
           }
 
@@ -330,9 +404,53 @@ static INFLASHFUN void terminal_process_text(char c)
 }
 
 
-static void INFLASHFUN terminal_process_command(char start_char, char final_char, uint8_t num_params, uint8_t *params)
+static int get_extended_color(uint8_t num_params, const uint16_t *params, uint16_t subparams, unsigned int *i)
+{
+  // extended color following SGR 38/48 at params[*i], either as separate
+  // parameters ("38;5;n", "38;2;r;g;b") or as sub-parameters ("38:5:n",
+  // "38:2:[colorspace]:r:g:b"). Advances *i to the last parameter belonging
+  // to the color and returns the 256-color index or -1 if not supported.
+  // 24-bit colors are mapped to the nearest color the display can show.
+  unsigned int j = *i+1;
+  int color = -1;
+
+  if( j<num_params && (subparams & (1<<j)) )
+    {
+      unsigned int n = 1;
+      while( j+n<num_params && (subparams & (1<<(j+n))) ) n++;
+      if( params[j]==5 && n>=2 && params[j+1]<256 )
+        color = params[j+1];
+      else if( params[j]==2 && n>=4 )
+        {
+          const uint16_t *rgb = params+j+(n>=5 ? 2 : 1);
+          color = framebuf_map_rgb(MIN(rgb[0], 255), MIN(rgb[1], 255), MIN(rgb[2], 255));
+        }
+      *i = j+n-1;
+    }
+  else if( j<num_params )
+    {
+      if( params[j]==5 )
+        {
+          if( j+1<num_params && params[j+1]<256 ) color = params[j+1];
+          *i = MIN(j+1, num_params-1);
+        }
+      else if( params[j]==2 )
+        {
+          if( j+3<num_params ) color = framebuf_map_rgb(MIN(params[j+1], 255), MIN(params[j+2], 255), MIN(params[j+3], 255));
+          *i = MIN(j+3, num_params-1);
+        }
+      else
+        *i = j;
+    }
+
+  return color;
+}
+
+
+static void HOTFUN(terminal_process_command)(char start_char, char final_char, uint8_t num_params, uint16_t *params, uint16_t subparams)
 {
   // NOTE: num_params>=1 always holds, if no parameters were received then params[0]=0
+  // bit N of subparams is set if params[N] was separated from its predecessor by ':'
   if( final_char=='l' || final_char=='h' )
     {
       bool enabled = final_char=='h';
@@ -344,7 +462,10 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
               if( !enabled ) { terminal_reset(); vt52_mode = true; }
               break;
 
-            case 3: // switch 80/132 columm mode - 132 columns not supported but we can clear the screen
+            case 3: // switch 80/132 column mode (only builds with an 800 pixel wide output can show 132 columns)
+#if VERSATERM_DVI_WIDE || VERSATERM_VGA_WIDE
+              framebuf_set_screen_size(enabled ? 132 : config_get_screen_cols(), config_get_screen_rows());
+#endif
               terminal_clear_screen();
               break;
 
@@ -373,6 +494,20 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
               cursor_shown = enabled;
               show_cursor(cursor_shown);
               break;
+
+            case 47:   // alternate screen
+            case 1047: // alternate screen, cleared when leaving
+            case 1049: // alternate screen, cleared when entering, cursor saved/restored
+              {
+                uint16_t p = 2;
+                if( params[0]==1049 && enabled ) terminal_process_command(0, 's', 0, NULL, 0);
+                if( params[0]==1047 && !enabled && framebuf_get_alternate_screen() ) terminal_process_command(0, 'J', 1, &p, 0);
+
+                framebuf_set_alternate_screen(enabled);
+                if( params[0]==1049 && enabled ) terminal_process_command(0, 'J', 1, &p, 0);
+                if( params[0]==1049 && !enabled ) terminal_process_command(0, 'u', 0, NULL, 0);
+                break;
+              }
             }
         }
       else if( start_char==0 )
@@ -404,9 +539,6 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
           framebuf_fill_region(0, 0, framebuf_get_ncols(cursor_row)-1, framebuf_get_nrows()-1, ' ', color_fg, color_bg);
           break;
         }
-
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      show_cursor(cursor_shown);
     }
   else if( final_char=='K' )
     {
@@ -424,9 +556,6 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
           framebuf_fill_region(0, cursor_row, framebuf_get_ncols(cursor_row)-1, cursor_row, ' ', color_fg, color_bg);
           break;
         }
-
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      show_cursor(cursor_shown);
     }
   else if( final_char=='A' )
     {
@@ -490,37 +619,26 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
     }
   else if( final_char=='L' || final_char=='M' )
     {
-      int n = MAX(1, params[0]);
       int bottom_limit = origin_mode ? scroll_region_end : framebuf_get_nrows()-1;
-      show_cursor(false);
+      int n = MIN(MAX(1, params[0]), bottom_limit-cursor_row+1);
       framebuf_scroll_region(cursor_row, bottom_limit, final_char=='M' ? n : -n, color_fg, color_bg);
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      show_cursor(cursor_shown);
     }
   else if( final_char=='@' )
     {
-      int n = MAX(1, params[0]);
-      show_cursor(false);
+      int n = MIN(MAX(1, params[0]), framebuf_get_ncols(cursor_row));
       framebuf_insert(cursor_col, cursor_row, n, color_fg, color_bg);
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      show_cursor(cursor_shown);
     }
   else if( final_char=='P' )
     {
-      int n = MAX(1, params[0]);
+      int n = MIN(MAX(1, params[0]), framebuf_get_ncols(cursor_row));
       framebuf_delete(cursor_col, cursor_row, n, color_fg, color_bg);
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      show_cursor(cursor_shown);
     }
   else if( final_char=='S' || final_char=='T' )
     {
       int top_limit    = origin_mode ? scroll_region_start : 0;
       int bottom_limit = origin_mode ? scroll_region_end   : framebuf_get_nrows()-1;
-      int n = MAX(1, params[0]);
-      show_cursor(false);
-      while( n-- ) framebuf_scroll_region(top_limit, bottom_limit, final_char=='S' ? n : -n, color_fg, color_bg);
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      show_cursor(cursor_shown);
+      int n = MIN(MAX(1, params[0]), bottom_limit-top_limit+1);
+      framebuf_scroll_region(top_limit, bottom_limit, final_char=='S' ? n : -n, color_fg, color_bg);
     }
   else if( final_char=='g' )
     {
@@ -537,18 +655,26 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
         {
           int p = params[i];
 
+          // skip sub-parameters not handled below (e.g. "4:3" = curly underline)
+          unsigned int sub = i;
+          while( sub+1<num_params && (subparams & (1<<(sub+1))) ) sub++;
+
           if( p==0 )
             {
               color_fg = config_get_terminal_default_fg();
               color_bg = config_get_terminal_default_bg();
               attr     = config_get_terminal_default_attr();
               //cursor_shown = true;
-              show_cursor(cursor_shown);
             }
           else if( p==1 )
             attr |= ATTR_BOLD;
           else if( p==4 )
-            attr |= ATTR_UNDERLINE;
+            {
+              if( sub>i && params[i+1]==0 )
+                attr &= ~ATTR_UNDERLINE;
+              else
+                attr |= ATTR_UNDERLINE;
+            }
           else if( p==5 )
             attr |= ATTR_BLINK;
           else if( p==7 )
@@ -563,18 +689,26 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
             attr &= ~ATTR_INVERSE;
           else if( p>=30 && p<=37 )
             color_fg = p-30;
-          else if( p==38 && num_params>=i+2 && params[i+1]==5 )
-            { color_fg = params[i+2] & 15; i+=2; }
+          else if( p==38 )
+            {
+              int c = get_extended_color(num_params, params, subparams, &i);
+              if( c>=0 ) color_fg = c;
+              continue;
+            }
           else if( p==39 )
             color_fg = config_get_terminal_default_fg();
           else if( p>=40 && p<=47 )
             color_bg = p-40;
-          else if( p==48 && num_params>=i+2 && params[i+1]==5 )
-            { color_bg = params[i+2] & 15; i+=2; }
+          else if( p==48 )
+            {
+              int c = get_extended_color(num_params, params, subparams, &i);
+              if( c>=0 ) color_bg = c;
+              continue;
+            }
           else if( p==49 )
             color_bg = config_get_terminal_default_bg();
 
-          show_cursor(cursor_shown);
+          i = sub;
         }
     }
   else if( final_char=='r' )
@@ -626,7 +760,19 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
     }
   else if( final_char=='n' )
     {
-      if( params[0] == 5 )
+      if( start_char=='?' && params[0] == 99 )
+        {
+          // statistics report (VersaTerm private): ESC [ ? 99 ; <counter> ; ... n
+          char buf[12];
+          send_string("\033[?99");
+          for(int i=0; i<STAT_NUM; i++)
+            {
+              snprintf(buf, 12, ";%lu", (unsigned long) stats_get(i));
+              send_string(buf);
+            }
+          send_string("n");
+        }
+      else if( params[0] == 5 )
         {
           // terminal status report
           send_string("\033[0n");
@@ -640,16 +786,107 @@ static void INFLASHFUN terminal_process_command(char start_char, char final_char
           send_string(buf);
         }
     }
+  else
+    stats_add(STAT_SEQ_UNKNOWN, 1);
 }
 
 
-void INFLASHFUN terminal_receive_char_vt102(char c)
+static uint8_t INFLASHFUN dld_start(uint8_t num_params, const uint16_t *params)
 {
-  static char    start_char = 0;
+  // DCS Pfn;Pcn;Pe;Pcmw;Pw;Pt;Pcmh;Pcss { => start of a DECDLD soft font download,
+  // the font number (Pfn), font width (Pw) and text/full cell (Pt) are ignored
+  uint16_t p[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  for(int i=0; i<num_params && i<8; i++) p[i] = params[i];
+
+  dld_96     = p[7]==1;
+  dld_first  = (dld_96 || p[1]>0) ? MIN(p[1], 95) : 1;
+  dld_max    = (dld_96 ? 96 : 95) - dld_first;
+  dld_erase  = p[2]!=1;
+  dld_width  = (p[3]>=2 && p[3]<=4) ? p[3]+3 : ((p[3]>=5 && p[3]<FONT_CHAR_WIDTH) ? p[3] : FONT_CHAR_WIDTH);
+  dld_height = (p[6]>0 && p[6]<font_get_char_height()) ? p[6] : font_get_char_height();
+  dld_dscs   = 0;
+  dld_num    = 0;
+  dld_col    = 0;
+  dld_band   = 0;
+  memset(dld_glyphs, 0, sizeof(dld_glyphs));
+  return TS_DCS_DSCS;
+}
+
+
+static void INFLASHFUN dld_data(char c)
+{
+  // sixel data of the glyphs: each character 0x3F-0x7E gives one column of six
+  // pixels (top pixel in bit 0), '/' starts the next six pixel rows and ';' the next glyph
+  if( dld_num==0 ) dld_num = 1;
+
+  if( c=='/' )
+    { dld_band++; dld_col = 0; }
+  else if( c==';' )
+    { dld_num = MIN(dld_num+1, dld_max+1); dld_band = 0; dld_col = 0; }
+  else if( c>=0x3F && c<=0x7E )
+    {
+      if( dld_col<dld_width && dld_num<=dld_max )
+        {
+          uint8_t *glyph = dld_glyphs + (dld_num-1)*16;
+          uint8_t bits = c - 0x3F;
+          for(int i=0; i<6; i++)
+            {
+              int row = dld_band*6+i;
+              if( (bits & (1<<i)) && row<dld_height ) glyph[row] |= 0x80 >> dld_col;
+            }
+        }
+
+      dld_col++;
+    }
+}
+
+
+static void INFLASHFUN dld_finish()
+{
+  // string terminator received => copy the glyphs to the font (only one soft
+  // font is kept so loading a differently named one replaces all glyphs)
+  if( dld_erase || dld_dscs!=soft_dscs ) font_clear_soft_glyphs();
+  font_set_soft_glyphs(0x20+dld_first, MIN(dld_num, dld_max), dld_glyphs);
+  soft_dscs = dld_dscs;
+  soft_96   = dld_96;
+}
+
+
+void HOTFUN(terminal_receive_char_vt102)(char c)
+{
+  static char    start_char = 0, intermediate = 0;
   static uint8_t num_params = 0;
-  static uint8_t params[16];
+  static uint16_t params[16], subparams = 0;
+  static bool dcs_esc = false;
+
+  if( terminal_state>=TS_DCS )
+    {
+      // within a device control string: only the string terminator (ESC \) or
+      // CAN/SUB end it, any other escape sequence aborts it and is processed
+      if( dcs_esc )
+        {
+          dcs_esc = false;
+          if( c=='\\' )
+            {
+              if( terminal_state==TS_DCS_DATA ) dld_finish();
+              terminal_state = TS_NORMAL;
+              return;
+            }
 
-  if( terminal_state!=TS_NORMAL )
+          terminal_state = TS_WAITBRACKET;
+        }
+      else if( c==27 )
+        {
+          dcs_esc = true;
+          return;
+        }
+      else if( c==24 || c==26 )
+        {
+          terminal_state = TS_NORMAL;
+          return;
+        }
+    }
+  else if( terminal_state!=TS_NORMAL )
     {
       if( c==8 || c==10 || c==13 )
         {
@@ -662,6 +899,7 @@ void INFLASHFUN terminal_receive_char_vt102(char c)
         {
           // ignore VT character plus the following character
           // (otherwise we fail "vttest" cursor control tests)
+          start_char = 0;
           terminal_state = TS_READCHAR;
           return;
         }
@@ -689,6 +927,7 @@ void INFLASHFUN terminal_receive_char_vt102(char c)
             start_char = 0;
             num_params = 1;
             params[0] = 0;
+            subparams = 0;
             terminal_state = TS_STARTCHAR;
             break;
             
@@ -696,13 +935,20 @@ void INFLASHFUN terminal_receive_char_vt102(char c)
             terminal_state = TS_HASH;
             break;
             
+          case 'P':
+            num_params = 1;
+            params[0] = 0;
+            intermediate = 0;
+            terminal_state = TS_DCS;
+            break;
+            
           case  27: print_char_vt(c); break;                           // escaped ESC
           case 'c': terminal_reset(); break;                           // reset
-          case '7': terminal_process_command(0, 's', 0, NULL); break;  // save cursor position
-          case '8': terminal_process_command(0, 'u', 0, NULL); break;  // restore cursor position
+          case '7': terminal_process_command(0, 's', 0, NULL, 0); break;  // save cursor position
+          case '8': terminal_process_command(0, 'u', 0, NULL, 0); break;  // restore cursor position
           case 'H': tabs[cursor_col] = true; break;                    // set tab
-          case 'J': terminal_process_command(0, 'J', 0, NULL); break;  // clear to end of screen
-          case 'K': terminal_process_command(0, 'K', 0, NULL); break;  // clear to end of row
+          case 'J': terminal_process_command(0, 'J', 0, NULL, 0); break;  // clear to end of screen
+          case 'K': terminal_process_command(0, 'K', 0, NULL, 0); break;  // clear to end of row
           case 'D': move_cursor_wrap(cursor_row+1, cursor_col); break; // cursor down
           case 'E': move_cursor_wrap(cursor_row+1, 0); break;          // cursor down and to first column
           case 'I': move_cursor_wrap(cursor_row-1, 0); break;          // cursor up and to furst column
@@ -711,9 +957,17 @@ void INFLASHFUN terminal_receive_char_vt102(char c)
           case ')': 
           case '+':
           case '*':
+          case '-':
+          case '.':
+          case '/':
             start_char = c;
+            intermediate = 0;
             terminal_state = TS_READCHAR;
             break;
+
+          default:
+            stats_add(STAT_SEQ_UNKNOWN, 1);
+            break;
           }
 
         break;
@@ -724,18 +978,24 @@ void INFLASHFUN terminal_receive_char_vt102(char c)
       {
         if( c>='0' && c<='9' )
           {
-            params[num_params-1] = params[num_params-1]*10 + (c-'0');
+            // values saturate at 65535
+            uint16_t p = params[num_params-1];
+            params[num_params-1] = p<6553 ? p*10 + (c-'0') : 65535;
             terminal_state = TS_READPARAM;
           }
-        else if( c == ';' )
+        else if( c == ';' || c == ':' )
           {
-            // next parameter (max 16 parameters)
+            // next parameter or sub-parameter (max 16 in total)
             num_params++;
             if( num_params>16 )
-              terminal_state = TS_NORMAL;
+              {
+                stats_add(STAT_SEQ_UNKNOWN, 1);
+                terminal_state = TS_NORMAL;
+              }
             else
               {
                 params[num_params-1]=0;
+                if( c==':' ) subparams |= 1<<(num_params-1);
                 terminal_state = TS_READPARAM;
               }
           }
@@ -747,7 +1007,7 @@ void INFLASHFUN terminal_receive_char_vt102(char c)
         else
           {
             // not a parameter value or startchar => command is done
-            terminal_process_command(start_char, c, num_params, params);
+            terminal_process_command(start_char, c, num_params, params, subparams);
             terminal_state = TS_NORMAL;
           }
         
@@ -787,12 +1047,13 @@ void INFLASHFUN terminal_receive_char_vt102(char c)
               // fill screen with 'E' characters (DEC test feature)
               int top_limit    = origin_mode ? scroll_region_start : 0;
               int bottom_limit = origin_mode ? scroll_region_end   : framebuf_get_nrows()-1;
-              show_cursor(false);
               framebuf_fill_region(0, top_limit, framebuf_get_ncols(-1)-1, bottom_limit, 'E', color_fg, color_bg);
-              cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-              show_cursor(cursor_shown);
               break;
             }
+
+          default:
+            stats_add(STAT_SEQ_UNKNOWN, 1);
+            break;
           }
         
         terminal_state = TS_NORMAL;
@@ -801,14 +1062,72 @@ void INFLASHFUN terminal_receive_char_vt102(char c)
 
     case TS_READCHAR:
       {
+        if( start_char!=0 && intermediate==0 && c>=0x20 && c<=0x2F )
+          {
+            // intermediate character of a (soft font) character set name
+            intermediate = c;
+            break;
+          }
+
         if( start_char=='(' )
-          charset_G0 = get_charset(c);
-        else if( start_char==')' )
-          charset_G1 = get_charset(c);
+          charset_G0 = get_charset(intermediate, c);
+        else if( start_char==')' || start_char=='-' )
+          charset_G1 = get_charset(intermediate, c);
 
         terminal_state = TS_NORMAL;
         break;
       }
+
+    case TS_DCS:
+      {
+        if( c>='0' && c<='9' )
+          {
+            uint16_t p = params[num_params-1];
+            params[num_params-1] = p<6553 ? p*10 + (c-'0') : 65535;
+          }
+        else if( c==';' )
+          {
+            if( num_params<16 ) params[num_params++] = 0;
+          }
+        else if( c>=0x20 && c<=0x2F )
+          intermediate = c;
+        else if( c>=0x40 && c<=0x7E )
+          {
+            // only DECDLD is supported, other device control strings are skipped
+            if( c=='{' && intermediate==0 )
+              terminal_state = dld_start(num_params, params);
+            else
+              {
+                stats_add(STAT_SEQ_UNKNOWN, 1);
+                terminal_state = TS_DCS_IGNORE;
+              }
+          }
+
+        break;
+      }
+
+    case TS_DCS_DSCS:
+      {
+        // name of the soft font character set (optional intermediate + final character)
+        if( c>=0x20 && c<=0x2F && dld_dscs==0 )
+          dld_dscs = (uint8_t) c << 8;
+        else if( c>=0x30 && c<=0x7E )
+          {
+            dld_dscs |= (uint8_t) c;
+            terminal_state = TS_DCS_DATA;
+          }
+        else
+          terminal_state = TS_DCS_IGNORE;
+
+        break;
+      }
+
+    case TS_DCS_DATA:
+      dld_data(c);
+      break;
+
+    case TS_DCS_IGNORE:
+      break;
     }
 }
 
@@ -864,25 +1183,16 @@ void INFLASHFUN terminal_receive_char_vt52(char c)
             break;
 
           case 'J':
-            show_cursor(false);
             framebuf_fill_region(cursor_col, cursor_row, framebuf_get_ncols(cursor_row)-1, framebuf_get_nrows()-1, ' ', color_fg, color_bg);
-            cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-            show_cursor(cursor_shown);
             break;
 
           case 'K':
-            show_cursor(false);
             framebuf_fill_region(cursor_col, cursor_row, framebuf_get_ncols(cursor_row)-1, cursor_row, ' ', color_fg, color_bg);
-            cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-            show_cursor(cursor_shown);
             break;
 
           case 'L':
           case 'M':
-            show_cursor(false);
             framebuf_scroll_region(cursor_row, framebuf_get_nrows()-1, c=='M' ? 1 : -1, color_fg, color_bg);
-            cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-            show_cursor(cursor_shown);
             break;
 
           case 'Y':
@@ -930,7 +1240,6 @@ void INFLASHFUN terminal_receive_char_vt52(char c)
 
           case 'o':
             framebuf_fill_region(0, cursor_row, cursor_col, cursor_row, ' ', color_fg, color_bg);
-            show_cursor(cursor_shown);
             break;
 
           case 'p':
@@ -953,6 +1262,10 @@ void INFLASHFUN terminal_receive_char_vt52(char c)
             terminal_reset();
             vt52_mode = false;
             break;
+
+          default:
+            stats_add(STAT_SEQ_UNKNOWN, 1);
+            break;
           }
 
         break;
@@ -973,12 +1286,10 @@ void INFLASHFUN terminal_receive_char_vt52(char c)
         else if( start_char=='b' && c>=32 )
           {
             color_fg = (c-32) & 15;
-            show_cursor(cursor_shown);
           }
         else if( start_char=='c' && c>=32 )
           {
             color_bg = (c-32) & 15;
-            show_cursor(cursor_shown);
           }
 
         break;
@@ -987,7 +1298,7 @@ void INFLASHFUN terminal_receive_char_vt52(char c)
 }
 
 
-static void INFLASHFUN terminal_receive_char_petscii(uint8_t c)
+static void HOTFUN(terminal_receive_char_petscii)(uint8_t c)
 {
   static uint8_t inserted = 0;
   static bool quoteMode = false;
@@ -1093,8 +1404,6 @@ static void INFLASHFUN terminal_receive_char_petscii(uint8_t c)
         {
           move_cursor_wrap(cursor_row, cursor_col-1);
           framebuf_delete(cursor_col, cursor_row, 1, color_fg, color_bg);
-          cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-          show_cursor(cursor_shown);
         }
       break;
 
@@ -1151,10 +1460,7 @@ static void INFLASHFUN terminal_receive_char_petscii(uint8_t c)
       break;
 
     case 148: // insert
-      show_cursor(false);
       framebuf_insert(cursor_col, cursor_row, 1, color_fg, color_bg);
-      cur_attr = framebuf_get_attr(cursor_col, cursor_row);
-      show_cursor(cursor_shown);
       inserted++;
       break;
 
@@ -1241,10 +1547,11 @@ static void INFLASHFUN terminal_receive_char_petscii(uint8_t c)
 }
 
 
-void INFLASHFUN terminal_receive_char(char c)
+static void HOTFUN(receive_char)(char c)
 {
-  if( config_get_terminal_clearBit7() ) c &= 0x7f;
-
+  // screen changes caused by one character (i.e. one complete escape sequence) 
+  // are shown together
+  framebuf_begin_update();
   switch( config_get_terminal_type() )
     {
     case CFG_TTYPE_VT102:
@@ -1258,9 +1565,74 @@ void INFLASHFUN terminal_receive_char(char c)
       terminal_receive_char_petscii(c);
       break;
     }
+  framebuf_end_update();
 }
 
 
+void HOTFUN(terminal_receive_char)(char c)
+{
+  if( config_get_terminal_clearBit7() ) c &= 0x7f;
+
+  if( zmodem_matched>0 || (c==zmodem_start[0] && config_get_terminal_zmodem_autostart()) )
+    {
+      if( c==zmodem_start[zmodem_matched] )
+        {
+          // hold back characters that may be the start of a ZMODEM transfer
+          if( ++zmodem_matched==sizeof(zmodem_start)-1 ) { zmodem_matched = 0; zmodem_requested = true; }
+          return;
+        }
+      else
+        {
+          // not a ZMODEM transfer => process the held back characters
+          uint8_t n = zmodem_matched;
+          zmodem_matched = 0;
+          for(uint8_t i=0; i<n; i++) receive_char(zmodem_start[i]);
+          if( c==zmodem_start[0] ) { zmodem_matched = 1; return; }
+        }
+    }
+
+  receive_char(c);
+}
+
+
+bool INFLASHFUN terminal_zmodem_requested()
+{
+  // returns true once after a ZMODEM transfer start was received
+  bool res = zmodem_requested;
+  zmodem_requested = false;
+  return res;
+}
+
+
+void HOTFUN(terminal_receive_buffer)(const char *buf, size_t len)
+{
+  uint8_t mask = config_get_terminal_clearBit7() ? 0x7f : 0xff;
+  bool vt102 = config_get_terminal_type()==CFG_TTYPE_VT102;
+
+  framebuf_begin_update();
+  while( len>0 && !zmodem_requested )
+    {
+      if( vt102 && !vt52_mode && terminal_state==TS_NORMAL && !insert_mode && *charset==CS_TEXT_US && zmodem_matched==0 )
+        {
+          // find run of regular characters and print them in one go
+          size_t n = 0;
+          while( n<len && (((uint8_t) buf[n]) & mask)>=32 && (((uint8_t) buf[n]) & mask)!=127 ) n++;
+          if( n>0 )
+            {
+              print_run_vt(buf, n, mask);
+              buf += n;
+              len -= n;
+              continue;
+            }
+        }
+
+      // escape sequences and control characters go through the regular state machine
+      terminal_receive_char(*buf++);
+      len--;
+    }
+  framebuf_end_update();
+}
+
 
 void INFLASHFUN terminal_receive_string(const char* str)
 {
@@ -1431,6 +1803,18 @@ static void INFLASHFUN terminal_process_key_petscii(uint16_t key)
 
 void INFLASHFUN terminal_process_key(uint16_t key)
 {
+  if( ((key&0xFF)==HID_KEY_PAGE_UP || (key&0xFF)==HID_KEY_PAGE_DOWN) && keyboard_shift_pressed(key) )
+    {
+      // Shift-PageUp/PageDown pages through the scrollback buffer
+      int page = MAX(1, framebuf_get_nrows()-1);
+      int view = framebuf_get_scrollback_view() + ((key&0xFF)==HID_KEY_PAGE_UP ? page : -page);
+      framebuf_set_scrollback_view(MAX(view, 0));
+      return;
+    }
+
+  // any other key returns to the current screen
+  framebuf_set_scrollback_view(0);
+
   if( (key&0xFF)==HID_KEY_PAUSE )
     {
       if( keyboard_ctrl_pressed(key) )
@@ -22,7 +22,9 @@
 
 void terminal_receive_char(char c);
 void terminal_receive_string(const char* str);
+void terminal_receive_buffer(const char *buf, size_t len);
 void terminal_process_key(uint16_t key);
+bool terminal_zmodem_requested();
 
 void terminal_clear_screen();
 void terminal_init();
@@ -23,4 +23,22 @@ void tmds_encode_font_2bpp_sw(const uint16_t *charbuf, const uint32_t *colourbuf
 void tmds_encode_font_2bpp_dw(const uint16_t *charbuf, const uint32_t *colourbuf,
                               uint32_t *tmdsbuf, uint n_pix, const uint8_t *font_line);
 
+// The LUTs used by the encoders above: for each of the 16 palettes, 16 entries
+// of 2 (sw) or 4 (dw) words holding the TMDS symbols for 4 pixels. Each word
+// only depends on its own pixels so the tables can be used for partial characters.
+extern const uint32_t palettised_1bpp_tables_sw[16 * 16 * 2];
+extern const uint32_t palettised_1bpp_tables_dw[16 * 16 * 4];
+
+#if VERSATERM_DVI_WIDE
+// Same for 6px-wide characters (132 columns in 800 pixels). The font row is
+// narrowed to 6 pixels via tmds_narrow_map, tmds_narrow_lut holds 3 words of
+// TMDS symbols (plus one of padding) for each palette and narrowed font row.
+// Both tables are set up by framebuf_dvi.c. n_pix must be a multiple of 48.
+void tmds_encode_font_2bpp_nw(const uint16_t *charbuf, const uint32_t *colourbuf,
+                              uint32_t *tmdsbuf, uint n_pix, const uint8_t *font_line);
+
+extern uint8_t  tmds_narrow_map[256];
+extern uint32_t tmds_narrow_lut[16 * 64 * 4];
+#endif
+
 #endif
@@ -86,8 +86,9 @@
 #define CFG_TUD_MIDI             0
 #define CFG_TUD_VENDOR           0
 
-// CDC FIFO size of TX and RX
-#define CFG_TUD_CDC_RX_BUFSIZE   (TUD_OPT_HIGH_SPEED ? 512 : 64)
+// CDC FIFO size of TX and RX (RX holds several packets so the host
+// can keep sending while the main loop is busy elsewhere)
+#define CFG_TUD_CDC_RX_BUFSIZE   (TUD_OPT_HIGH_SPEED ? 2048 : 1024)
 #define CFG_TUD_CDC_TX_BUFSIZE   (TUD_OPT_HIGH_SPEED ? 512 : 64)
 
 // CDC Endpoint transfer buffer size, more is faster
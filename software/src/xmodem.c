@@ -34,6 +34,7 @@ static const unsigned char NACK = 21;
 static const unsigned char ACK =  6;
 
 static const unsigned char SOH =  1;
+static const unsigned char STX =  2;
 static const unsigned char EOT =  4;
 static const unsigned char CAN =  0x18;
 
@@ -58,12 +59,17 @@ static unsigned long blockNoExt;
 //retry counter for NACK
 static int retries;
 
-//buffer
-static char buffer[133];
+//buffer (1024 byte frames for XMODEM-1K)
+static char buffer[1024+5];
 
 //repeated block flag
 static bool repeatedBlock, canceled;
 
+//YMODEM batch transfer: file name and size from/for block 0 (size -1 if unknown)
+static bool batch;
+static char fileName[64];
+static long fileSize, fileRemaining;
+
 
 static int  (*recvChar)(int);
 static void (*sendData)(const char *data, int len);
@@ -127,9 +133,9 @@ static bool receiveFrameNo()
 }
 
 
-static bool receiveData()
+static bool receiveData(int len)
 {
-  for(int i = 0; i < 128; i++) {
+  for(int i = 0; i < len; i++) {
     int byte = dataRead(receiveDelay);
     if(byte != -1)
       buffer[i] = (unsigned char)byte;
@@ -140,45 +146,131 @@ static bool receiveData()
 }
 
 
-static unsigned short crc16_ccitt(char *buf, int size)
+//CRC16-CCITT of one byte (polynomial 0x1021)
+static const unsigned short crcTable[256] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+  0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+  0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+  0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+  0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+  0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+  0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+  0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+  0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+  0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+  0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+  0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+  0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+  0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+  0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+  0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+  0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+  0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+  0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+  0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+  0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+  0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+  0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+  0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+  0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+  0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+  0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+  0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+  0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+  0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+  0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+  0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
+};
+
+
+static unsigned short crc16_ccitt(const char *buf, int size)
 {
   unsigned short crc = 0;
-  while (--size >= 0) {
-    int i;
-    crc ^= (unsigned short) *buf++ << 8;
-    for (i = 0; i < 8; i++)
-      if (crc & 0x8000)
-        crc = crc << 1 ^ 0x1021;
-      else
-        crc <<= 1;
-  }
+  while (--size >= 0)
+    crc = (crc << 8) ^ crcTable[((crc >> 8) ^ (unsigned char) *buf++) & 0xFF];
   return crc;
 }
 
 
-static bool checkCrc()
+static bool checkCrc(int len)
 {
   unsigned short frame_crc = ((unsigned char) dataRead(receiveDelay)) << 8;
 
   frame_crc |= (unsigned char)dataRead(receiveDelay);
-  unsigned short crc = crc16_ccitt(buffer, 128);
+  unsigned short crc = crc16_ccitt(buffer, len);
 
   return frame_crc == crc;
 }
 
 
-static bool checkChkSum()
+static bool checkChkSum(int len)
 {
   unsigned char frame_chksum = (unsigned char) dataRead(receiveDelay);
 
   unsigned char chksum = 0;
-  for(int i = 0; i< 128; i++)
+  for(int i = 0; i< len; i++)
     chksum += buffer[i];
 
   return frame_chksum == chksum;
 }
 
 
+static bool receiveFrame(transfer_t transfer, int len)
+{
+  //frame number, data and checksum or crc (after SOH or STX)
+  if (!receiveFrameNo() || !receiveData(len))
+    return false;
+  else if (transfer == Crc)
+    return checkCrc(len);
+  else
+    return checkChkSum(len);
+}
+
+
+static void receiveHeader()
+{
+  //YMODEM block 0: file name, NUL, file size (decimal) and optional further
+  //fields, an empty file name ends the batch
+  batch = true;
+  strncpy(fileName, buffer, sizeof(fileName)-1);
+  fileName[sizeof(fileName)-1] = 0;
+
+  char *end;
+  const char *size = buffer + strnlen(buffer, 1024-1) + 1;
+  fileSize = strtol(size, &end, 10);
+  if (end == size) fileSize = -1;
+  fileRemaining = fileSize;
+}
+
+
+static void receiveBatchEnd(transfer_t transfer)
+{
+  //YMODEM: request the next file header, only single files are received so
+  //an empty header (end of batch) is expected, otherwise the sender is canceled
+  blockNo = 0;
+  for (int i = 0; i < rcvRetryLimit && !canceled; i++)
+    {
+      dataWrite(transfer == Crc ? 'C' : NACK);
+      int cmd = dataRead(1000);
+      if (cmd == SOH || cmd == STX)
+        {
+          if (receiveFrame(transfer, cmd == STX ? 1024 : 128))
+            {
+              if (buffer[0] == 0) {
+                dataWrite(ACK);
+              } else {
+                dataWrite(CAN);
+                dataWrite(CAN);
+              }
+              return;
+            }
+        }
+      else if (cmd == EOT)
+        dataWrite(ACK);
+    }
+}
+
+
 static bool sendNack()
 {
   dataWrite(NACK);	
@@ -198,39 +290,37 @@ static bool receiveFrames(transfer_t transfer)
       switch(cmd)
         {
         case SOH:
-          if (!receiveFrameNo()) 
+        case STX:
+          {
+          int len = (cmd == STX) ? 1024 : 128;
+          if (!receiveFrame(transfer, len))
             {
               if (sendNack())
                 break;
               else
                 return false;
             }
-          if (!receiveData()) 
-            {	
-              if (sendNack())
-                break;
-              else
-                return false;
-            };
-          if (transfer == Crc) {
-            if (!checkCrc()) {
-              if (sendNack())
-                break;
-              else
+          //YMODEM header (block 0 before any data)
+          if (repeatedBlock && blockNoExt == 1)
+            {
+              receiveHeader();
+              dataWrite(ACK);
+              if (fileName[0] == 0)
                 return false;
+              dataWrite(transfer == Crc ? 'C' : NACK);
+              retries = 0;
+              break;
             }
-          } else {
-            if(!checkChkSum()) {
-              if (sendNack())
-                break;
-              else
-                return false;
+          //file size from the YMODEM header removes the padding of the last block
+          if (fileRemaining >= 0)
+            {
+              if (len > fileRemaining && repeatedBlock == false) len = fileRemaining;
+              if (repeatedBlock == false) fileRemaining -= len;
             }
-          }
           //callback
           if(dataHandler != NULL && 
-             repeatedBlock == false)
-            if(!dataHandler(blockNoExt, buffer, 128)) {
+             repeatedBlock == false && len > 0)
+            if(!dataHandler(blockNoExt, buffer, len)) {
               return false;
             }
           //ack
@@ -242,8 +332,10 @@ static bool receiveFrames(transfer_t transfer)
             }
           retries = 0;
           break;
+          }
         case EOT:
           dataWrite(ACK);
+          if (batch) receiveBatchEnd(transfer);
           return true;
         case CAN:
           //wait second CAN
@@ -288,7 +380,76 @@ static unsigned char generateChkSum(const char *buf, int len)
 }
 
 
-bool transmitFrames(transfer_t transfer)
+static void sendFrame(transfer_t transfer, int len)
+{
+  //SOH or STX
+  buffer[0] = (len == 1024) ? STX : SOH;
+  //frame number
+  buffer[1] = blockNo;
+  //inv frame number
+  buffer[2] = (unsigned char)(255-(blockNo));
+  //(data is already in buffer starting at byte 3)
+  //checksum or crc
+  if (transfer == ChkSum) {
+    buffer[3+len] = generateChkSum(buffer+3, len);
+    sendData(buffer, 3+len+1);
+  } else {
+    unsigned short crc;
+    crc = crc16_ccitt(buffer+3, len);
+    buffer[3+len+0] = (unsigned char)(crc >> 8);
+    buffer[3+len+1] = (unsigned char)(crc);
+    sendData(buffer, 3+len+2);
+  }
+}
+
+
+static bool transmitHeader(const char *name, long size)
+{
+  //YMODEM block 0: file name, NUL and file size (an empty name ends the batch),
+  //after it was acknowledged the receiver requests the data with 'C'
+  memset(buffer+3, 0, 128);
+  if (name != NULL)
+    {
+      strncpy(buffer+3, name, 100);
+      snprintf(buffer+3+strlen(buffer+3)+1, 20, "%ld", size);
+    }
+
+  blockNo = 0;
+  for (int i = 0; i < rcvRetryLimit && !canceled; i++)
+    {
+      sendFrame(Crc, 128);
+      int ret = dataRead(receiveDelay);
+      if (ret == ACK)
+        return name == NULL || dataRead(receiveDelay) == 'C';
+      else if (ret == CAN)
+        return false;
+    }
+
+  return false;
+}
+
+
+static bool transmitEnd()
+{
+  //EOT, repeated if the receiver answers with NACK (YMODEM receivers do so once)
+  for (int i = 0; i < rcvRetryLimit && !canceled; i++)
+    {
+      dataWrite(EOT);
+      int ret = dataRead(receiveDelay);
+      if (ret == ACK)
+        {
+          //YMODEM: answer the request for the next file with an empty header
+          return !batch || (dataRead(receiveDelay) == 'C' && transmitHeader(NULL, 0));
+        }
+      else if (ret != NACK)
+        return false;
+    }
+
+  return false;
+}
+
+
+bool transmitFrames(transfer_t transfer, int len)
 {
   blockNo = 1;
   blockNoExt = 1;
@@ -299,12 +460,10 @@ bool transmitFrames(transfer_t transfer)
       //get data
       if (dataHandler != NULL)
         {
-          if( !dataHandler(blockNoExt, buffer+3, 128) )
+          if( !dataHandler(blockNoExt, buffer+3, len) )
             {
               //end of transfer
-              dataWrite(EOT);
-              //wait ACK
-              return (dataRead(receiveDelay) == ACK);
+              return transmitEnd();
             }			
           
         }
@@ -316,24 +475,7 @@ bool transmitFrames(transfer_t transfer)
           //wait ACK
           return (dataRead(receiveDelay) == ACK);
         }
-      //SOH
-      buffer[0] = SOH;
-      //frame number
-      buffer[1] = blockNo;
-      //inv frame number
-      buffer[2] = (unsigned char)(255-(blockNo));
-      //(data is already in buffer starting at byte 3)
-      //checksum or crc
-      if (transfer == ChkSum) {
-        buffer[3+128] = generateChkSum(buffer+3, 128);
-        sendData(buffer, 3+128+1);
-      } else {
-        unsigned short crc;
-        crc = crc16_ccitt(buffer+3, 128);
-        buffer[3+128+0] = (unsigned char)(crc >> 8);
-        buffer[3+128+1] = (unsigned char)(crc);;
-        sendData(buffer, 3+128+2);
-      }
+      sendFrame(transfer, len);
 
       //TO DO - wait NACK or CAN or ACK
       int ret = dataRead(receiveDelay);
@@ -355,6 +497,30 @@ bool transmitFrames(transfer_t transfer)
 }
 
 
+static bool transmit(const char *name, long size)
+{
+  int retry = 0;
+  int sym;
+
+  //wait for CRC transfer (XMODEM-CRC or YMODEM) or checksum transfer (XMODEM),
+  //only YMODEM receivers are sure to accept 1024 byte frames
+  canceled = false;
+  while( (retry < 256) && !canceled )
+    {
+      if(dataAvail(1000))
+        {
+          sym = dataRead(1); //data is here - no delay
+          if(sym == 'C')	
+            return (!batch || transmitHeader(name, size)) && transmitFrames(Crc, batch ? 1024 : 128);
+          if(sym == NACK && !batch)
+            return transmitFrames(ChkSum, 128);
+        }
+      retry++;
+    }	
+  return false;
+}
+
+
 bool xmodem_receive(int (*recvCharFn)(int), 
                     void (*sendDataFn)(const char *data, int len), 
                     bool (*dataHandlerFn)(unsigned long, char*, int))
@@ -364,6 +530,10 @@ bool xmodem_receive(int (*recvCharFn)(int),
   sendData = sendDataFn;
   recvChar = recvCharFn;
   dataHandler = dataHandlerFn;
+  batch = false;
+  fileName[0] = 0;
+  fileSize = -1;
+  fileRemaining = -1;
   
   canceled = false;
   for (int i =0; (i <  128) && !canceled; i++)
@@ -387,27 +557,40 @@ bool xmodem_transmit(int (*recvCharFn)(int),
                      void (*sendDataFn)(const char *data, int len), 
                      bool (*dataHandlerFn)(unsigned long, char*, int))
 {
-  int retry = 0;
-  int sym;
   init();
 
   sendData = sendDataFn;
   recvChar = recvCharFn;
   dataHandler = dataHandlerFn;
-  
-  //wait for CRC transfer
-  canceled = false;
-  while( (retry < 256) && !canceled )
-    {
-      if(dataAvail(1000))
-        {
-          sym = dataRead(1); //data is here - no delay
-          if(sym == 'C')	
-            return transmitFrames(Crc);
-          if(sym == NACK)
-            return transmitFrames(ChkSum);
-        }
-      retry++;
-    }	
-  return false;
+  batch = false;
+
+  return transmit(NULL, 0);
+}
+
+
+bool ymodem_transmit(int (*recvCharFn)(int), 
+                     void (*sendDataFn)(const char *data, int len), 
+                     bool (*dataHandlerFn)(unsigned long, char*, int),
+                     const char *name, long size)
+{
+  init();
+
+  sendData = sendDataFn;
+  recvChar = recvCharFn;
+  dataHandler = dataHandlerFn;
+  batch = true;
+
+  return transmit(name, size);
+}
+
+
+const char *xmodem_get_filename()
+{
+  return batch ? fileName : NULL;
+}
+
+
+long xmodem_get_filesize()
+{
+  return batch ? fileSize : -1;
 }
@@ -1,6 +1,13 @@
 #ifndef XMODEM_H
 #define XMODEM_H
 
+// dataHandler is called with the block number, data and length of each
+// block: 128 or 1024 (XMODEM-1K) bytes, less for the last block of a YMODEM
+// file when receiving. When transmitting it must fill the given number of bytes
+// and return false once all data was sent. xmodem_transmit sends 128 byte blocks
+// (with CRC or checksum, as the receiver asks), ymodem_transmit 1024 byte blocks.
+
+// receives via XMODEM, XMODEM-1K or YMODEM (single file), depending on the sender
 bool xmodem_receive(int (*recvChar)(int), 
                     void (*sendData)(const char *data, int len), 
                     bool (*dataHandler)(unsigned long, char*, int));
@@ -9,4 +16,14 @@ bool xmodem_transmit(int (*recvChar)(int),
                      void (*sendData)(const char *data, int len), 
                      bool (*dataHandler)(unsigned long, char*, int));
 
+bool ymodem_transmit(int (*recvChar)(int), 
+                     void (*sendData)(const char *data, int len), 
+                     bool (*dataHandler)(unsigned long, char*, int),
+                     const char *fileName, long fileSize);
+
+// file name and size from the YMODEM header of the current/last transfer
+// (NULL and -1 for XMODEM transfers or if the size was not given)
+const char *xmodem_get_filename();
+long xmodem_get_filesize();
+
 #endif
@@ -0,0 +1,489 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "zmodem.h"
+
+#define ZPAD     '*'
+#define ZDLE     0x18
+#define ZBIN     'A'
+#define ZHEX     'B'
+#define ZBIN32   'C'
+
+// frame types
+#define ZRQINIT  0
+#define ZRINIT   1
+#define ZSINIT   2
+#define ZACK     3
+#define ZFILE    4
+#define ZSKIP    5
+#define ZNAK     6
+#define ZABORT   7
+#define ZFIN     8
+#define ZRPOS    9
+#define ZDATA    10
+#define ZEOF     11
+#define ZFERR    12
+#define ZCRC     13
+#define ZCOMPL   15
+#define ZCAN     16
+#define ZFREECNT 17
+
+// ZDLE sequences ending a data subpacket and escaping DEL
+#define ZCRCE    'h'
+#define ZCRCG    'i'
+#define ZCRCQ    'j'
+#define ZCRCW    'k'
+#define ZRUB0    'l'
+#define ZRUB1    'm'
+
+// receiver capabilities sent in ZRINIT (ZF0): full duplex, can receive while
+// processing data, can use 32-bit CRC
+#define CANFDX   0x01
+#define CANOVIO  0x02
+#define CANFC32  0x20
+#define RINITHDR (((uint32_t) (CANFC32 | CANFDX | CANOVIO)) << 24)
+
+// results from reading besides data bytes (subpacket ends are returned as GOTOR|ZCRCx)
+#define GOTOR    0x100
+#define RTIMEOUT -1
+#define RCANCEL  -2
+#define RERROR   -3
+
+#define XON      0x11
+#define XOFF     0x13
+
+static const int receiveDelay  = 7000;
+static const int rcvRetryLimit = 10;
+
+static int  (*recvChar)(int);
+static void (*sendData)(const char *data, int len);
+
+// buffer for one data subpacket
+static char buffer[1024+1];
+
+// header data (ZP0..ZP3) and CRC type of the last received header
+static uint8_t header[4];
+static bool crc32;
+
+// number of consecutive CAN characters received
+static int cancount;
+
+
+//CRC-32 of one byte (reflected polynomial 0xEDB88320)
+static const uint32_t crc32Table[256] = {
+  0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F,
+  0xE963A535, 0x9E6495A3, 0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988,
+  0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91, 0x1DB71064, 0x6AB020F2,
+  0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
+  0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9,
+  0xFA0F3D63, 0x8D080DF5, 0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172,
+  0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B, 0x35B5A8FA, 0x42B2986C,
+  0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
+  0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423,
+  0xCFBA9599, 0xB8BDA50F, 0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924,
+  0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D, 0x76DC4190, 0x01DB7106,
+  0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
+  0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D,
+  0x91646C97, 0xE6635C01, 0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E,
+  0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457, 0x65B0D9C6, 0x12B7E950,
+  0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
+  0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7,
+  0xA4D1C46D, 0xD3D6F4FB, 0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0,
+  0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9, 0x5005713C, 0x270241AA,
+  0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
+  0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81,
+  0xB7BD5C3B, 0xC0BA6CAD, 0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A,
+  0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683, 0xE3630B12, 0x94643B84,
+  0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
+  0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB,
+  0x196C3671, 0x6E6B06E7, 0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC,
+  0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5, 0xD6D6A3E8, 0xA1D1937E,
+  0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
+  0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55,
+  0x316E8EEF, 0x4669BE79, 0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236,
+  0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F, 0xC5BA3BBE, 0xB2BD0B28,
+  0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
+  0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F,
+  0x72076785, 0x05005713, 0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38,
+  0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21, 0x86D3D2D4, 0xF1D4E242,
+  0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
+  0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69,
+  0x616BFFD3, 0x166CCF45, 0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2,
+  0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB, 0xAED16A4A, 0xD9D65ADC,
+  0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
+  0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693,
+  0x54DE5729, 0x23D967BF, 0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
+  0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
+};
+
+
+static uint32_t updcrc32(uint32_t crc, uint8_t b)
+{
+  return crc32Table[(crc ^ b) & 0xFF] ^ (crc >> 8);
+}
+
+
+static uint16_t updcrc16(uint16_t crc, uint8_t b)
+{
+  // CRC16-CCITT (polynomial 0x1021), only used for headers and by senders
+  // that do not support 32-bit CRCs
+  crc ^= ((uint16_t) b) << 8;
+  for(int i=0; i<8; i++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+  return crc;
+}
+
+
+static int readByte(int delay)
+{
+  // read one byte, ignoring XON/XOFF flow control characters (the sender
+  // escapes them when they are part of the data)
+  while( true )
+    {
+      int c = recvChar(delay);
+      if( c==-2 ) 
+        return RCANCEL;
+      else if( c<0 )
+        return RTIMEOUT;
+      else if( (c & 0x7F)!=XON && (c & 0x7F)!=XOFF )
+        {
+          cancount = (c==ZDLE) ? cancount+1 : 0;
+          return cancount>=5 ? RCANCEL : c;
+        }
+    }
+}
+
+
+static int readEscaped()
+{
+  // read one (possibly ZDLE-escaped) byte of a binary header or data subpacket
+  int c = readByte(receiveDelay);
+  if( c!=ZDLE ) return c;
+
+  // more ZDLEs are the start of a cancel sequence, readByte returns
+  // RCANCEL once five of them were received
+  do { c = readByte(receiveDelay); } while( c==ZDLE );
+  if( c<0 ) return c;
+
+  switch( c )
+    {
+    case ZCRCE: 
+    case ZCRCG: 
+    case ZCRCQ: 
+    case ZCRCW: return GOTOR | c;
+    case ZRUB0: return 0x7F;
+    case ZRUB1: return 0xFF;
+    }
+
+  return (c & 0x60)==0x40 ? c ^ 0x40 : RERROR;
+}
+
+
+static int readHex()
+{
+  int v = 0;
+  for(int i=0; i<2; i++)
+    {
+      int c = readByte(receiveDelay);
+      if( c<0 ) return c;
+      c &= 0x7F;
+      if( c>='0' && c<='9' )
+        v = v*16 + c-'0';
+      else if( c>='a' && c<='f' )
+        v = v*16 + c-'a'+10;
+      else
+        return RERROR;
+    }
+
+  return v;
+}
+
+
+static int getHeader()
+{
+  // hunt for ZPAD ZDLE, then read a hex or binary header, returns
+  // the frame type or a negative value for errors
+  int c, pads = 0;
+  uint8_t hdr[9];
+
+  for(int garbage=0; garbage<16384; garbage++)
+    {
+      c = readByte(receiveDelay);
+      if( c<0 ) return c;
+
+      if( (c & 0x7F)==ZPAD )
+        pads++;
+      else if( c==ZDLE && pads>0 )
+        {
+          int format = readByte(receiveDelay);
+          if( format<0 ) return format;
+
+          int n = (format==ZBIN32) ? 9 : 7;
+          if( format==ZHEX )
+            {
+              for(int i=0; i<7; i++)
+                if( (c = readHex())<0 ) return c; else hdr[i] = c;
+
+              // skip CR/LF following the header (XON is ignored by readByte)
+              if( ((c = readByte(100)) & 0x7F)=='\r' ) readByte(100);
+            }
+          else if( format==ZBIN || format==ZBIN32 )
+            {
+              for(int i=0; i<n; i++)
+                if( (c = readEscaped())<0 || c>0xFF ) return c<0 ? c : RERROR; else hdr[i] = c;
+            }
+          else
+            { pads = 0; continue; }
+
+          if( format==ZBIN32 )
+            {
+              uint32_t crc = 0xFFFFFFFF;
+              for(int i=0; i<5; i++) crc = updcrc32(crc, hdr[i]);
+              if( ~crc != (hdr[5] | (hdr[6]<<8) | (hdr[7]<<16) | ((uint32_t) hdr[8]<<24)) ) return RERROR;
+            }
+          else
+            {
+              uint16_t crc = 0;
+              for(int i=0; i<5; i++) crc = updcrc16(crc, hdr[i]);
+              if( crc != ((hdr[5]<<8) | hdr[6]) ) return RERROR;
+            }
+
+          // the CRC type of the data subpackets following a header depends on the header
+          crc32 = format==ZBIN32;
+          memcpy(header, hdr+1, 4);
+          return hdr[0];
+        }
+      else
+        pads = 0;
+    }
+
+  return RERROR;
+}
+
+
+static uint32_t headerPos()
+{
+  return header[0] | (header[1]<<8) | (header[2]<<16) | ((uint32_t) header[3]<<24);
+}
+
+
+static void sendHexHeader(uint8_t type, uint32_t pos)
+{
+  uint8_t hdr[5] = {type, pos & 0xFF, (pos>>8) & 0xFF, (pos>>16) & 0xFF, (pos>>24) & 0xFF};
+  uint16_t crc = 0;
+  for(int i=0; i<5; i++) crc = updcrc16(crc, hdr[i]);
+
+  char buf[24];
+  int n = sprintf(buf, "**\x18" "B%02x%02x%02x%02x%02x%04x\r\x8a", hdr[0], hdr[1], hdr[2], hdr[3], hdr[4], crc);
+  if( type!=ZFIN && type!=ZACK ) buf[n++] = XON;
+  sendData(buf, n);
+}
+
+
+static int receiveData(int *len)
+{
+  // receive one data subpacket into the buffer, returns how the
+  // subpacket ended (ZCRCE/ZCRCG/ZCRCQ/ZCRCW) or a negative value for errors
+  uint32_t crc = crc32 ? 0xFFFFFFFF : 0;
+  *len = 0;
+
+  while( true )
+    {
+      int c = readEscaped();
+      if( c<0 )
+        return c;
+      else if( c & GOTOR )
+        {
+          c &= 0xFF;
+          uint32_t rcrc = 0;
+          if( crc32 )
+            {
+              crc = ~updcrc32(crc, c);
+              for(int i=0; i<4; i++)
+                {
+                  int b = readEscaped();
+                  if( b<0 || b>0xFF ) return b<0 ? b : RERROR;
+                  rcrc |= ((uint32_t) b) << (8*i);
+                }
+            }
+          else
+            {
+              crc = updcrc16(crc, c);
+              for(int i=0; i<2; i++)
+                {
+                  int b = readEscaped();
+                  if( b<0 || b>0xFF ) return b<0 ? b : RERROR;
+                  rcrc = (rcrc << 8) | b;
+                }
+            }
+
+          return rcrc==crc ? c : RERROR;
+        }
+      else if( *len>=1024 )
+        return RERROR;
+
+      buffer[(*len)++] = c;
+      crc = crc32 ? updcrc32(crc, c) : updcrc16(crc, c);
+    }
+}
+
+
+static void cancel()
+{
+  static const char canistr[] = {ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8};
+  sendData(canistr, sizeof(canistr));
+}
+
+
+bool zmodem_receive(int (*_recvChar)(int), 
+                    void (*_sendData)(const char *data, int len), 
+                    bool (*fileStart)(const char *fileName, long fileSize),
+                    bool (*dataHandler)(unsigned long, char*, int),
+                    void (*fileEnd)(bool ok))
+{
+  bool inFile = false;
+  unsigned long blockNo = 0;
+  uint32_t pos = 0;
+  int retries = 0, len, end;
+
+  recvChar = _recvChar;
+  sendData = _sendData;
+  cancount = 0;
+
+  sendHexHeader(ZRINIT, RINITHDR);
+  while( retries<rcvRetryLimit )
+    {
+      int type = getHeader();
+      switch( type )
+        {
+        case ZRQINIT:
+          sendHexHeader(ZRINIT, RINITHDR);
+          retries++;
+          break;
+
+        case ZSINIT:
+          // attention string is not needed (we never interrupt the sender)
+          end = receiveData(&len);
+          if( end==RCANCEL ) 
+            type = RCANCEL;
+          else 
+            sendHexHeader(end<0 ? ZNAK : ZACK, 1);
+          break;
+
+        case ZFILE:
+          {
+            // file name followed by size, modification date etc. as text
+            end = receiveData(&len);
+            if( end==RCANCEL )
+              { type = RCANCEL; break; }
+            else if( end<0 )
+              { sendHexHeader(ZNAK, 0); retries++; break; }
+
+            if( inFile ) fileEnd(false);
+            buffer[len] = 0;
+            int nameLen = strlen(buffer);
+            long size = (nameLen+1<len && buffer[nameLen+1]!=0) ? strtol(buffer+nameLen+1, NULL, 10) : -1;
+            inFile = fileStart(buffer, size);
+            pos = 0;
+            blockNo = 0;
+            retries = 0;
+            sendHexHeader(inFile ? ZRPOS : ZSKIP, 0);
+            break;
+          }
+
+        case ZDATA:
+          if( !inFile || headerPos()!=pos )
+            {
+              // data for a skipped file or at the wrong position
+              sendHexHeader(inFile ? ZRPOS : ZSKIP, pos);
+              retries++;
+              break;
+            }
+
+          // receive data subpackets until the end of the frame
+          do
+            {
+              end = receiveData(&len);
+              if( end<0 )
+                {
+                  if( end!=RCANCEL ) { sendHexHeader(ZRPOS, pos); retries++; }
+                  break;
+                }
+              else if( !dataHandler(++blockNo, buffer, len) )
+                {
+                  end = RCANCEL;
+                  break;
+                }
+
+              pos += len;
+              retries = 0;
+              if( end==ZCRCQ || end==ZCRCW ) sendHexHeader(ZACK, pos);
+            }
+          while( end==ZCRCG || end==ZCRCQ );
+
+          if( end==RCANCEL ) type = RCANCEL;
+          break;
+
+        case ZEOF:
+          // ZEOF for another position is ignored (data has been lost and ZRPOS was sent)
+          if( inFile && headerPos()==pos )
+            {
+              inFile = false;
+              fileEnd(true);
+              sendHexHeader(ZRINIT, RINITHDR);
+            }
+          else if( !inFile )
+            sendHexHeader(ZRINIT, RINITHDR);
+          break;
+
+        case ZFIN:
+          // end of session, sender responds with "OO" (over and out)
+          if( inFile ) fileEnd(false);
+          sendHexHeader(ZFIN, 0);
+          if( readByte(500)=='O' ) readByte(500);
+          return true;
+
+        case ZFREECNT:
+          sendHexHeader(ZACK, 0xFFFFFFFF);
+          break;
+
+        case RCANCEL:
+        case ZCAN:
+        case ZABORT:
+          type = RCANCEL;
+          break;
+
+        default:
+          // timeout, error or unsupported frame (ZCOMMAND, ZCRC, ...)
+          sendHexHeader(inFile ? ZRPOS : ZRINIT, inFile ? pos : RINITHDR);
+          retries++;
+          break;
+        }
+
+      if( type==RCANCEL ) break;
+    }
+
+  cancel();
+  if( inFile ) fileEnd(false);
+  return false;
+}
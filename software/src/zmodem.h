@@ -0,0 +1,37 @@
+// -----------------------------------------------------------------------------
+// VersaTerm - A versatile serial terminal
+// Copyright (C) 2022 David Hansel
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+#ifndef ZMODEM_H
+#define ZMODEM_H
+
+#include <stdbool.h>
+
+// receives a ZMODEM batch (the sender having been started e.g. with "sz file").
+// For each file fileStart is called with the file name and size (-1 if unknown),
+// returning false skips the file. Data is passed to dataHandler in blocks of up to
+// 1024 bytes (block numbers start at 1 for each file), returning false cancels the
+// transfer. fileEnd is called once for each started file, ok is false if the file
+// was not received completely. Returns true if the session ended regularly.
+bool zmodem_receive(int (*recvChar)(int),
+                    void (*sendData)(const char *data, int len),
+                    bool (*fileStart)(const char *fileName, long fileSize),
+                    bool (*dataHandler)(unsigned long, char*, int),
+                    void (*fileEnd)(bool ok));
+
+#endif